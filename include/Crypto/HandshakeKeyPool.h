@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Crypto/NetRSA.h"
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+class ThreadPool;
+
+namespace net
+{
+	/**
+	 * \brief Keeps a queue of RSA key pairs that are generated ahead of time on a ThreadPool.
+	 * Generating a key pair takes milliseconds, so a server that generates one per connecting client stalls everyone else,
+	 * and a burst of reconnects after a restart takes very long to clear.
+	 * \warning The ThreadPool should be destroyed, which finishes the generation jobs, before the HandshakeKeyPool.
+	 */
+	class HandshakeKeyPool
+	{
+	public:
+		/**
+		 * \param readyTarget The amount of key pairs to keep ready.
+		 */
+		HandshakeKeyPool(ThreadPool& workers, std::size_t readyTarget);
+
+		HandshakeKeyPool(const HandshakeKeyPool&) = delete;
+		HandshakeKeyPool& operator=(const HandshakeKeyPool&) = delete;
+
+		/**
+		 * \brief Takes a ready key pair and starts generating its replacement.
+		 * \return bool False when no key pair is ready yet.
+		 */
+		bool TryAcquire(NetRSAKey& privateKey, NetRSAKey& publicKey);
+
+		std::size_t GetReadyCount() const;
+
+	private:
+		struct KeyPair
+		{
+			NetRSAKey privateKey;
+			NetRSAKey publicKey;
+		};
+
+		/**
+		 * \brief Starts generation jobs until the ready and generating key pairs reach the target.
+		 * At most one job per worker runs at a time, so other jobs on the pool aren't starved.
+		 */
+		void Refill();
+		void Generate();
+
+		ThreadPool& workers;
+		const std::size_t readyTarget;
+
+		mutable std::mutex mutex{};
+		std::deque<KeyPair> ready{};
+		std::size_t generating{ 0 };
+	};
+}
@@ -2,6 +2,8 @@
 
 #include "Crypto/NetRSA.h"
 #include "Crypto/NetAES.h"
+#include "Crypto/NetAEAD.h"
+#include "Crypto/KeyExchange.h"
 
 namespace net
 {
@@ -9,6 +11,14 @@ namespace net
 	{
 		NetRSA handshakeKey;
 		NetAES dataKey;
+		/**
+		 * \brief Replaces dataKey on the data channel when a cipher was negotiated.
+		 */
+		NetAEAD channelKey{};
+		/**
+		 * \brief The key pair of the server during the key share handshake, cleared once the channel key is derived.
+		 */
+		KeyExchange keyExchange{};
 	};
 
 	inline KeyChain EmptyKeyChain()
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Crypto/NetAES.h"
+
+#include <cstddef>
+
+namespace net
+{
+	/**
+	 * \brief An ephemeral X25519 key pair for the key share handshake.
+	 * Both sides send their public key, and derive the same data channel key from the shared secret using HKDF-SHA256,
+	 * with both public keys as salt so the key is bound to this exchange.
+	 */
+	class KeyExchange
+	{
+	public:
+		KeyExchange() = default;
+
+		/**
+		 * \brief Generates a new key pair.
+		 */
+		static KeyExchange Generate();
+
+		bool IsValid() const noexcept { return this->valid; }
+		const unsigned char* GetPublicKey() const noexcept { return this->publicKey; }
+
+		/**
+		 * \brief Derives the data channel key from the public key of the peer.
+		 * \param isServer Whether this side is the server, so both sides put the public keys in the same order.
+		 * \return bool False when the public key of the peer is invalid.
+		 */
+		bool DeriveKey(const unsigned char* peerPublicKey, bool isServer, NetAESKey& keyOut) const;
+
+		/**
+		 * \brief Derives a NetAES::keyLength key from a secret using HKDF-SHA256.
+		 * \param info Separates the keys derived for different purposes from the same secret.
+		 */
+		static bool ExpandKey(const unsigned char* secret, std::size_t secretSize, const unsigned char* salt, std::size_t saltSize, const char* info, NetAESKey& keyOut);
+
+		/**
+		 * \brief Wipes the key pair, it should only be used for one exchange.
+		 */
+		void Clear() noexcept;
+
+		static constexpr std::size_t keySize = 32; // bytes
+
+	private:
+		unsigned char privateKey[keySize]{};
+		unsigned char publicKey[keySize]{};
+		bool valid{ false };
+	};
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Crypto/NetAES.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace net
+{
+	/**
+	 * \brief The AEAD ciphers the data channel can negotiate during the handshake.
+	 * The values are bit positions in the mask the server sends with NetCommands::HandshakeServerKey and NetCommands::HandshakeKeyShare.
+	 */
+	enum class AeadCipher : unsigned char
+	{
+		/**
+		 * \brief Not negotiated, the data channel uses NetAES.
+		 */
+		None = 0,
+		AesGcm = 1,
+		ChaCha20Poly1305 = 2
+	};
+
+	/**
+	 * \brief Authenticated encryption of the data channel, with 256 bit keys.
+	 * The nonce is never sent: it is the direction of the message followed by a per-direction message counter.
+	 * Because the data channel is reliable and ordered, a message that doesn't carry the next expected counter fails to open,
+	 * so tampered, replayed and reordered messages are all rejected.
+	 * \warning An instance should only be used by one thread at a time.
+	 */
+	class NetAEAD
+	{
+	public:
+		NetAEAD() = default;
+		/**
+		 * \param isServer Whether this side is the server, which picks the direction byte of the nonces.
+		 */
+		NetAEAD(AeadCipher cipher, NetAESKey key, bool isServer);
+		NetAEAD(const NetAEAD& other);
+		NetAEAD(NetAEAD&& other) noexcept;
+		NetAEAD& operator=(const NetAEAD& other);
+		NetAEAD& operator=(NetAEAD&& other) noexcept;
+		~NetAEAD();
+
+		/**
+		 * \brief Encrypts dataSize bytes in place and authenticates them together with the additional data.
+		 * \param tagOut Receives tagSize bytes.
+		 */
+		bool Seal(unsigned char* buffer, const size_t dataSize, const unsigned char* additionalData, const size_t additionalDataSize, unsigned char* tagOut);
+		/**
+		 * \brief Decrypts dataSize bytes in place.
+		 * \return bool False when the message was tampered with or isn't the next message, the buffer is then unspecified.
+		 */
+		bool Open(unsigned char* buffer, const size_t dataSize, const unsigned char* additionalData, const size_t additionalDataSize, const unsigned char* tag);
+
+		bool IsActive() const noexcept { return this->cipher != AeadCipher::None; }
+		AeadCipher GetCipher() const noexcept { return this->cipher; }
+
+		/**
+		 * \brief The ciphers this build supports, as a mask of 1 << AeadCipher.
+		 */
+		static unsigned int SupportedCiphers() noexcept;
+		/**
+		 * \brief Picks the fastest cipher of the mask on this CPU: AES-GCM with hardware AES, ChaCha20-Poly1305 without.
+		 */
+		static AeadCipher PreferredCipher(unsigned int cipherMask) noexcept;
+
+		static constexpr size_t tagSize = 16; // bytes
+		static constexpr size_t nonceSize = 12; // bytes
+
+	private:
+		struct ContextDeleter
+		{
+			void operator()(EVP_CIPHER_CTX* ctx) const;
+		};
+		using ContextPtr = std::unique_ptr<EVP_CIPHER_CTX, ContextDeleter>;
+
+		EVP_CIPHER_CTX* GetContext(ContextPtr& context, bool encrypt);
+		void MakeNonce(unsigned char direction, unsigned long long counter, unsigned char* nonce) const noexcept;
+
+		AeadCipher cipher{ AeadCipher::None };
+		NetAESKey key{};
+		bool isServer{ false };
+
+		unsigned long long sendCounter{ 0 };
+		unsigned long long receiveCounter{ 0 };
+
+		ContextPtr encryptContext{};
+		ContextPtr decryptContext{};
+	};
+}
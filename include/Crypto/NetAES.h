@@ -2,6 +2,8 @@
 
 #include <memory>
 
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
 namespace net
 {
 	struct NetAESKey
@@ -10,11 +12,38 @@ namespace net
 		std::shared_ptr<unsigned char> key;
 	};
 
+	/**
+	 * \brief AES-256-CBC with random padding.
+	 * The cipher contexts are created on first use and keep the expanded key, so every message only sets a new IV.
+	 * Copies share the key but get their own contexts.
+	 * \warning An instance should only be used by one thread at a time.
+	 */
 	class NetAES
 	{
 	public:
 		NetAES();
 		NetAES(NetAESKey key);
+		NetAES(const NetAES& other);
+		NetAES(NetAES&& other) noexcept;
+		NetAES& operator=(const NetAES& other);
+		NetAES& operator=(NetAES&& other) noexcept;
+		~NetAES();
+
+		/**
+		 * \brief Encrypts in place.
+		 * \param buffer Holds dataSize bytes of data, followed by room for at least GetPaddingSize(dataSize) bytes of padding.
+		 * \param ivOut Receives the ivLength bits of IV that were used.
+		 * \return size_t The size of the encrypted data, dataSize + paddingSize, or 0 when encrypting failed.
+		 */
+		size_t EncryptInPlace(unsigned char* buffer, const size_t dataSize, unsigned char* ivOut, size_t& paddingSize);
+		/**
+		 * \brief Decrypts in place.
+		 * \param dataSize The size of the encrypted data, a multiple of blockSize.
+		 * \return size_t The size of the decrypted data without the padding, or 0 when decrypting failed.
+		 */
+		size_t DecryptInPlace(unsigned char* buffer, const size_t dataSize, const unsigned char* ivIn, size_t paddingSize);
+
+		static size_t GetPaddingSize(const size_t dataSize) noexcept { return (blockSize - dataSize % blockSize) % blockSize; }
 
 		void Encrypt(const unsigned char* data, const size_t dataSize, std::unique_ptr<unsigned char[]>& ivOut, std::unique_ptr<unsigned char[]>& encryptedData, size_t& encryptedDataSize, size_t& paddingSize);
 		void Decrypt(const unsigned char* data, const size_t dataSize, unsigned char* ivIn, std::unique_ptr<unsigned char[]>& decryptedData, size_t& decryptedDataSize, size_t paddingSize);
@@ -29,9 +58,21 @@ namespace net
 		static constexpr int ivLength = 128; // bits
 		static constexpr int blockSize = 16; // bytes
 	private:
-		unsigned char* AddPadding(unsigned char* data, const size_t dataSize, size_t& paddingSize);
-		unsigned char* RemovePadding(unsigned char* data, const size_t dataSize, size_t paddingSize);
+		struct ContextDeleter
+		{
+			void operator()(EVP_CIPHER_CTX* ctx) const;
+		};
+		using ContextPtr = std::unique_ptr<EVP_CIPHER_CTX, ContextDeleter>;
+
+		/**
+		 * \brief Creates the context with the key expanded, or returns the cached one.
+		 */
+		EVP_CIPHER_CTX* GetEncryptContext();
+		EVP_CIPHER_CTX* GetDecryptContext();
 
 		NetAESKey key{};
+
+		ContextPtr encryptContext{};
+		ContextPtr decryptContext{};
 	};
 }
@@ -34,14 +34,18 @@ namespace net
 		static void GenerateKeyPair(const int keySize, NetRSAKey& publicKey, NetRSAKey& privateKey);
 
 		void Encrypt(const unsigned char* data, const size_t dataSize, std::unique_ptr<unsigned char[]>& encryptedData, size_t& encryptedDataSize);
+		/**
+		 * \brief Only reads the key, so a copy of the NetRSA can decrypt on another thread.
+		 * \param decryptedDataSize Is 0 when decrypting failed.
+		 */
 		void Decrypt(const unsigned char* data, const size_t dataSize, std::unique_ptr<unsigned char[]>& decryptedData, size_t& decryptedDataSize);
 
+		static constexpr int keyLength = 1024; // bits
+
 	private:
 		void Equalize(NetRSAKey& key);
 
 		NetRSAKey privateKey{};
 		NetRSAKey publicKey{};
-
-		static constexpr int keyLength = 1024; // bits
 	};
 }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+namespace net
+{
+	/**
+	 * \brief Cryptographically secure random bytes for keys, IVs, padding and tickets.
+	 * Every thread has its own AES-256-CTR generator that is seeded from the OpenSSL RNG, which uses getrandom on Linux and BCryptGenRandom on Windows.
+	 * The generator refills a buffer in batches and takes the key for the next batch from the keystream itself,
+	 * so bytes that were handed out can't be recovered from the state. It reseeds from the OpenSSL RNG after reseedInterval bytes.
+	 */
+	class SecureRandom
+	{
+	public:
+		/**
+		 * \brief Fills the buffer with random bytes. Thread safe and lock free.
+		 */
+		static void Fill(unsigned char* out, std::size_t size);
+
+		static constexpr std::size_t bufferSize = 4096; // bytes
+		static constexpr std::size_t reseedInterval = 1 << 20; // bytes
+	};
+}
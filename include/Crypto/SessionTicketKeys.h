@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace net
+{
+	/**
+	 * \brief The HKDF info of the channel key of a resumed session.
+	 */
+	constexpr const char* resumptionKeyInfo = "tbsg resumption data channel";
+
+	/**
+	 * \brief Encrypts and authenticates session resumption tickets with AES-256-GCM, under keys that only the server knows.
+	 * The key rotates every ticket lifetime and the previous key is kept, so a ticket can be redeemed until it expires.
+	 * A ticket is only redeemed once: redeemed tickets are remembered until they expire, which rejects replays.
+	 * Thread safe, so the shards of a ServerGroup can share one instance.
+	 */
+	class SessionTicketKeys
+	{
+	public:
+		explicit SessionTicketKeys(std::chrono::seconds lifetime = std::chrono::minutes(10));
+		~SessionTicketKeys();
+
+		SessionTicketKeys(const SessionTicketKeys&) = delete;
+		SessionTicketKeys& operator=(const SessionTicketKeys&) = delete;
+
+		/**
+		 * \brief Creates a ticket around the data, which expires one lifetime from now.
+		 * \return std::vector<unsigned char> The ticket, empty when encrypting failed.
+		 */
+		std::vector<unsigned char> Seal(const unsigned char* data, std::size_t size);
+		/**
+		 * \brief Decrypts a ticket without redeeming it.
+		 * \param expiresAt Receives the time the ticket expires, in microseconds of the steady clock.
+		 * \return bool False when the ticket is malformed, tampered with, expired or its key rotated out.
+		 */
+		bool Open(const unsigned char* ticket, std::size_t size, std::vector<unsigned char>& data, long long& expiresAt);
+		/**
+		 * \brief Marks an opened ticket as used.
+		 * \return bool False when the ticket was already redeemed.
+		 */
+		bool Redeem(const unsigned char* ticket, std::size_t size, long long expiresAt);
+
+		std::chrono::seconds GetLifetime() const noexcept { return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::microseconds(lifetime)); }
+
+		static constexpr std::size_t keySize = 32; // bytes
+		static constexpr std::size_t nonceSize = 12; // bytes
+		static constexpr std::size_t tagSize = 16; // bytes
+		/**
+		 * \brief The bytes a ticket adds to its data: the key id, the nonce, the expiry and the tag.
+		 */
+		static constexpr std::size_t overhead = 1 + nonceSize + sizeof(long long) + tagSize;
+
+	private:
+		struct Key
+		{
+			unsigned char bytes[keySize];
+			unsigned char id;
+			long long createdAt;
+		};
+
+		static long long Now() noexcept;
+		void Rotate(long long now);
+		const Key* FindKey(unsigned char id) const noexcept;
+
+		const long long lifetime; // microseconds
+
+		std::mutex mutex{};
+		Key current{};
+		Key previous{};
+		bool hasPrevious{ false };
+
+		/**
+		 * \brief The nonces of the redeemed tickets and when they expire.
+		 */
+		std::unordered_map<std::string, long long> redeemed{};
+		long long nextPurge{ 0 };
+	};
+}
@@ -4,32 +4,67 @@
 #include "Net/Connection.h"
 #include "Net/NetCommands.h"
 #include "Net/Packet.h"
+#include "Net/PacketTracer.h"
+#include "Net/ClockSync.h"
+#include "Net/ClientSession.h"
+#include "Net/CommandOptions.h"
 #include <memory/String.h>
 #include "Utility/Observable.h"
+#include "Utility/SpscRing.h"
 #include "Crypto/KeyChain.h"
 
 #include <map>
+#include <unordered_map>
 #include <functional>
-#include <queue>
-#include <mutex>
+#include <deque>
+#include <memory>
+#include <vector>
 #include <atomic>
 #include <thread>
 #include "enet/enet.h"
 #include "IdentifyResponse.h"
 
+namespace net
+{
+	class ClientSession;
+}
+
 struct NetEvent {
 	ENetEventType type;
 	Packet packet;
+	unsigned int traceId{ 0 };
+	net::ClientSession* session{ nullptr };
 };
 
 namespace net
 {
-	class Client
+	/**
+	 * \brief Connects to one or more servers, using a single ENet host and network thread.
+	 * The client is the handler of its primary session, the members that take no session act on the primary session.
+	 * Additional sessions, like a game server while still in the lobby, are opened using OpenSession(..).
+	 */
+	class Client : public SessionHandler
 	{
+		friend ClientSession;
 	public:
-		Client();
+		/**
+		 * \param maxSessions The maximum amount of sessions, including the primary session.
+		 */
+		explicit Client(std::size_t maxSessions = 1);
 		virtual ~Client();
 
+		/**
+		 * \brief Opens a new session, which has to be connected using ClientSession::Connect(..).
+		 * \return ClientSession* The session, or nullptr when the name is in use or the maximum amount of sessions is reached.
+		 * \warning The handler should outlive the client.
+		 */
+		ClientSession* OpenSession(const std::string& name, SessionHandler* handler);
+		/**
+		 * \return ClientSession* The session with the name, or nullptr when there is none.
+		 */
+		ClientSession* GetSession(const std::string& name) const;
+		ClientSession& GetPrimarySession() const noexcept { return *sessions.front(); }
+
 		void Connect(const char* ip, unsigned short port, unsigned int connectionId = CONNECTION_ID_INVALID);
 		void Disconnect() const;
 		void SendPacket(NetCommands command) const;
@@ -45,51 +80,169 @@ namespace net
 		 * \param packet The packet data associated with the command that will be sent.
 		 */
 		void SendCustomPacket(unsigned int command, Packet& packet) const;
+		RequestFuture SendRequest(unsigned int command, Packet& packet, std::chrono::milliseconds timeout = defaultRequestTimeout) const;
+		void CancelRequest(unsigned int requestId) const;
+		void SendResponse(unsigned int requestId, Packet& packet, RequestStatus status = RequestStatus::Success) const;
+
+		/**
+		 * \brief Sets the options of a custom command, for all sessions. Should be called before connecting, the network thread reads them.
+		 * Commands that aren't registered use the default CommandOptions.
+		 */
+		void RegisterCommand(unsigned int customCommand, CommandOptions options);
+		CommandOptions GetCommandOptions(unsigned int customCommand) const;
 
+		/**
+		 * \brief The network thread services ENet on its own, calling this isn't needed anymore.
+		 * \deprecated Kept so existing game loops keep compiling.
+		 */
 		void ReceivePackets();
+		/**
+		 * \brief Handles the events the network thread received since the last call, for every session. Should be called from the game thread.
+		 */
 		void HandleEvents();
 		void HandleAnyPacket(Packet& packet);
 
-		virtual void OnConnect() {};
-		virtual void OnDisconnect() {};
-		virtual void OnIdentificationSuccess() {};
-		virtual void OnIdentificationFailure(net::IdentifyResponse) {};
-
 		bool IsConnected() const;
 
 		// TODO: https://jira1.nhtv.nl:8443/browse/YDY2019DY2DPTEAM03-156
 		void SetDebug(bool enableDebug) { this->debug = enableDebug; }
 
+		/**
+		 * \brief Pings the server and takes an extra clock synchronization sample.
+		 */
 		void AdditionalPing();
 
+		/**
+		 * \brief The current time of the server clock in microseconds.
+		 * \see Server::ServerTimeNow
+		 */
+		long long ServerTimeNow() const noexcept { return GetPrimarySession().ServerTimeNow(); }
+		/**
+		 * \brief Round trip time to the server in microseconds.
+		 */
+		long long GetRoundTripTime() const noexcept { return GetPrimarySession().GetRoundTripTime(); }
+		const ClockSync& GetClockSync() const noexcept { return GetPrimarySession().GetClockSync(); }
+
 	private:
+		void HandleAnyPacket(ClientSession& session, Packet& packet);
+		void HandlePacket(ClientSession& session, NetCommands command, Packet& packet);
+
 		/**
-		 * \brief Will be called when the user needs to send it's identification over to the server.
-		 * \param packet The packet that will be sent. This packet should be filled with the identification.
+		 * \brief Work the game thread hands over to the network thread.
 		 */
-		virtual void GetIdentity(Packet& packet) = 0;
-		void HandlePacket(NetCommands command, Packet& packet);
-		virtual void HandleCustomPacket(unsigned int customCommand, Packet& packet) = 0;
+		struct NetRequest
+		{
+			enum class Type
+			{
+				Connect,
+				Disconnect,
+				Send,
+				Ping,
+				Request,
+				Cancel
+			};
+
+			Type type{ Type::Send };
+			ClientSession* session{ nullptr };
+			Packet packet{};
+			SecurityLevel security{ SecurityLevel::Plain };
+			std::string host{};
+			unsigned short port{ 0 };
+			unsigned int connectionId{ CONNECTION_ID_INVALID };
+			unsigned int traceId{ 0 };
+
+			unsigned int requestId{ 0 };
+			long long deadline{ 0 };
+			std::promise<RequestResult> promise{};
+		};
+
+		void PushRequest(NetRequest&& request) const;
+		void PushEvent(NetEvent&& event);
 
-		bool isConnected{ false };
-		bool isIdentified{ false };
+		/**
+		 * \brief Runs on the network thread until the client is destroyed.
+		 */
+		void NetworkLoop();
+		void ServiceHost(enet_uint32 timeout);
+		void ProcessRequests();
+		void ProcessRequest(NetRequest& request);
+		void SendFrame(ClientSession& session, NetRequest& request);
+		/**
+		 * \brief Answers the server key with a fresh data key, on the network thread so the handshake doesn't wait for the game loop.
+		 */
+		void HandleServerKey(ClientSession& session, Packet& packet);
+		/**
+		 * \brief Derives the channel key from the key share of the server and sends the encrypted identity, which completes the key share handshake.
+		 */
+		void HandleKeyShare(ClientSession& session, Packet& packet);
+		/**
+		 * \brief Presents the ticket of the session, which restores its keys and identity without a handshake.
+		 */
+		void SendResumption(ClientSession& session);
+		void HandleSessionTicket(ClientSession& session, Packet& packet);
+		/**
+		 * \brief Replaces the contents of a CryptoPacket, AeadPacket or AuthenticatedPacket with the decrypted or verified command and payload.
+		 * \param level Set to how the packet was protected.
+		 * \return bool Whether decrypting succeeded.
+		 */
+		bool DecryptPacket(ClientSession& session, Packet& packet, NetCommands command, unsigned int messageId, SecurityLevel& level);
+		/**
+		 * \brief The SecurityLevel a decrypted packet needs, which is only lower than Encrypted for registered custom commands.
+		 */
+		SecurityLevel GetRequiredSecurity(Packet& packet) const;
+		void SendTimeSync(ClientSession& session);
+		void HandleTimeSyncResponse(ClientSession& session, Packet& packet, long long receiveTime);
+		/**
+		 * \brief Resolves the request on the network thread, the game thread only has to look at the future.
+		 */
+		void HandleCustomResponse(ClientSession& session, Packet& packet);
 
 		ENetHost* client;
-		ENetPeer* serverPeer;
 
-		Connection connection;
+		static constexpr std::size_t ringSize = 1024;
+		/**
+		 * \brief Timeout in milliseconds the network thread waits for ENet events.
+		 */
+		static constexpr enet_uint32 serviceTimeout = 1;
+		/**
+		 * \brief Microseconds between clock synchronization samples, while synchronizing and once synchronized.
+		 */
+		static constexpr long long timeSyncIntervalFast = 250000;
+		static constexpr long long timeSyncInterval = 5000000;
+		/**
+		 * \brief Microseconds a synchronized sample waits for other frames before it is sent on its own.
+		 */
+		static constexpr long long timeSyncIdleDelay = 25000000;
 
-		std::queue<NetEvent> netEventQueue;
+		SpscRing<NetEvent, ringSize> incomingEvents;
+		mutable SpscRing<NetRequest, ringSize> outgoingRequests;
+		/**
+		 * \brief Overflow of the rings, only touched by the thread that pushes into the ring.
+		 * The network thread sends the requests left over once alive was cleared.
+		 */
+		std::deque<NetEvent> pendingEvents;
+		mutable std::deque<NetRequest> pendingRequests;
 
-		mutable std::mutex queueMutex;
-		mutable std::mutex clientMutex;
+		/**
+		 * \brief Owned by the game thread. The first session is the primary session.
+		 */
+		std::vector<std::unique_ptr<ClientSession>> sessions;
+		std::size_t maxSessions;
+		/**
+		 * \brief The sessions the network thread has seen a connect request of. Only used by the network thread.
+		 */
+		std::vector<ClientSession*> networkSessions;
+		std::unordered_map<unsigned int, CommandOptions> commandOptions{};
 
-		std::thread queueThread;
+		std::thread networkThread;
 
 		std::atomic<bool> alive{ true };
-		net::KeyChain keyChain;
 
 		bool debug{ false };
+		/**
+		 * \brief Trace id of the event that is currently being handled. 0 when tracing is disabled.
+		 */
+		unsigned int traceId{ 0 };
 
 		std::string netPrefix = "[Net Core]";
 	};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Net/Connection.h"
+#include "Net/NetCommands.h"
+#include "Net/Packet.h"
+#include "Net/CommandOptions.h"
+#include "Net/ClockSync.h"
+#include "Net/PendingRequests.h"
+#include "Crypto/KeyChain.h"
+#include "IdentifyResponse.h"
+
+#include <string>
+#include <vector>
+#include "enet/enet.h"
+
+namespace net
+{
+	class Client;
+
+	/**
+	 * \brief Receives the events of a ClientSession. Called on the game thread from Client::HandleEvents().
+	 */
+	class SessionHandler
+	{
+	public:
+		virtual ~SessionHandler() = default;
+
+		virtual void OnConnect() {};
+		virtual void OnDisconnect() {};
+		virtual void OnIdentificationSuccess() {};
+		virtual void OnIdentificationFailure(net::IdentifyResponse) {};
+
+		/**
+		 * \brief Will be called when the user needs to send it's identification over to the server.
+		 * \param packet The packet that will be sent. This packet should be filled with the identification.
+		 */
+		virtual void GetIdentity(Packet& packet) = 0;
+		virtual void HandleCustomPacket(unsigned int customCommand, Packet& packet) = 0;
+		/**
+		 * \brief Handles a request of the server, which should be answered using ClientSession::SendResponse(..).
+		 * \return bool Whether the request is handled. Unhandled requests are answered with RequestStatus::Unhandled.
+		 */
+		virtual bool HandleCustomRequest(unsigned int customCommand, Packet& packet, unsigned int requestId) { return false; }
+	};
+
+	/**
+	 * \brief A named connection to one server, like the lobby or a game server.
+	 * Every session has its own keys, identity and handler, but all sessions of a Client share its host and network thread.
+	 * \see Client::OpenSession
+	 */
+	class ClientSession
+	{
+		friend Client;
+	public:
+		ClientSession(Client& client, std::string name, SessionHandler* handler, unsigned int sessionId);
+
+		const std::string& GetName() const noexcept { return name; }
+		SessionHandler* GetHandler() const noexcept { return handler; }
+		/**
+		 * \brief The index of the session in its Client, which tells the sessions apart in the packet traces.
+		 */
+		unsigned int GetSessionId() const noexcept { return sessionId; }
+
+		/**
+		 * \brief Connects with the key share handshake, so the identity is already taken from SessionHandler::GetIdentity(..) here.
+		 * Servers without it fall back to the RSA handshake, which asks for the identity again once the handshake succeeded.
+		 */
+		void Connect(const char* ip, unsigned short port, unsigned int connectionId = CONNECTION_ID_INVALID);
+		void Disconnect() const;
+		void SendPacket(NetCommands command) const;
+		void SendPacket(NetCommands command, Packet& packet, bool encrypted = true) const;
+		/**
+		 * \brief Sends an empty packet with a custom command to the server.
+		 * \param command The command which will be sent.
+		 */
+		void SendCustomPacket(unsigned int command) const;
+		/**
+		 * \brief Sends a packet with a custom command to the server, protected as registered with Client::RegisterCommand(..).
+		 * \param command The command which will be sent.
+		 * \param packet The packet data associated with the command that will be sent.
+		 */
+		void SendCustomPacket(unsigned int command, Packet& packet) const;
+
+		/**
+		 * \brief Sends a custom command the server answers with Server::SendResponse(..).
+		 * \return RequestFuture Resolved by the network thread when the response arrives, the request times out or the session disconnects.
+		 */
+		RequestFuture SendRequest(unsigned int command, Packet& packet, std::chrono::milliseconds timeout = defaultRequestTimeout) const;
+		/**
+		 * \brief Resolves the request with RequestStatus::Cancelled. A response that still arrives is ignored.
+		 */
+		void CancelRequest(unsigned int requestId) const;
+		/**
+		 * \brief Answers a request received in SessionHandler::HandleCustomRequest(..).
+		 */
+		void SendResponse(unsigned int requestId, Packet& packet, RequestStatus status = RequestStatus::Success) const;
+
+		bool IsConnected() const noexcept { return isConnected; }
+		bool IsIdentified() const noexcept { return isIdentified; }
+
+		/**
+		 * \brief The current time of the server clock of this session in microseconds.
+		 */
+		long long ServerTimeNow() const noexcept { return clockSync.RemoteTimeNow(); }
+		long long GetRoundTripTime() const noexcept { return clockSync.GetRoundTripTime(); }
+		const ClockSync& GetClockSync() const noexcept { return clockSync; }
+
+	private:
+		void SendPacket(NetCommands command, Packet& packet, SecurityLevel security) const;
+
+		Client& client;
+		std::string name;
+		SessionHandler* handler;
+		unsigned int sessionId;
+
+		// Only used by the game thread.
+		bool isConnected{ false };
+		bool isIdentified{ false };
+		mutable unsigned int nextRequestId{ 0 };
+
+		// Only used by the network thread.
+		ENetPeer* peer{ nullptr };
+		net::KeyChain keyChain;
+		bool peerConnected{ false };
+		/**
+		 * \brief Received NetCommands::IdentifySuccessful, from then on NetCommands::TimeSync is answered.
+		 */
+		bool established{ false };
+		/**
+		 * \brief Frames were queued since the last ENet service, a due NetCommands::TimeSync can go along with them.
+		 */
+		bool sentFrames{ false };
+		long long nextTimeSync{ 0 };
+		/**
+		 * \brief Timestamps of the last NetCommands::TimeSyncResponse, echoed so the server can take a sample of its own.
+		 */
+		long long lastResponseSend{ 0 };
+		long long lastResponseReceive{ 0 };
+		/**
+		 * \brief Sent encrypted with NetCommands::HandshakeIdentify.
+		 */
+		Packet identity{};
+
+		/**
+		 * \brief The last NetCommands::SessionTicket of the server, used once by the next Connect(..) to the same address.
+		 */
+		struct Ticket
+		{
+			std::vector<unsigned char> ticket{};
+			unsigned char secret[KeyExchange::keySize]{};
+			AeadCipher cipher{ AeadCipher::None };
+			unsigned int connectionId{ CONNECTION_ID_INVALID };
+			long long expiresAt{ 0 };
+			ENetAddress address{};
+		};
+		Ticket resumption{};
+		/**
+		 * \brief Sent a ResumeSession and waits for the answer, the server may still fall back to a key share.
+		 */
+		bool resuming{ false };
+		PendingRequests pendingRequests;
+
+		/**
+		 * \brief Samples are added by the network thread, the estimates are read by the game thread.
+		 */
+		ClockSync clockSync;
+	};
+}
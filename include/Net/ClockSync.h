@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace net
+{
+	/**
+	 * \brief Estimates the offset between the local clock and the clock of the server, NTP style.
+	 * A sample is one NetCommands::TimeSync exchange. Samples that took the longest are the most likely to have waited in a queue somewhere,
+	 * so the offset is taken from the sample with the lowest round trip time of the last sampleWindow samples.
+	 * All times are steady clock microseconds.
+	 * \warning Samples should be added from a single thread, the estimates can be read from any thread.
+	 */
+	class ClockSync
+	{
+	public:
+		static constexpr std::size_t sampleWindow = 8;
+		/**
+		 * \brief The amount of samples before the estimate is considered synchronized.
+		 */
+		static constexpr std::size_t minimumSamples = 4;
+
+		/**
+		 * \brief The local steady clock in microseconds.
+		 */
+		static long long LocalTimeNow() noexcept;
+
+		/**
+		 * \param clientSend Local time the request was sent.
+		 * \param serverReceive Server time the request was received.
+		 * \param serverSend Server time the response was sent.
+		 * \param clientReceive Local time the response was received.
+		 */
+		void AddSample(long long clientSend, long long serverReceive, long long serverSend, long long clientReceive);
+		void Reset();
+
+		/**
+		 * \brief Microseconds to add to the local clock to get the server clock.
+		 */
+		long long GetOffset() const noexcept { return offset.load(std::memory_order_acquire); }
+		/**
+		 * \brief Round trip time in microseconds, without the time the server took to respond.
+		 */
+		long long GetRoundTripTime() const noexcept { return roundTripTime.load(std::memory_order_acquire); }
+		bool IsSynchronized() const noexcept { return synchronized.load(std::memory_order_acquire); }
+		std::size_t GetSampleCount() const noexcept { return sampleCount; }
+
+		/**
+		 * \brief The current time of the server clock in microseconds.
+		 */
+		long long RemoteTimeNow() const noexcept { return LocalTimeNow() + GetOffset(); }
+
+	private:
+		struct Sample
+		{
+			long long offset{ 0 };
+			long long roundTripTime{ 0 };
+		};
+
+		std::array<Sample, sampleWindow> samples{};
+		std::size_t sampleCount{ 0 };
+		std::size_t nextSample{ 0 };
+
+		std::atomic<long long> offset{ 0 };
+		std::atomic<long long> roundTripTime{ 0 };
+		std::atomic<bool> synchronized{ false };
+	};
+}
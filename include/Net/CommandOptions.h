@@ -0,0 +1,60 @@
+#pragma once
+
+namespace net
+{
+	/**
+	 * \brief The priority lanes the Server handles received packets in.
+	 * \see PacketScheduler
+	 */
+	enum class PacketLane : unsigned int
+	{
+		/**
+		 * \brief Connection control like the handshake and identification. Always handled first.
+		 */
+		Control = 0,
+		/**
+		 * \brief Commands that influence the game state. The default lane of custom commands.
+		 */
+		Turn,
+		/**
+		 * \brief Bulk and cosmetic traffic that may wait when the server is busy.
+		 */
+		Bulk,
+
+		Count
+	};
+
+	/**
+	 * \brief How a custom command is protected once the connection has keys.
+	 * Both sides should register the same level: the receiving side drops messages that are protected less than registered.
+	 */
+	enum class SecurityLevel : unsigned char
+	{
+		/**
+		 * \brief Sent as it is, for public high-rate traffic like lobby listings and spectator streams.
+		 * Anyone on the path can read, change or inject it. Can be broadcast to many connections as one shared buffer.
+		 */
+		Plain = 0,
+		/**
+		 * \brief Readable, but a tag proves it is sent by the peer, unchanged and in order.
+		 * Needs a negotiated AEAD cipher, connections that use NetAES encrypt it instead.
+		 */
+		Authenticated,
+		/**
+		 * \brief Encrypted and authenticated.
+		 */
+		Encrypted
+	};
+
+	/**
+	 * \brief Options of a custom command, registered using Server::RegisterCommand and Client::RegisterCommand.
+	 */
+	struct CommandOptions
+	{
+		/**
+		 * \brief Only used by the Server.
+		 */
+		PacketLane lane{ PacketLane::Turn };
+		SecurityLevel security{ SecurityLevel::Encrypted };
+	};
+}
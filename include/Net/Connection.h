@@ -3,7 +3,21 @@
 #include "Net/NetUtils.h"
 #include "enet/enet.h"
 
+#include <atomic>
+
 #define CONNECTION_ID_INVALID 0
+/**
+ * \brief Set in the connect data by clients that want the key share handshake, the other bits are the connection id.
+ * The server sends its share once ENet reports the connect, after the client acknowledged it, and the IdentifySuccessful
+ * arrives about 3 round trips after the client started connecting, 2 after its ENet connect. One round trip less than the RSA handshake.
+ * \see NetCommands::HandshakeKeyShare
+ */
+#define CONNECT_FLAG_KEY_EXCHANGE 0x80000000u
+/**
+ * \brief Set together with CONNECT_FLAG_KEY_EXCHANGE by clients that resume with a ticket, the connection id is the one of the ticket.
+ * \see NetCommands::ResumeSession
+ */
+#define CONNECT_FLAG_RESUME 0x40000000u
 
 
 namespace net
@@ -22,10 +36,21 @@ namespace net
 		unsigned int GetConnectionId() const noexcept { return connectionId; }
 
 		static unsigned int NewConnectionId();
-		static unsigned int IDCount() noexcept { return idCount; };
+		static unsigned int IDCount() noexcept { return idCount.load(); };
 
 		bool Valid() const;
 
+		/**
+		 * \brief Microseconds to add to a client timestamp to get the server time, as estimated by the server from NetCommands::TimeSync.
+		 */
+		long long GetClockOffset() const noexcept { return clockOffset; }
+		long long ToServerTime(long long clientTime) const noexcept { return clientTime + clockOffset; }
+		/**
+		 * \brief Round trip time in microseconds. Uses the ENet estimate until the clock of the client is synchronized.
+		 */
+		long long GetRoundTripTime() const;
+		bool IsClockSynchronized() const noexcept { return clockSynchronized; }
+
 		bool operator==(const Connection& rhs) const
 		{
 			return GetConnectionId() == rhs.GetConnectionId();
@@ -36,7 +61,14 @@ namespace net
 		unsigned int connectionId{ CONNECTION_ID_INVALID };
 		bool identified{ false };
 
-		static unsigned int idCount;
+		long long clockOffset{ 0 };
+		long long roundTripTime{ 0 };
+		bool clockSynchronized{ false };
+
+		/**
+		 * \brief Shared by every Server in the process, so ids stay unique across the shards of a ServerGroup.
+		 */
+		static std::atomic<unsigned int> idCount;
 	};
 }
 
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Net/Packet.h"
+#include "Crypto/NetAES.h"
+#include "Crypto/NetAEAD.h"
+
+#include <cstddef>
+#include <vector>
+#include "enet/enet.h"
+
+class ThreadPool;
+
+namespace net
+{
+	/**
+	 * \brief Collects the messages of a tick and encrypts all of them in one batch.
+	 * Messages are grouped by key: one thread seals all the messages of a key in the order they were added,
+	 * because the nonces of NetAEAD are counters, while different keys are sealed in parallel on a ThreadPool.
+	 */
+	class CryptoBatch
+	{
+	public:
+		struct Job
+		{
+			ENetPeer* peer{ nullptr };
+			unsigned int connectionId{ 0 };
+			unsigned int messageId{ 0 };
+			/**
+			 * \brief The key to seal with, at most one of them is set. Without a key the data is sent as it is.
+			 */
+			NetAEAD* channelKey{ nullptr };
+			NetAES* dataKey{ nullptr };
+			/**
+			 * \brief The command and payload of the message.
+			 */
+			Packet data{};
+			Packet frame{};
+			bool failed{ false };
+			/**
+			 * \brief Only adds a tag with the channelKey, for SecurityLevel::Authenticated.
+			 */
+			bool authenticateOnly{ false };
+
+			/**
+			 * \brief The packet that should be sent after Seal(..).
+			 */
+			Packet& Output() noexcept { return channelKey != nullptr || dataKey != nullptr ? frame : data; }
+		};
+
+		void Add(Job&& job);
+		/**
+		 * \brief Seals every job that has a key. Without a pool, or with a single key, it all happens on the calling thread.
+		 * \warning The keys may not be used by other threads until Seal(..) returns.
+		 */
+		void Seal(ThreadPool* pool);
+
+		std::vector<Job>& GetJobs() noexcept { return jobs; }
+		bool Empty() const noexcept { return jobs.empty(); }
+		void Clear();
+
+	private:
+		static void SealJob(Job& job);
+
+		std::vector<Job> jobs{};
+		/**
+		 * \brief The indices of the jobs per key, in order. Kept between batches so the vectors keep their capacity.
+		 */
+		std::vector<std::vector<std::size_t>> groups{};
+		std::size_t groupCount{ 0 };
+	};
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Net/Packet.h"
+#include "Crypto/NetAES.h"
+#include "Crypto/NetAEAD.h"
+
+#include <cstddef>
+
+namespace net
+{
+	/**
+	 * \brief Builds and opens NetCommands::CryptoPacket and NetCommands::AeadPacket frames, encrypting and decrypting inside the packet buffer.
+	 * A CryptoPacket is [CryptoPacket][paddingSize][iv][encryptedSize][encrypted data].
+	 * An AeadPacket is [AeadPacket][encrypted data][tag], the command is authenticated as additional data and the length is the length of the frame.
+	 * An AuthenticatedPacket is [AuthenticatedPacket][data][tag], everything before the tag is authenticated as additional data.
+	 */
+	class CryptoFrame
+	{
+	public:
+		/**
+		 * \brief Replaces the contents of frame with the encrypted data.
+		 * \return bool False when encrypting failed, the frame must not be sent.
+		 */
+		static bool Seal(NetAES& key, const void* data, std::size_t dataSize, Packet& frame);
+		/**
+		 * \brief Replaces the contents of a CryptoPacket with the decrypted command and payload.
+		 * \return bool False when the frame is malformed, the packet is left in an unspecified state.
+		 */
+		static bool Open(NetAES& key, Packet& frame);
+
+		static bool Seal(NetAEAD& key, const void* data, std::size_t dataSize, Packet& frame);
+		/**
+		 * \return bool False when the frame is malformed, tampered with or replayed, the packet is left in an unspecified state.
+		 */
+		static bool Open(NetAEAD& key, Packet& frame);
+
+		/**
+		 * \brief Replaces the contents of frame with the data and a tag, without encrypting.
+		 */
+		static bool Authenticate(NetAEAD& key, const void* data, std::size_t dataSize, Packet& frame);
+		/**
+		 * \brief Replaces the contents of an AuthenticatedPacket with the command and payload.
+		 * \return bool False when the frame is malformed, tampered with or replayed, the packet is left in an unspecified state.
+		 */
+		static bool Verify(NetAEAD& key, Packet& frame);
+	};
+}
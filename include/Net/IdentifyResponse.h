@@ -8,6 +8,10 @@ namespace net
 		Invalid,
 		AccountInUse,
 		Error,
-		Unknown
+		Unknown,
+		/**
+		 * \brief Identifying continues asynchronously, the server answers with Server::CompleteIdentification(..) once it is done.
+		 */
+		Pending
 	};
 }
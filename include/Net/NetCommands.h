@@ -40,7 +40,83 @@ enum class NetCommands
     /**
 	 * \brief Custom command that will be passed to the custom implementation.
 	 */
-	CustomCommand
+	CustomCommand,
+
+	/**
+	 * \brief Sent by client once identified, encrypted like any other command. Sample of the clock synchronization.
+	 * The echoed response lets the server take a sample of its own, so it doesn't have to trust the estimates of the client.
+	 * \param long long Client time the request was sent.
+	 * \param long long Server time the last NetCommands::TimeSyncResponse was sent, 0 before the first.
+	 * \param long long Client time the last NetCommands::TimeSyncResponse was received, 0 before the first.
+	 * \see ClockSync
+	 */
+	TimeSync,
+	/**
+	 * \brief Sent by server after NetCommands::TimeSync, encrypted.
+	 * \param long long Client time the request was sent.
+	 * \param long long Server time the request was received.
+	 * \param long long Server time the response was sent.
+	 */
+	TimeSyncResponse,
+
+	/**
+	 * \brief Custom command that expects a NetCommands::CustomResponse. Can be sent by both sides.
+	 * \param unsigned int The correlation id of the request.
+	 * \param unsigned int The custom command.
+	 */
+	CustomRequest,
+	/**
+	 * \brief Answer to a NetCommands::CustomRequest.
+	 * \param unsigned int The correlation id of the request.
+	 * \param net::RequestStatus The status of the response.
+	 */
+	CustomResponse,
+
+	/**
+	 * \brief Packet encrypted with the negotiated NetAEAD. The frame is the command, the encrypted packet and the tag.
+	 */
+	AeadPacket,
+
+	/**
+	 * \brief Sent by server right after connecting, instead of HandshakeServerKey, when the client asked for the key share handshake. Unencrypted.
+	 * \param unsigned char[32] The ephemeral X25519 public key of the server.
+	 * \param unsigned int The AEAD ciphers the server supports, as a mask of 1 << AeadCipher.
+	 * \see CONNECT_FLAG_KEY_EXCHANGE
+	 */
+	HandshakeKeyShare,
+	/**
+	 * \brief Answer of the client to NetCommands::HandshakeKeyShare, replaces HandshakeDataKey, HandshakeSuccess and Identify.
+	 * The server answers with IdentifySuccessful or IdentifyFailure, encrypted with the derived key.
+	 * \param unsigned char[32] The ephemeral X25519 public key of the client.
+	 * \param unsigned char The AeadCipher the client picked.
+	 * The rest is the identity encrypted as the first message of the channel, followed by the tag. The command, key and cipher are authenticated.
+	 */
+	HandshakeIdentify,
+
+	/**
+	 * \brief Sent by server after the client identified, when session tickets are enabled. Encrypted.
+	 * \param unsigned int The connection id to reconnect with.
+	 * \param unsigned int The lifetime of the ticket in seconds.
+	 * \param unsigned char[32] The resumption secret.
+	 * The rest is the ticket, which only the server can read.
+	 * \see SessionTicketKeys
+	 */
+	SessionTicket,
+	/**
+	 * \brief Sent by client right after connecting with CONNECT_FLAG_RESUME, instead of waiting for a key share.
+	 * The server answers with IdentifySuccessful or IdentifyFailure encrypted with the resumed key, or with HandshakeKeyShare when it doesn't accept the ticket.
+	 * \param unsigned int The size of the ticket.
+	 * \param unsigned char[] The ticket of NetCommands::SessionTicket.
+	 * \param unsigned char[32] A random salt for the new channel key, which is derived from the resumption secret.
+	 * Followed by the tag of an empty message sealed with the new key, which proves the client knows the secret.
+	 */
+	ResumeSession,
+
+	/**
+	 * \brief Packet that is authenticated with the negotiated NetAEAD but not encrypted, for SecurityLevel::Authenticated commands.
+	 * The frame is the command, the packet and the tag. It uses the same message counter as NetCommands::AeadPacket.
+	 */
+	AuthenticatedPacket
 };
 
 inline std::string GetName(NetCommands command)
@@ -58,6 +134,16 @@ inline std::string GetName(NetCommands command)
 		case NetCommands::HandshakeFailed: return "HandshakeFailed";
 		case NetCommands::CryptoPacket: return "CryptoPacket";
 		case NetCommands::CustomCommand: return "CustomCommand";
+		case NetCommands::TimeSync: return "TimeSync";
+		case NetCommands::TimeSyncResponse: return "TimeSyncResponse";
+		case NetCommands::CustomRequest: return "CustomRequest";
+		case NetCommands::CustomResponse: return "CustomResponse";
+		case NetCommands::AeadPacket: return "AeadPacket";
+		case NetCommands::HandshakeKeyShare: return "HandshakeKeyShare";
+		case NetCommands::HandshakeIdentify: return "HandshakeIdentify";
+		case NetCommands::SessionTicket: return "SessionTicket";
+		case NetCommands::ResumeSession: return "ResumeSession";
+		case NetCommands::AuthenticatedPacket: return "AuthenticatedPacket";
 	}
 	return "Unknown";
 }
@@ -14,6 +14,7 @@ namespace net
 {
 	class Server;
 	class Client;
+	class CryptoFrame;
 }
 
 class Packet
@@ -50,6 +51,7 @@ public:
 
 	friend class net::Server;
 	friend class net::Client;
+	friend class net::CryptoFrame;
 
 	////////////////////////////////////////////////////////////
 	/// \brief Append data to the end of the packet
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Net/CommandOptions.h"
+#include "Net/Packet.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+
+namespace net
+{
+	/**
+	 * \brief Limits how much work a single Server::HandlePackets(..) call may do. A limit of 0 means unlimited.
+	 */
+	struct HandleBudget
+	{
+		unsigned int maxPackets{ 0 };
+		std::chrono::microseconds maxTime{ 0 };
+	};
+
+	/**
+	 * \brief Queue of received packets, split over priority lanes.
+	 * The control lane is always served first. The other lanes are served by weight, so bulk traffic can't starve turns and the other way around.
+	 * Within a lane the connections are served round-robin, so a burst of one client doesn't delay the others.
+	 */
+	class PacketScheduler
+	{
+	public:
+		struct Entry
+		{
+			unsigned int connectionId{};
+			Packet packet{};
+			unsigned int traceId{};
+		};
+
+		PacketScheduler();
+
+		void Push(PacketLane lane, Entry&& entry);
+		/**
+		 * \brief The next packet that should be handled.
+		 * \warning The scheduler should not be empty.
+		 */
+		Entry& Front();
+		/**
+		 * \brief Removes the packet returned by Front().
+		 */
+		void Pop();
+		/**
+		 * \brief Drops all the queued packets of a connection.
+		 */
+		void Remove(unsigned int connectionId);
+
+		/**
+		 * \brief Sets how many packets of a lane are handled each round, relative to the other lanes.
+		 * \warning The control lane always has priority and ignores its weight.
+		 */
+		void SetLaneWeight(PacketLane lane, unsigned int weight);
+
+		std::size_t Size() const noexcept { return size; }
+		bool Empty() const noexcept { return size == 0; }
+
+	private:
+		struct Lane
+		{
+			std::unordered_map<unsigned int, std::deque<Entry>> queues{};
+			/**
+			 * \brief The connections with queued packets, in the order they will be served.
+			 */
+			std::deque<unsigned int> active{};
+			std::size_t size{ 0 };
+			unsigned int weight{ 1 };
+			unsigned int credit{ 0 };
+		};
+
+		Lane& SelectLane();
+
+		std::array<Lane, static_cast<std::size_t>(PacketLane::Count)> lanes{};
+		std::size_t size{ 0 };
+		Lane* selected{ nullptr };
+	};
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace net
+{
+	/**
+	 * \brief The stages a message passes through inside a Server or Client.
+	 * \see PacketTracer
+	 */
+	enum class TraceStage : unsigned char
+	{
+		Receive,
+		Enqueue,
+		Decrypt,
+		Dispatch,
+		Handler,
+		Send,
+		Encrypt,
+		Flush
+	};
+
+	const char* GetName(TraceStage stage);
+
+	/**
+	 * \brief A single timed stage of a message. Times are in microseconds since the tracer started.
+	 */
+	struct TraceSpan
+	{
+		TraceStage stage{};
+		unsigned int connectionId{};
+		unsigned int messageId{};
+		long long begin{};
+		long long end{};
+	};
+
+	/**
+	 * \brief Optional lifecycle tracing of network messages.
+	 * Every thread records its spans into its own ring buffer, so recording never contends with other threads.
+	 * When the ring is full the oldest spans are overwritten.
+	 * The collected spans can be written out as Chrome trace_event JSON, which chrome://tracing and the Perfetto UI both open.
+	 */
+	class PacketTracer
+	{
+	public:
+		static void SetEnabled(bool enable) noexcept { enabled.store(enable, std::memory_order_relaxed); }
+		static bool IsEnabled() noexcept { return enabled.load(std::memory_order_relaxed); }
+
+		/**
+		 * \brief Get a new id to follow a message through all of its stages.
+		 * \return unsigned int The id, or 0 when tracing is disabled.
+		 */
+		static unsigned int NextMessageId() noexcept;
+		static long long Now() noexcept;
+
+		static void Record(TraceStage stage, unsigned int connectionId, unsigned int messageId, long long begin, long long end);
+
+		/**
+		 * \brief Writes the spans of all threads to a Chrome trace_event JSON file.
+		 * \return bool Whether writing succeeded.
+		 */
+		static bool DumpChromeTrace(const std::string& path);
+		/**
+		 * \brief Removes all the recorded spans of all threads.
+		 */
+		static void Clear();
+
+		static constexpr std::size_t ringSize = 8192; // spans per thread
+
+	private:
+		static std::atomic<bool> enabled;
+	};
+
+	/**
+	 * \brief Records the lifetime of the scope as a span of the given stage. Does nothing when tracing is disabled.
+	 */
+	class TraceScope
+	{
+	public:
+		TraceScope(TraceStage stage, unsigned int connectionId, unsigned int messageId) noexcept;
+		~TraceScope();
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		TraceStage stage;
+		unsigned int connectionId;
+		unsigned int messageId;
+		long long begin{ -1 };
+	};
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Net/Packet.h"
+
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+namespace net
+{
+	/**
+	 * \brief How a request ended. Timeout, Cancelled and Disconnected are only set locally, never sent.
+	 */
+	enum class RequestStatus : unsigned int
+	{
+		Success = 0,
+		/**
+		 * \brief The handler of the other side answered with a failure.
+		 */
+		Failed,
+		/**
+		 * \brief The other side has no handler for the command.
+		 */
+		Unhandled,
+		Timeout,
+		Cancelled,
+		Disconnected
+	};
+
+	struct RequestResult
+	{
+		RequestStatus status{ RequestStatus::Success };
+		/**
+		 * \brief The payload of the response.
+		 */
+		Packet packet{};
+	};
+
+	struct RequestFuture
+	{
+		/**
+		 * \brief Correlation id of the request, used to cancel it.
+		 */
+		unsigned int requestId{ 0 };
+		std::future<RequestResult> result{};
+	};
+
+	constexpr std::chrono::milliseconds defaultRequestTimeout{ 5000 };
+
+	/**
+	 * \brief The requests that still wait for a response, keyed by their correlation id.
+	 * Open addressing with linear probing in a single array, so looking up a response doesn't allocate or chase pointers.
+	 * \warning Not thread safe, should be owned by the thread that receives the responses.
+	 */
+	class PendingRequests
+	{
+	public:
+		struct Entry
+		{
+			/**
+			 * \brief 0 marks an empty slot.
+			 */
+			unsigned int requestId{ 0 };
+			unsigned int connectionId{ 0 };
+			/**
+			 * \brief Steady clock microseconds.
+			 * \see ClockSync::LocalTimeNow
+			 */
+			long long deadline{ 0 };
+			std::promise<RequestResult> promise{};
+		};
+
+		explicit PendingRequests(std::size_t capacity = 64);
+
+		void Insert(Entry&& entry);
+		/**
+		 * \brief Fulfils the request and removes it.
+		 * \return bool False when no request with the id was sent to the connection, like when it already timed out.
+		 */
+		bool Resolve(unsigned int requestId, unsigned int connectionId, RequestResult&& result);
+		bool Cancel(unsigned int requestId);
+		/**
+		 * \brief Ends every request that passed its deadline with RequestStatus::Timeout.
+		 */
+		void Expire(long long now);
+		/**
+		 * \brief Ends every request of a connection.
+		 */
+		void Fail(unsigned int connectionId, RequestStatus status);
+		void FailAll(RequestStatus status);
+
+		std::size_t Size() const noexcept { return count; }
+		bool Empty() const noexcept { return count == 0; }
+
+	private:
+		static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+		std::size_t Home(unsigned int requestId) const noexcept;
+		std::size_t Find(unsigned int requestId) const noexcept;
+		/**
+		 * \brief Empties the slot and shifts the entries after it back, so no tombstones are needed.
+		 */
+		void Erase(std::size_t index);
+		void Grow();
+
+		std::vector<Entry> slots;
+		std::size_t count{ 0 };
+		/**
+		 * \brief Lower bound of the deadlines in the table, so Expire(..) only scans when something can have expired.
+		 */
+		long long nextDeadline{ 0 };
+	};
+}
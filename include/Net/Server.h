@@ -3,18 +3,30 @@
 #include "Net/NetUtils.h"
 #include "Net/Connection.h"
 #include "Net/Packet.h"
+#include "Net/PacketScheduler.h"
+#include "Net/PendingRequests.h"
+#include "Net/PacketTracer.h"
+#include "Net/CommandOptions.h"
+#include "Net/ClockSync.h"
+#include "Net/CryptoBatch.h"
 #include "NetCommands.h"
 
 #include "Utility/Observable.h"
+#include "Utility/ThreadPool.h"
 #include "Crypto/KeyChain.h"
+#include "Crypto/HandshakeKeyPool.h"
+#include "Crypto/SessionTicketKeys.h"
 #include "Logger.h"
 
 #include <enet/enet.h>
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <unordered_map>
+#include <unordered_set>
 #include "IdentifyResponse.h"
 
 namespace cof
@@ -27,37 +39,195 @@ namespace cof
 
 namespace net
 {
+	class ServerGroup;
+
 	class Server
 	{
+		friend ServerGroup;
+
 	public:
 		Server();
 		explicit Server(cof::basic_logger::Logger* logger);
 		virtual ~Server();
 
 		void StartServer(unsigned short port, unsigned short maxSessions);
-		void ReceivePackets();
+		/**
+		 * \brief Whether StartServer(..) created the ENet host, it fails when the port can't be bound.
+		 */
+		bool IsStarted() const noexcept { return server != nullptr; }
+		/**
+		 * \brief Services the ENet host and queues the received packets.
+		 * \param timeout Milliseconds to wait for the first event when none are pending.
+		 */
+		void ReceivePackets(enet_uint32 timeout = 0);
+		/**
+		 * \brief Handles all the queued packets.
+		 */
 		void HandlePackets();
+		/**
+		 * \brief Handles the queued packets until the budget runs out. The remaining packets stay queued for the next call.
+		 * Connection control packets are handled first, the other lanes are served by weight and round-robin over the connections.
+		 */
+		void HandlePackets(const HandleBudget& budget);
+		std::size_t GetQueuedPacketCount() const noexcept { return packetQueue.Size(); }
+		void SetLaneWeight(PacketLane lane, unsigned int weight) { packetQueue.SetLaneWeight(lane, weight); }
 		void HandleAnyPacket(Connection* connection, Packet& packet);
 
+		/**
+		 * \brief Queues the sent packets until Flush(), which encrypts the whole batch at once on a pool of workers.
+		 * Broadcasts to many connections then no longer encrypt one connection after the other on the server thread.
+		 * \param workerCount Threads that encrypt besides the server thread. 0 encrypts the batch on the server thread.
+		 */
+		void SetSendBatching(bool enable, unsigned int workerCount = ThreadPool::DefaultWorkerCount());
+		bool IsSendBatching() const noexcept { return this->batchSends; }
+		/**
+		 * \brief Encrypts and sends the queued packets. Called at the end of HandlePackets(..) and before ReceivePackets(..) services the host,
+		 * call it at the end of a tick that also sends outside of the packet handlers.
+		 */
+		void Flush();
+
+		/**
+		 * \brief Moves the RSA work of the handshake off the server thread: key pairs are generated ahead of time and the data keys are decrypted on workers.
+		 * \param workerCount 0 generates and decrypts on the server thread when a client connects, which is the default.
+		 * Clients get one data key decryption each, and at most maxDecryptingDataKeys wait for the workers at once.
+		 * \param readyKeys The amount of key pairs to keep ready for new clients. Clients that connect while none are ready wait for one.
+		 * \warning Must be called before StartServer(..).
+		 */
+		void SetHandshakeWorkers(unsigned int workerCount, std::size_t readyKeys = 16);
+
+		/**
+		 * \brief Sends a resumption ticket to every client that identifies. A client that reconnects before the ticket expires
+		 * restores its keys and identity one round trip after its ENet connect, without asymmetric crypto or IdentifyClient(..).
+		 * The application stores what it needs in GetResumptionData(..) and restores it in ResumeClient(..).
+		 * \warning Must be called before StartServer(..). The shards of a ServerGroup share the ticket keys of the first shard.
+		 */
+		void EnableSessionTickets(std::chrono::seconds lifetime = std::chrono::minutes(10));
+
 		// TODO: https://jira1.nhtv.nl:8443/browse/YDY2019DY2DPTEAM03-156
 		void SetDebug(bool enableDebug) { this->debug = enableDebug; }
 		bool IsDebug() const { return this->debug; }
 
+		/**
+		 * \brief Binds the server socket with SO_REUSEPORT so multiple servers can share one port. Linux only.
+		 * \warning Must be called before StartServer(..).
+		 */
+		void SetReusePort(bool enableReusePort) { this->reusePort = enableReusePort; }
+
+		/**
+		 * \brief The group this server is a shard of, or nullptr when it runs on its own.
+		 */
+		ServerGroup* GetShardGroup() const noexcept { return this->group; }
+		unsigned int GetShardIndex() const noexcept { return this->shardIndex; }
+
 		const std::vector<Connection>& GetConnections() const noexcept;
 		Connection* GetConnection(unsigned int connectionId);
 		Connection* GetConnection(ENetPeer* client);
 
 		void SendCustomPacket(unsigned int command, Connection* connection);
 		void SendCustomPacket(unsigned int command, Packet& packet, Connection* connection);
+		/**
+		 * \brief Sends a custom command to all identified connections.
+		 * Commands registered as SecurityLevel::Plain are sent as one shared buffer instead of one copy per connection.
+		 */
+		void BroadcastCustomPacket(unsigned int command, Packet& packet);
+		void BroadcastCustomPacket(unsigned int command, Packet& packet, const std::vector<Connection*>& recipients);
+
+		/**
+		 * \brief Answers an Identify or ResumeSession and sends a new ticket when the client is identified.
+		 * Called by the server itself, unless IdentifyClient(..) or ResumeClient(..) returned IdentifyResponse::Pending.
+		 */
+		void CompleteIdentification(Connection* connection, IdentifyResponse response);
+		/**
+		 * \brief Completes a pending identification. Ignored when the client disconnected in the meantime.
+		 */
+		void CompleteIdentification(unsigned int connectionId, IdentifyResponse response);
+
+		/**
+		 * \brief Sends a custom command the client answers with ClientSession::SendResponse(..).
+		 * \return RequestFuture Resolved in HandlePackets(..) when the response arrives, the request times out or the client disconnects.
+		 */
+		RequestFuture SendRequest(unsigned int command, Packet& packet, Connection* connection, std::chrono::milliseconds timeout = defaultRequestTimeout);
+		/**
+		 * \brief Answers a request received in HandleCustomRequest(..). May be called later, as long as the connection is open.
+		 */
+		void SendResponse(unsigned int requestId, Packet& packet, Connection* connection, RequestStatus status = RequestStatus::Success);
+		/**
+		 * \brief Resolves the request with RequestStatus::Cancelled. A response that still arrives is ignored.
+		 */
+		bool CancelRequest(unsigned int requestId);
 
 		unsigned int GetPort() const;
 
+		/**
+		 * \brief The server clock in microseconds, the clock every client synchronizes to.
+		 * \see Connection::ToServerTime
+		 */
+		static long long ServerTimeNow() noexcept { return ClockSync::LocalTimeNow(); }
+
+		/**
+		 * \brief Sets the options of a custom command. Commands that aren't registered use the default CommandOptions.
+		 */
+		void RegisterCommand(unsigned int customCommand, CommandOptions options);
+		CommandOptions GetCommandOptions(unsigned int customCommand) const;
+
 	private:
 		void SendPacket(NetCommands command, ENetPeer* client) const;
-		void SendPacket(NetCommands command, Packet& packet, ENetPeer* client) const;
+		void SendPacket(NetCommands command, Packet& packet, ENetPeer* client, SecurityLevel security = SecurityLevel::Encrypted) const;
+		static void SendFrame(ENetPeer* client, Packet& frame);
+		/**
+		 * \brief Starts the handshake of a new client by sending it the public key.
+		 */
+		void SendServerKey(Connection* connection, const NetRSA& rsa);
+		/**
+		 * \brief Starts the key share handshake of a new client by sending it an ephemeral key share.
+		 * ENet only reports the connect once the client acknowledged it, so the share leaves about 1.5 round trips after the client started connecting.
+		 */
+		void SendKeyShare(Connection* connection);
+		/**
+		 * \brief Derives the channel key from a NetCommands::HandshakeIdentify and replaces it with the decrypted NetCommands::Identify.
+		 * \return bool False when the packet should be dropped.
+		 */
+		bool AcceptKeyShare(Connection* connection, Packet& packet, unsigned int messageId);
+		/**
+		 * \brief Restores the channel key from a NetCommands::ResumeSession and replaces the packet with an empty ResumeSession,
+		 * which restores the identity when it is handled. Falls back to the key share handshake when the ticket isn't accepted.
+		 * \return bool False when the packet should be dropped.
+		 */
+		bool AcceptResumption(Connection* connection, Packet& packet, unsigned int messageId);
+		void SendSessionTicket(Connection* connection);
+		/**
+		 * \brief Sends keys to the clients that connected while no key pair was ready, and applies the data keys the workers decrypted.
+		 */
+		void ServeAwaitingHandshakes();
+		/**
+		 * \brief Reads the decrypted NetCommands::HandshakeDataKey, activates the data key and finishes the handshake.
+		 */
+		void ApplyDataKey(Connection* connection, const unsigned char* data, std::size_t size);
+		unsigned int GetConnectionId(ENetPeer* client) const;
+
+		/**
+		 * \brief Replaces a CryptoPacket or AeadPacket with the packet that was encrypted inside of it.
+		 * \return bool False when the packet should be dropped: decrypting failed, or the packet is protected less than its command requires.
+		 */
+		bool DecryptPacket(Connection* connection, Packet& packet, NetCommands command, unsigned int messageId);
+		/**
+		 * \brief Reads the command of a packet without moving its read position.
+		 */
+		static NetCommands PeekCommand(Packet& packet, unsigned int* customCommand = nullptr);
+		/**
+		 * \brief The SecurityLevel a decrypted packet needs, which is only lower than Encrypted for registered custom commands.
+		 */
+		SecurityLevel GetRequiredSecurity(Packet& packet) const;
+		PacketLane GetLane(Packet& packet) const;
+		/**
+		 * \brief Answers a NetCommands::TimeSync right away, so the time spent in the queue doesn't end up in the sample.
+		 * Only identified connections are answered. The clock of the connection is estimated from the server's own timestamps.
+		 */
+		void HandleTimeSync(Connection* connection, Packet& packet, long long receiveTime);
 
 		/**
 		 * \brief Function to verify the connection.
+		 * Return IdentifyResponse::Pending to verify it asynchronously, e.g. using DatabaseAPI::Async(..), and finish with CompleteIdentification(..).
 		 */
 		virtual net::IdentifyResponse IdentifyClient(Packet& packet, Connection* connection) = 0;
 		/**
@@ -69,6 +239,17 @@ namespace net
 		 * \brief A player identified.
 		 */
 		virtual void OnPlayerIdentified(Connection* connection) = 0;
+		/**
+		 * \brief Fills what the server needs to restore an identified client, like its profile id. Stored encrypted in the session ticket.
+		 */
+		virtual void GetResumptionData(Packet& packet, Connection* connection) {}
+		/**
+		 * \brief Restores an identified client from the data of its session ticket, instead of IdentifyClient(..).
+		 */
+		virtual net::IdentifyResponse ResumeClient(Packet& packet, Connection* connection)
+		{
+			return IdentifyResponse::Invalid;
+		}
 
 		/**
 		 * \brief Function to handle the non-custom commands.
@@ -78,9 +259,25 @@ namespace net
 		 * \brief Function to handle the custom commands. Should be implemented by server application.
 		 */
 		virtual void HandleCustomPacket(unsigned int customCommand, Packet& packet, Connection* connection) = 0;
+		/**
+		 * \brief Function to handle the custom requests, which should be answered using SendResponse(..).
+		 * \return bool Whether the request is handled. Unhandled requests are answered with RequestStatus::Unhandled.
+		 */
+		virtual bool HandleCustomRequest(unsigned int customCommand, Packet& packet, Connection* connection, unsigned int requestId)
+		{
+			return false;
+		}
+		void HandleCustomResponse(Packet& packet, Connection* connection);
 
 		virtual void OnPlayerDisconnected(Connection* connection) = 0;
 
+		/**
+		 * \brief Function to handle a packet another shard of the ServerGroup sent to this shard.
+		 * Called on the thread of this shard.
+		 * \see ServerGroup::SendToShard
+		 */
+		virtual void HandleShardPacket(unsigned int sourceShard, Packet& packet) {}
+
 		virtual std::string GetPlayerName(Connection* connection)
 		{
 			return std::string{};
@@ -96,10 +293,75 @@ namespace net
 		ENetHost* server;
 
 		bool debug{ false };
+		bool reusePort{ false };
+
+		ServerGroup* group{ nullptr };
+		unsigned int shardIndex{ 0 };
 
 		cof::basic_logger::Logger* logger{ nullptr };
-		std::map<std::string, net::KeyChain> clientKeys;
-		std::queue<std::pair<Connection*, Packet>> packetQueue{};
+		/**
+		 * \brief Mutable because the cached cipher contexts of the keys change with every message, also in the const SendPacket(..).
+		 */
+		mutable std::map<std::string, net::KeyChain> clientKeys;
+		std::unordered_map<unsigned int, CommandOptions> commandOptions{};
+
+		PacketScheduler packetQueue{};
+		/**
+		 * \brief The packets queued by SendPacket(..) while send batching is enabled. Mutable like clientKeys.
+		 */
+		mutable CryptoBatch sendBatch{};
+		std::unique_ptr<ThreadPool> cryptoPool{};
+		bool batchSends{ false };
+
+		struct HandshakeResult
+		{
+			unsigned int connectionId;
+			std::unique_ptr<unsigned char[]> data;
+			std::size_t size;
+		};
+		unsigned int handshakeWorkerCount{ 0 };
+		std::size_t readyHandshakeKeys{ 16 };
+		/**
+		 * \brief The connections whose NetCommands::HandshakeDataKey is decrypted by a worker, until ServeAwaitingHandshakes() applied it.
+		 * Data keys that arrive while maxDecryptingDataKeys are queued are refused and their clients disconnected, so a flood of handshakes can't grow the queue.
+		 */
+		std::unordered_set<unsigned int> decryptingDataKeys{};
+		static constexpr std::size_t maxDecryptingDataKeys = 64;
+		/**
+		 * \brief The connections that wait for a key pair, in order of connecting.
+		 */
+		std::vector<unsigned int> awaitingKeys{};
+		std::mutex handshakeMutex{};
+		std::vector<HandshakeResult> handshakeResults{};
+		std::unique_ptr<HandshakeKeyPool> handshakeKeys{};
+
+		std::shared_ptr<SessionTicketKeys> ticketKeys{};
+		/**
+		 * \brief The ticket data of the connections that resumed, until their ResumeSession is handled.
+		 */
+		std::unordered_map<unsigned int, Packet> resumptions{};
+		struct TimeSyncState
+		{
+			ClockSync clockSync;
+			/**
+			 * \brief Server time the last NetCommands::TimeSyncResponse was sent, which the next NetCommands::TimeSync has to echo.
+			 */
+			long long lastResponseSend{ 0 };
+		};
+		/**
+		 * \brief The clock estimates of the connections that sent a NetCommands::TimeSync.
+		 */
+		std::unordered_map<unsigned int, TimeSyncState> timeSyncs{};
+		/**
+		 * \brief Declared after the members its jobs use, so it is destroyed before them.
+		 */
+		std::unique_ptr<ThreadPool> handshakeWorkers{};
+		PendingRequests pendingRequests{};
+		unsigned int nextRequestId{ 0 };
+		/**
+		 * \brief Trace id of the packet that is currently being handled. 0 when tracing is disabled.
+		 */
+		unsigned int traceId{ 0 };
 
 		std::string netPrefix = "\u001b[35m[Net Core]\u001b[0m";
 	};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Net/Packet.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace net
+{
+	class Server;
+
+	/**
+	 * \brief Runs several Server shards on one port, each on its own thread.
+	 * On Linux every shard binds its own ENet host to the port using SO_REUSEPORT and the kernel spreads the clients over the shards.
+	 * Every shard owns its own connections and handlers, connection ids stay unique over all shards.
+	 * On other platforms only a single shard is started.
+	 */
+	class ServerGroup
+	{
+	public:
+		/**
+		 * \brief Creates the server of a shard. Called once for every shard from Start(..).
+		 */
+		using ServerFactory = std::function<std::unique_ptr<Server>(unsigned int shardIndex)>;
+
+		explicit ServerGroup(ServerFactory factory);
+		~ServerGroup();
+
+		ServerGroup(const ServerGroup&) = delete;
+		ServerGroup& operator=(const ServerGroup&) = delete;
+
+		/**
+		 * \brief Creates the shards and starts their threads.
+		 * \param maxSessions The max sessions of every single shard.
+		 * \param shardCount The amount of shards, 0 uses the amount of hardware threads.
+		 * \return bool Whether every shard started. When one fails no thread is started and the shards are destroyed again.
+		 */
+		bool Start(unsigned short port, unsigned short maxSessions, unsigned int shardCount = 0);
+		/**
+		 * \brief Stops all the shard threads and destroys the shards.
+		 */
+		void Stop();
+
+		bool IsRunning() const noexcept { return running; }
+		unsigned int GetShardCount() const noexcept { return static_cast<unsigned int>(shards.size()); }
+		/**
+		 * \warning The shard is serviced by its own thread. Only access it from that thread.
+		 */
+		Server* GetShard(unsigned int shardIndex) const;
+
+		/**
+		 * \brief Sends a packet to another shard. It will be passed to Server::HandleShardPacket on the thread of that shard.
+		 * Can be called from any thread.
+		 */
+		void SendToShard(unsigned int sourceShard, unsigned int targetShard, const Packet& packet);
+		/**
+		 * \brief Sends a packet to every shard except the source shard.
+		 */
+		void Broadcast(unsigned int sourceShard, const Packet& packet);
+
+		/**
+		 * \brief Milliseconds a shard thread waits for network events before handling its queues.
+		 */
+		static constexpr unsigned int serviceTimeout = 1;
+
+	private:
+		struct Shard
+		{
+			std::unique_ptr<Server> server;
+			std::thread thread;
+
+			std::mutex inboxMutex;
+			std::vector<std::pair<unsigned int, Packet>> inbox;
+		};
+
+		void RunShard(Shard& shard);
+
+		ServerFactory factory;
+		std::vector<std::unique_ptr<Shard>> shards{};
+		std::atomic<bool> running{ false };
+	};
+}
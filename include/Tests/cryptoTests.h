@@ -3,6 +3,13 @@
 #include "catch/catch.hpp"
 #include "Crypto/NetRSA.h"
 #include "Crypto/NetAES.h"
+#include "Crypto/NetAEAD.h"
+#include "Crypto/SecureRandom.h"
+#include "Crypto/KeyExchange.h"
+#include "Crypto/SessionTicketKeys.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <memory>
 
 
@@ -87,4 +94,124 @@ TEST_CASE("AES Generate, Encrypt Decrypt", "[crypto]")
 
 
 	REQUIRE(data.compare(output) == 0);
-}
\ No newline at end of file
+}
+
+TEST_CASE("AES Encrypt Decrypt in place with cached contexts", "[crypto]")
+{
+	auto aes = net::NetAES();
+	auto copy = aes;
+	std::string data = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.";
+
+	for (int message = 0; message < 2; message++)
+	{
+		std::unique_ptr<unsigned char[]> buffer{ new unsigned char[data.length() + net::NetAES::blockSize] };
+		memcpy(buffer.get(), data.data(), data.length());
+
+		unsigned char iv[net::NetAES::ivLength >> 3];
+		size_t paddingSize;
+		size_t encryptedDataSize = aes.EncryptInPlace(buffer.get(), data.length(), iv, paddingSize);
+
+		REQUIRE(encryptedDataSize == data.length() + paddingSize);
+		REQUIRE(encryptedDataSize % net::NetAES::blockSize == 0);
+
+		size_t decryptedDataSize = copy.DecryptInPlace(buffer.get(), encryptedDataSize, iv, paddingSize);
+
+		REQUIRE(decryptedDataSize == data.length());
+		REQUIRE(data.compare(0, data.length(), reinterpret_cast<const char*>(buffer.get()), decryptedDataSize) == 0);
+	}
+}
+
+TEST_CASE("AEAD Seal Open, reject tampered and replayed", "[crypto]")
+{
+	for (auto cipher : { net::AeadCipher::AesGcm, net::AeadCipher::ChaCha20Poly1305 })
+	{
+		auto key = net::NetAES::GenerateKey(net::NetAES::keyLength);
+		auto client = net::NetAEAD(cipher, key, false);
+		auto server = net::NetAEAD(cipher, key, true);
+
+		std::string data = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.";
+		const unsigned char header[4] = { 0, 0, 0, 1 };
+
+		std::string sealed = data;
+		unsigned char tag[net::NetAEAD::tagSize];
+		REQUIRE(client.Seal(reinterpret_cast<unsigned char*>(&sealed[0]), sealed.length(), header, sizeof(header), tag));
+
+		std::string replayed = sealed;
+		std::string tampered = sealed;
+		tampered[0] ^= 1;
+
+		REQUIRE_FALSE(server.Open(reinterpret_cast<unsigned char*>(&tampered[0]), tampered.length(), header, sizeof(header), tag));
+		REQUIRE(server.Open(reinterpret_cast<unsigned char*>(&sealed[0]), sealed.length(), header, sizeof(header), tag));
+		REQUIRE(data.compare(sealed) == 0);
+		REQUIRE_FALSE(server.Open(reinterpret_cast<unsigned char*>(&replayed[0]), replayed.length(), header, sizeof(header), tag));
+
+		// The server can't open its own messages, the directions use different nonces.
+		std::string reflected = data;
+		REQUIRE(server.Seal(reinterpret_cast<unsigned char*>(&reflected[0]), reflected.length(), header, sizeof(header), tag));
+		REQUIRE_FALSE(server.Open(reinterpret_cast<unsigned char*>(&reflected[0]), reflected.length(), header, sizeof(header), tag));
+	}
+}
+
+TEST_CASE("SecureRandom fills across buffer refills", "[crypto]")
+{
+	const size_t size = net::SecureRandom::bufferSize * 3 + 7;
+	std::unique_ptr<unsigned char[]> first{ new unsigned char[size]() };
+	std::unique_ptr<unsigned char[]> second{ new unsigned char[size]() };
+
+	net::SecureRandom::Fill(first.get(), size);
+	net::SecureRandom::Fill(second.get(), size);
+
+	REQUIRE(memcmp(first.get(), second.get(), size) != 0);
+
+	size_t counts[256] = {};
+	for (size_t i = 0; i < size; i++)
+	{
+		counts[first.get()[i]]++;
+	}
+	REQUIRE(*std::min_element(std::begin(counts), std::end(counts)) > 0);
+}
+
+TEST_CASE("X25519 key exchange derives the same channel key on both sides", "[crypto]")
+{
+	auto client = net::KeyExchange::Generate();
+	auto server = net::KeyExchange::Generate();
+	REQUIRE(client.IsValid());
+	REQUIRE(server.IsValid());
+
+	net::NetAESKey clientKey, serverKey;
+	REQUIRE(client.DeriveKey(server.GetPublicKey(), false, clientKey));
+	REQUIRE(server.DeriveKey(client.GetPublicKey(), true, serverKey));
+	REQUIRE(clientKey.bitSize == static_cast<size_t>(net::NetAES::keyLength));
+	REQUIRE(memcmp(clientKey.key.get(), serverKey.key.get(), net::NetAES::keyLength >> 3) == 0);
+
+	// A low order point gives an all zero secret and must be refused.
+	const unsigned char zeroKey[net::KeyExchange::keySize] = {};
+	REQUIRE_FALSE(client.DeriveKey(zeroKey, false, clientKey));
+
+	client.Clear();
+	REQUIRE_FALSE(client.DeriveKey(server.GetPublicKey(), false, clientKey));
+}
+
+TEST_CASE("Session tickets open once and reject tampering", "[crypto]")
+{
+	net::SessionTicketKeys keys{ std::chrono::seconds(60) };
+	std::string data = "profile 42";
+
+	auto ticket = keys.Seal(reinterpret_cast<const unsigned char*>(data.data()), data.length());
+	REQUIRE(ticket.size() == data.length() + net::SessionTicketKeys::overhead);
+
+	std::vector<unsigned char> opened;
+	long long expiresAt;
+	REQUIRE(keys.Open(ticket.data(), ticket.size(), opened, expiresAt));
+	REQUIRE(data.compare(0, data.length(), reinterpret_cast<const char*>(opened.data()), opened.size()) == 0);
+
+	REQUIRE(keys.Redeem(ticket.data(), ticket.size(), expiresAt));
+	REQUIRE_FALSE(keys.Redeem(ticket.data(), ticket.size(), expiresAt));
+
+	auto tampered = ticket;
+	tampered[tampered.size() / 2] ^= 1;
+	REQUIRE_FALSE(keys.Open(tampered.data(), tampered.size(), opened, expiresAt));
+
+	net::SessionTicketKeys otherServer{};
+	REQUIRE_FALSE(otherServer.Open(ticket.data(), ticket.size(), opened, expiresAt));
+}
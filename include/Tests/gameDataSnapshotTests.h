@@ -0,0 +1,228 @@
+#pragma once
+
+#include "catch/catch.hpp"
+#include "databaseAPI/GameDataSnapshot.h"
+#include "databaseAPI/GameDataDatabase.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace snapshotTests
+{
+	// The layout of the file, as GameDataSnapshot writes it.
+	constexpr std::size_t sectionCount = 9;
+	constexpr std::size_t cardTypesSection = 5;
+	constexpr std::size_t cardRaritiesSection = 6;
+	constexpr std::size_t scriptsSection = 7;
+	constexpr std::size_t stringsSection = 8;
+
+	constexpr std::size_t versionOffset = 8;
+	constexpr std::size_t checksumOffset = 24;
+	constexpr std::size_t sectionsOffset = 32;
+	constexpr std::size_t headerSize = sectionsOffset + sectionCount * 16;
+
+	struct StringRef
+	{
+		std::uint32_t offset;
+		std::uint32_t length;
+	};
+
+	struct NamedRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		StringRef name;
+	};
+
+	struct ScriptRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		std::uint32_t cardId;
+		std::uint32_t monsterCardId;
+		std::uint32_t revision;
+		StringRef name;
+		StringRef code;
+	};
+
+	const std::string path = "gameDataSnapshotTests.tbsgdata";
+	const std::string copyPath = "gameDataSnapshotTests.copy.tbsgdata";
+
+	template<typename T>
+	T Read(const std::vector<char>& file, std::size_t offset)
+	{
+		T value;
+		std::memcpy(&value, file.data() + offset, sizeof(T));
+		return value;
+	}
+
+	template<typename T>
+	void Write(std::vector<char>& file, std::size_t offset, const T& value)
+	{
+		std::memcpy(file.data() + offset, &value, sizeof(T));
+	}
+
+	std::uint64_t SectionOffset(const std::vector<char>& file, std::size_t section)
+	{
+		return Read<std::uint64_t>(file, sectionsOffset + section * 16);
+	}
+
+	/**
+	 * \brief FNV-1a of everything after the header, like the checksum in the header.
+	 */
+	void UpdateChecksum(std::vector<char>& file)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (std::size_t i = headerSize; i < file.size(); i++)
+		{
+			hash ^= static_cast<unsigned char>(file[i]);
+			hash *= 1099511628211ull;
+		}
+		Write(file, checksumOffset, hash);
+	}
+
+	/**
+	 * \brief A snapshot of project 7 with two card types, a card rarity and a script, made without a database.
+	 */
+	std::vector<char> MakeSnapshot()
+	{
+		const std::string strings = "SpellCreatureCommonprint(\"hi\")";
+		std::vector<char> sections[sectionCount];
+
+		auto add = [&sections](std::size_t section, const void* record, std::size_t size)
+		{
+			const char* bytes = static_cast<const char*>(record);
+			sections[section].insert(sections[section].end(), bytes, bytes + size);
+		};
+		const NamedRecord spell{ 1, 1, { 0, 5 } };
+		const NamedRecord creature{ 2, 2, { 5, 8 } };
+		const NamedRecord common{ 1, 1, { 13, 6 } };
+		const ScriptRecord script{ 3, 3, 10, 0, 4, { 19, 0 }, { 19, 11 } };
+		add(cardTypesSection, &spell, sizeof(spell));
+		add(cardTypesSection, &creature, sizeof(creature));
+		add(cardRaritiesSection, &common, sizeof(common));
+		add(scriptsSection, &script, sizeof(script));
+		add(stringsSection, strings.data(), strings.size());
+
+		std::vector<char> file(headerSize);
+		std::memcpy(file.data(), "TBSGDATA", 8);
+		Write<std::uint32_t>(file, versionOffset, tbsg::GameDataSnapshot::formatVersion);
+		Write<std::uint32_t>(file, versionOffset + 4, 7);
+
+		const std::size_t recordSizes[sectionCount] = { 40, 8, 40, 20, 4, sizeof(NamedRecord), sizeof(NamedRecord), sizeof(ScriptRecord), 1 };
+		for (std::size_t section = 0; section < sectionCount; section++)
+		{
+			file.resize((file.size() + 7) / 8 * 8);
+			Write<std::uint64_t>(file, sectionsOffset + section * 16, file.size());
+			Write<std::uint64_t>(file, sectionsOffset + section * 16 + 8, sections[section].size() / recordSizes[section]);
+			file.insert(file.end(), sections[section].begin(), sections[section].end());
+		}
+		Write<std::uint64_t>(file, 16, file.size());
+		UpdateChecksum(file);
+		return file;
+	}
+
+	void SaveFile(const std::string& filePath, const std::vector<char>& file)
+	{
+		std::ofstream output(filePath, std::ios::binary | std::ios::trunc);
+		output.write(file.data(), static_cast<std::streamsize>(file.size()));
+	}
+}
+
+TEST_CASE("GameDataSnapshot Write Open round trip", "[snapshot]")
+{
+	snapshotTests::SaveFile(snapshotTests::path, snapshotTests::MakeSnapshot());
+
+	auto snapshot = tbsg::GameDataSnapshot::Open(snapshotTests::path);
+	REQUIRE(snapshot != nullptr);
+	REQUIRE(snapshot->GetProjectId() == 7);
+
+	tbsg::GameDataDatabase database{};
+	snapshot->Load(database);
+	snapshot.reset();
+
+	// Written from the loaded data, so it has to load back into the same data.
+	REQUIRE(tbsg::GameDataSnapshot::Write(database, 7, snapshotTests::copyPath));
+	auto copy = tbsg::GameDataSnapshot::Open(snapshotTests::copyPath);
+	REQUIRE(copy != nullptr);
+	REQUIRE(copy->GetProjectId() == 7);
+	REQUIRE(copy->HasLatestScripts({ { 3, 4 } }));
+	REQUIRE_FALSE(copy->HasLatestScripts({ { 3, 5 } }));
+
+	tbsg::GameDataDatabase loaded{};
+	copy->Load(loaded);
+
+	REQUIRE(loaded.GetCardTypes().size() == 2);
+	REQUIRE(loaded.GetCardTypes().at(1).name == "Spell");
+	REQUIRE(loaded.GetCardTypes().at(2).name == "Creature");
+	REQUIRE(loaded.GetCardRarity().size() == 1);
+	REQUIRE(loaded.GetCardRarity().at(1).name == "Common");
+
+	const tbsg::Script* script = loaded.GetScript(3u);
+	REQUIRE(script != nullptr);
+	REQUIRE(script->cardId == 10);
+	REQUIRE(script->revision == 4);
+	REQUIRE(script->name.empty());
+	REQUIRE(script->code == "print(\"hi\")");
+
+	copy.reset();
+	std::remove(snapshotTests::path.c_str());
+	std::remove(snapshotTests::copyPath.c_str());
+}
+
+TEST_CASE("GameDataSnapshot rejects damaged files", "[snapshot]")
+{
+	const std::vector<char> valid = snapshotTests::MakeSnapshot();
+
+	SECTION("Wrong checksum")
+	{
+		std::vector<char> file = valid;
+		file.back() ^= 0x20;
+		snapshotTests::SaveFile(snapshotTests::path, file);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) == nullptr);
+	}
+
+	SECTION("Wrong version")
+	{
+		std::vector<char> file = valid;
+		snapshotTests::Write<std::uint32_t>(file, snapshotTests::versionOffset, tbsg::GameDataSnapshot::formatVersion + 1);
+		snapshotTests::SaveFile(snapshotTests::path, file);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) == nullptr);
+	}
+
+	SECTION("Truncated")
+	{
+		std::vector<char> file = valid;
+		file.resize(file.size() - 4);
+		snapshotTests::SaveFile(snapshotTests::path, file);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) == nullptr);
+
+		file.resize(snapshotTests::headerSize / 2);
+		snapshotTests::SaveFile(snapshotTests::path, file);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) == nullptr);
+	}
+
+	SECTION("String outside of the string table")
+	{
+		// A valid checksum, so only the check of the offsets can catch it.
+		std::vector<char> file = valid;
+		const std::size_t recordOffset = static_cast<std::size_t>(snapshotTests::SectionOffset(file, snapshotTests::cardTypesSection));
+		auto record = snapshotTests::Read<snapshotTests::NamedRecord>(file, recordOffset);
+		record.name.offset = 28;
+		snapshotTests::Write(file, recordOffset, record);
+		snapshotTests::UpdateChecksum(file);
+		snapshotTests::SaveFile(snapshotTests::path, file);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) == nullptr);
+	}
+
+	SECTION("Unchanged")
+	{
+		snapshotTests::SaveFile(snapshotTests::path, valid);
+		REQUIRE(tbsg::GameDataSnapshot::Open(snapshotTests::path) != nullptr);
+	}
+
+	std::remove(snapshotTests::path.c_str());
+}
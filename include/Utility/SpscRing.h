@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * \brief Wait-free bounded queue for exactly one producer thread and one consumer thread.
+ * Values are move constructed into the ring and destroyed when popped, so T only needs to be move constructible.
+ * \tparam Capacity The amount of slots, should be a power of two.
+ */
+template <class T, std::size_t Capacity>
+class SpscRing
+{
+	static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity should be a power of two");
+
+public:
+	SpscRing() = default;
+	~SpscRing();
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	/**
+	 * \brief Producer only.
+	 * \return bool False when the ring is full, the value is left untouched.
+	 */
+	bool TryPush(T&& value);
+
+	/**
+	 * \brief Consumer only. The oldest value in the ring, or nullptr when the ring is empty.
+	 */
+	T* Front();
+	/**
+	 * \brief Consumer only. Destroys the value returned by Front().
+	 */
+	void Pop();
+
+	bool Empty() const noexcept { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire); }
+
+private:
+	using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+	T* At(std::size_t index) noexcept { return reinterpret_cast<T*>(&slots[index & (Capacity - 1)]); }
+
+	// Positions only ever increase, the slot is the position modulo the capacity.
+	alignas(64) std::atomic<std::size_t> head{ 0 }; // written by the consumer
+	alignas(64) std::atomic<std::size_t> tail{ 0 }; // written by the producer
+	alignas(64) Slot slots[Capacity];
+};
+
+template <class T, std::size_t Capacity>
+SpscRing<T, Capacity>::~SpscRing()
+{
+	while (Front() != nullptr)
+	{
+		Pop();
+	}
+}
+
+template <class T, std::size_t Capacity>
+bool SpscRing<T, Capacity>::TryPush(T&& value)
+{
+	const std::size_t position = tail.load(std::memory_order_relaxed);
+	if (position - head.load(std::memory_order_acquire) == Capacity)
+	{
+		return false;
+	}
+
+	new (At(position)) T(std::move(value));
+	tail.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+template <class T, std::size_t Capacity>
+T* SpscRing<T, Capacity>::Front()
+{
+	const std::size_t position = head.load(std::memory_order_relaxed);
+	if (position == tail.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+	return At(position);
+}
+
+template <class T, std::size_t Capacity>
+void SpscRing<T, Capacity>::Pop()
+{
+	const std::size_t position = head.load(std::memory_order_relaxed);
+	At(position)->~T();
+	head.store(position + 1, std::memory_order_release);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief A fixed set of worker threads that run submitted jobs in order of submission.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * \param workerCount The amount of threads, 0 runs every job on the thread that waits for it.
+	 */
+	explicit ThreadPool(unsigned int workerCount = DefaultWorkerCount());
+	/**
+	 * \brief Finishes the jobs that are already submitted, then joins the workers.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * \brief Runs the job on one of the workers. Without workers the job runs right away.
+	 */
+	void Submit(std::function<void()> job);
+
+	/**
+	 * \brief Calls job(i) for every i in [0, count) and returns when all calls returned.
+	 * The calling thread runs indices as well, so this completes even when all workers are busy with other jobs.
+	 */
+	void ParallelFor(std::size_t count, const std::function<void(std::size_t)>& job);
+
+	unsigned int GetWorkerCount() const noexcept { return static_cast<unsigned int>(workers.size()); }
+
+	/**
+	 * \brief One thread less than the hardware has, leaving a core to the thread that owns the pool.
+	 */
+	static unsigned int DefaultWorkerCount() noexcept;
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers{};
+	std::deque<std::function<void()>> jobs{};
+	std::mutex mutex{};
+	std::condition_variable jobAvailable{};
+	bool stopping{ false };
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "core/SparseSet.h"
+#include "memory/Containers.h"
+
+namespace db
+{
+	/**
+	 * \brief Finds cards of a ptl::sparse_set by id in constant time, where sparse_set::at(..) scans all keys.
+	 * \warning Points into the set, so it has to be rebuilt when cards are added to or removed from it.
+	 */
+	template<typename CardType>
+	class CardIndex
+	{
+	public:
+		CardIndex() = default;
+		explicit CardIndex(ptl::sparse_set<unsigned int, CardType>& cards)
+		{
+			Build(cards);
+		}
+
+		void Build(ptl::sparse_set<unsigned int, CardType>& cards)
+		{
+			this->index.clear();
+			this->index.reserve(cards.size());
+			for (std::size_t i = 0; i < cards.keys.size(); i++)
+			{
+				this->index[cards.keys[i]] = &cards.values[i];
+			}
+		}
+
+		/**
+		 * \return CardType* The card, or nullptr when there is no card with the id.
+		 */
+		CardType* Find(unsigned int id) const
+		{
+			auto it = this->index.find(id);
+			return it != this->index.end() ? it->second : nullptr;
+		}
+
+		std::size_t GetSize() const noexcept { return this->index.size(); }
+
+	private:
+		ptl::unordered_map<unsigned int, CardType*> index{};
+	};
+}
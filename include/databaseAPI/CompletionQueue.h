@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace db
+{
+	/**
+	 * \brief Completions of asynchronous database calls, posted by the workers and run by the thread that drains the queue.
+	 */
+	class CompletionQueue
+	{
+	public:
+		void Post(std::function<void()> completion);
+		/**
+		 * \brief Runs the posted completions on the calling thread, in order of posting.
+		 * \param maxCompletions 0 runs all of them.
+		 * \return std::size_t The amount of completions that ran.
+		 */
+		std::size_t Drain(std::size_t maxCompletions = 0);
+		bool Empty() const;
+
+	private:
+		mutable std::mutex mutex{};
+		std::deque<std::function<void()>> completions{};
+	};
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <mariadb++/account.hpp>
+#include <mariadb++/connection.hpp>
+#include "DatabaseCredentials.h"
+#include "StatementCache.h"
+
+namespace db
+{
+	struct PoolOptions
+	{
+		/**
+		 * \brief Connections that are opened by ConnectionPool::Open() and kept open.
+		 */
+		std::size_t minConnections{ 1 };
+		std::size_t maxConnections{ 4 };
+		/**
+		 * \brief How long ConnectionPool::Acquire() waits for a free connection before it throws.
+		 */
+		std::chrono::milliseconds acquireTimeout{ 5000 };
+		/**
+		 * \brief Connections that were idle for longer are pinged before they are handed out.
+		 */
+		std::chrono::milliseconds healthCheckInterval{ 30000 };
+		/**
+		 * \brief The wait after a failed connect, doubled on every failure up to maxReconnectBackoff.
+		 */
+		std::chrono::milliseconds reconnectBackoff{ 100 };
+		std::chrono::milliseconds maxReconnectBackoff{ 5000 };
+	};
+
+	/**
+	 * \brief A bounded pool of database connections, so multiple threads can query at the same time.
+	 * Every connection has its own StatementCache. A connection is borrowed for one operation, or for a whole transaction, using Acquire().
+	 */
+	class ConnectionPool
+	{
+		struct PooledConnection
+		{
+			mariadb::connection_ref connection{};
+			StatementCache statements{};
+			std::chrono::steady_clock::time_point lastUsed{};
+		};
+
+	public:
+		/**
+		 * \brief A borrowed connection, given back to the pool when it is destroyed.
+		 */
+		class Lease
+		{
+			friend ConnectionPool;
+		public:
+			Lease(Lease&& other) noexcept;
+			Lease& operator=(Lease&& other) noexcept;
+			Lease(const Lease&) = delete;
+			Lease& operator=(const Lease&) = delete;
+			~Lease();
+
+			/**
+			 * \brief Use it for transactions, mariadb::connection::create_transaction(..) runs on the borrowed connection.
+			 */
+			const mariadb::connection_ref& GetConnection() const noexcept { return this->pooled->connection; }
+			StatementCache& GetStatements() const noexcept { return this->pooled->statements; }
+
+		private:
+			Lease(ConnectionPool* pool, std::unique_ptr<PooledConnection> pooled);
+
+			ConnectionPool* pool{ nullptr };
+			std::unique_ptr<PooledConnection> pooled{};
+		};
+
+		ConnectionPool(DatabaseCredentials credentials, PoolOptions options);
+		ConnectionPool(const ConnectionPool&) = delete;
+		ConnectionPool& operator=(const ConnectionPool&) = delete;
+		/**
+		 * \warning All leases should be returned first.
+		 */
+		~ConnectionPool() = default;
+
+		/**
+		 * \brief Opens the minimum amount of connections.
+		 * \return bool Whether all of them connected.
+		 */
+		bool Open();
+		/**
+		 * \brief Borrows an idle connection, opens a new one while below the maximum, or waits for one to be returned.
+		 * \throws mariadb::exception::connection When no connection could be borrowed within PoolOptions::acquireTimeout.
+		 */
+		Lease Acquire();
+
+		std::size_t GetSize() const;
+		std::size_t GetIdleCount() const;
+		const PoolOptions& GetOptions() const noexcept { return this->options; }
+
+	private:
+		void Release(std::unique_ptr<PooledConnection> pooled);
+		/**
+		 * \brief Pings a connection that was idle for too long, and reconnects it when the ping fails.
+		 */
+		bool CheckHealth(PooledConnection& pooled);
+		/**
+		 * \brief Connects, unless the backoff of an earlier failure hasn't passed yet.
+		 */
+		bool Connect(PooledConnection& pooled);
+
+		DatabaseCredentials credentials;
+		PoolOptions options;
+		mariadb::account_ref account{};
+
+		mutable std::mutex mutex;
+		std::condition_variable released;
+		std::vector<std::unique_ptr<PooledConnection>> idle{};
+		/**
+		 * \brief Idle and borrowed connections, including the ones that are still connecting.
+		 */
+		std::size_t size{ 0 };
+
+		std::chrono::milliseconds backoff{ 0 };
+		std::chrono::steady_clock::time_point nextConnectAttempt{};
+	};
+}
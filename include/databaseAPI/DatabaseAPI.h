@@ -3,18 +3,122 @@
 #include "DatabaseCredentials.h"
 #include <mariadb++/connection.hpp>
 #include "Payloads.h"
+#include "ConnectionPool.h"
+#include "CompletionQueue.h"
+#include "WriteBehindQueue.h"
+#include "CardIndex.h"
+#include "Utility/ThreadPool.h"
+#include <future>
+#include <memory>
 #include "core/SparseSet.h"
 
 namespace db
 {
+	/**
+	 * \brief A monster deck with the ids of its monster cards, for when the monster cards aren't loaded yet.
+	 */
+	struct UnlinkedMonsterDeck
+	{
+		unsigned int id{};
+		ptl::string name{};
+		ptl::vector<unsigned int> monsterCardIds{};
+	};
+
+	/**
+	 * \brief Every call borrows a connection of the pool for its duration, so the methods can be called from multiple threads at once.
+	 * Every method can also run asynchronously on the database workers using Async(..).
+	 * \warning Pending asynchronous calls use this object, so it shouldn't be moved while they run. The destructor waits for them.
+	 */
 	class DatabaseAPI
 	{
 	public:
 		DatabaseAPI() = default;
-		explicit DatabaseAPI(DatabaseCredentials credentials, unsigned int projectId);
-		~DatabaseAPI() = default;
+		explicit DatabaseAPI(DatabaseCredentials credentials, unsigned int projectId, PoolOptions poolOptions = PoolOptions{});
+		~DatabaseAPI();
+
+		/**
+		 * \brief Copying stopped with the database workers, a copy would share them and the pool. Moving still works.
+		 */
+		DatabaseAPI(const DatabaseAPI&) = delete;
+		DatabaseAPI& operator=(const DatabaseAPI&) = delete;
+		DatabaseAPI(DatabaseAPI&&) = default;
+		/**
+		 * \brief Waits for the workers and write-behind queue of this object before replacing the pool they borrow from.
+		 */
+		DatabaseAPI& operator=(DatabaseAPI&& other);
 
+		/**
+		 * \brief Opens the pool and starts one database worker per pooled connection.
+		 */
 		void OpenDatabaseConnection();
+		/**
+		 * \brief The pool of the opened connection. Borrow a connection from it to run multiple statements in one transaction.
+		 */
+		ConnectionPool& GetPool() const noexcept { return *this->pool; }
+		unsigned int GetProjectId() const noexcept { return this->projectId; }
+
+		/**
+		 * \brief Queues RegisterIp, PingServer, SetServerOccupied and EndMatch instead of writing them right away.
+		 * They are written in batches in the background, and flushed when the api is destroyed.
+		 * StartMatch is always written right away, so GetNextMatchForServer(..) doesn't return a started match again.
+		 * \warning Reads see the writes up to WriteBehindOptions::flushInterval later, on other servers and on this one,
+		 * e.g. GetAvailableServers(..) still returns a server whose occupied state is queued. Call FlushWrites() first where that matters.
+		 * \param onFailure Logs the dropped writes when empty.
+		 */
+		void EnableWriteBehind(WriteBehindOptions options = WriteBehindOptions{}, WriteBehindQueue::FailureCallback onFailure = {});
+		/**
+		 * \brief Writes the queued writes before returning. Does nothing without write-behind.
+		 */
+		void FlushWrites() const;
+
+		/**
+		 * \brief Calls the method on a database worker, e.g. Async(&DatabaseAPI::GetProfile, profileId).
+		 * Arguments are copied, use std::ref for the reference parameters. Overloaded methods have to be cast to the overload.
+		 * \return std::future The result, or the database error that get() rethrows.
+		 */
+		template<typename Result, typename... Params, typename... Args>
+		std::future<Result> Async(Result(DatabaseAPI::*method)(Params...) const, Args... args) const
+		{
+			return RunAsync([method, args...](const DatabaseAPI& api) mutable { return (api.*method)(args...); });
+		}
+		/**
+		 * \brief Calls the method on a database worker, and the callback with its ready future on the thread that calls DrainCompletions().
+		 */
+		template<typename Callback, typename Result, typename... Params, typename... Args>
+		void Async(Callback callback, Result(DatabaseAPI::*method)(Params...) const, Args... args) const
+		{
+			RunAsync([method, args...](const DatabaseAPI& api) mutable { return (api.*method)(args...); }, std::move(callback));
+		}
+		/**
+		 * \brief Runs work(const DatabaseAPI&) on a database worker, for multiple calls that belong together.
+		 */
+		template<typename Work>
+		auto RunAsync(Work work) const -> std::future<decltype(work(*this))>
+		{
+			using Result = decltype(work(*this));
+			auto task = std::make_shared<std::packaged_task<Result()>>([this, work]() mutable { return work(*this); });
+			std::future<Result> future = task->get_future();
+			this->asyncWorkers->Submit([task]() { (*task)(); });
+			return future;
+		}
+		template<typename Work, typename Callback>
+		void RunAsync(Work work, Callback callback) const
+		{
+			using Result = decltype(work(*this));
+			auto task = std::make_shared<std::packaged_task<Result()>>([this, work]() mutable { return work(*this); });
+			auto future = std::make_shared<std::future<Result>>(task->get_future());
+			auto completions = this->completions;
+			this->asyncWorkers->Submit([task, future, completions, callback]() mutable
+			{
+				(*task)();
+				completions->Post([future, callback]() mutable { callback(std::move(*future)); });
+			});
+		}
+		/**
+		 * \brief Runs the callbacks of the asynchronous calls that completed, on the calling thread.
+		 * \param maxCompletions 0 runs all of them.
+		 */
+		std::size_t DrainCompletions(std::size_t maxCompletions = 0) const { return this->completions->Drain(maxCompletions); }
 
 		/**
 		 * \brief Get the profile id from the token the client might have provided.
@@ -33,6 +137,11 @@ namespace db
 		ptl::sparse_set<unsigned int, tbsg::CardRarity> GetCardRarities() const;
 
 		ptl::vector<tbsg::Deck> GetDecksOfProfile(unsigned int profileId, ptl::sparse_set<unsigned int, tbsg::Card>& cards) const;
+		/**
+		 * \brief Get the decks of many profiles with their cards in one query per maxProfilesPerQuery profiles, e.g. for a matchmaking batch.
+		 * \return The decks per profile id. Every requested profile has an entry, which is empty when it has no decks.
+		 */
+		ptl::unordered_map<unsigned int, ptl::vector<tbsg::Deck>> GetDecksOfProfiles(const ptl::vector<unsigned int>& profileIds, const CardIndex<tbsg::Card>& cards) const;
 		/**
 		 * \brief Get the monster deck using the id.
 		 * \return tbsg::MonsterDeck The actual monster deck requested. (When id is invalid, will return a MonsterDeck object with id == 0)
@@ -45,6 +154,14 @@ namespace db
 		tbsg::MonsterDeck GetMonsterDeck(const ptl::string& name, ptl::sparse_set<unsigned int, tbsg::MonsterCard>& cards) const;
 
 		void GetMonsterDecks(ptl::sparse_set<unsigned int, tbsg::MonsterDeck>& monsterDecks,ptl::sparse_set<unsigned int, tbsg::MonsterCard>& cards) const;
+		/**
+		 * \brief Get all monster decks without the monster cards, so they can be loaded at the same time. Link them with LinkMonsterDecks(..).
+		 */
+		ptl::vector<UnlinkedMonsterDeck> GetUnlinkedMonsterDecks() const;
+		/**
+		 * \brief Adds the decks to monsterDecks, pointing to the cards. Cards that don't exist are left out of the decks.
+		 */
+		static void LinkMonsterDecks(const ptl::vector<UnlinkedMonsterDeck>& decks, ptl::sparse_set<unsigned int, tbsg::MonsterDeck>& monsterDecks, ptl::sparse_set<unsigned int, tbsg::MonsterCard>& cards);
 
 		void GetScriptsForCards(ptl::sparse_set<unsigned int, tbsg::Script>& scripts) const;
 		/**
@@ -69,6 +186,16 @@ namespace db
 		 * \return tbsg::Script The actual script requested. (When id is invalid, will return a Script object with id == 0)
 		 */
 		tbsg::Script GetOtherScript(const ptl::string& scriptName) const;
+		/**
+		 * \brief Get the latest revision of every script, e.g. to find out whether loaded scripts are outdated.
+		 * \return The revision per script id.
+		 */
+		ptl::unordered_map<unsigned int, unsigned int> GetLatestScriptRevisions() const;
+		/**
+		 * \brief Get the latest revision of the scripts, in one query per maxScriptsPerQuery scripts.
+		 * \return The scripts with their id, code and revision. Scripts that don't exist are left out.
+		 */
+		ptl::vector<tbsg::Script> GetLatestScripts(const ptl::vector<unsigned int>& scriptIds) const;
 
 		/**
 		 * \brief Get all the servers that are not occupied and were online in the last 15 minutes.
@@ -135,13 +262,22 @@ namespace db
 		 */
 		const tbsg::Match GetNextMatchForServer(unsigned int serverId) const;
 
+		static constexpr std::size_t maxProfilesPerQuery = 32;
+		static constexpr std::size_t maxScriptsPerQuery = 32;
+
 	private:
 		unsigned int projectId{};
 
 		DatabaseCredentials credentials{};
+		PoolOptions poolOptions{};
 
-		mariadb::account_ref account{};
-		mariadb::connection_ref connection{};
+		std::shared_ptr<ConnectionPool> pool{};
+		std::shared_ptr<CompletionQueue> completions{ std::make_shared<CompletionQueue>() };
+		std::unique_ptr<WriteBehindQueue> writeBehind{};
+		/**
+		 * \brief Declared after the pool it borrows from, and joined first by the destructor.
+		 */
+		std::unique_ptr<ThreadPool> asyncWorkers{ std::make_unique<ThreadPool>(0) };
 
 		ptl::string databasePrefix = "\u001b[0bm[DatabaseAPI]\u001b[0m";
 
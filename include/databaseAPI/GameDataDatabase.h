@@ -3,6 +3,7 @@
 #include "core/SparseSet.h"
 #include "memory/String.h"
 
+#include <chrono>
 #include <memory>
 #include <mariadb++/connection.hpp>
 #include "DatabaseAPI.h"
@@ -30,12 +31,45 @@ namespace tbsg {
 
 		/**
 		 * \brief Loads the data from the database. It also binds the datamodel to lua.
+		 * The tables are queried at the same time on the database workers, so the api has to be opened with OpenDatabaseConnection() first.
 		 */
 		void Initialize(db::DatabaseAPI* api);
+		/**
+		 * \brief Loads the data from a snapshot written by SaveSnapshot(..), and from the database like Initialize(api) when the snapshot can't be used.
+		 * \param validate Only use the snapshot when its scripts are still at their latest revision. Without it, startup doesn't wait for the database at all.
+		 * \return bool Whether the data was loaded from the snapshot.
+		 */
+		bool Initialize(db::DatabaseAPI* api, const std::string& snapshotPath, bool validate);
+		/**
+		 * \brief Writes the loaded data to a snapshot file, which servers can start from with Initialize(api, snapshotPath, validate).
+		 * \return bool Whether writing succeeded.
+		 */
+		bool SaveSnapshot(const std::string& path) const;
+
+		/**
+		 * \brief Checks the database for changed cards, monster cards and scripts every interval, while the server keeps running.
+		 * The check runs on a database worker and only fetches the code of scripts whose revision changed.
+		 * The changes are applied by db::DatabaseAPI::DrainCompletions(), so they are never half applied while the game thread reads them.
+		 * \warning The api has to outlive pending refreshes, a refresh that completes after this database was destroyed is dropped. Cards, monster cards and scripts that are new since loading need a restart,
+		 * adding them could move the ones that decks and the Lua bindings point to.
+		 */
+		void EnableRefresh(std::chrono::milliseconds interval);
+		/**
+		 * \brief Starts a refresh when the refresh interval passed. Call it every tick from the thread that drains the completions.
+		 */
+		void Update();
+		/**
+		 * \brief Starts a refresh right away, unless one is still running.
+		 */
+		void Refresh();
 		/**
 		 * \brief Loads the decks for the specified profile from the database.
 		 */
 		void LoadDecksOfProfile(unsigned int profileId);
+		/**
+		 * \brief Loads the decks of all the profiles at once, e.g. to prefetch them for a matchmaking batch.
+		 */
+		void LoadDecksOfProfiles(const ptl::vector<unsigned int>& profileIds);
 		/**
 		 * \brief Loads the specified deck from the database.
 		 * \warning Should only be called once! Use GetMonsterDeck(deckId) to get the actual object after loading.
@@ -90,9 +124,27 @@ namespace tbsg {
 		 */
 		bool CreateHarddriveCopyOfScript(const ptl::string& requestedString);
 	private:
+		friend class GameDataSnapshot;
+
+		/**
+		 * \brief What a refresh fetched. Built on a database worker, applied on the game thread.
+		 */
+		struct RefreshedData
+		{
+			ptl::sparse_set<unsigned int, Card> cards{};
+			ptl::sparse_set<unsigned int, MonsterCard> monsterCards{};
+			ptl::vector<Script> scripts{};
+		};
+
+		void ApplyRefresh(RefreshedData& refreshed);
+
 		db::DatabaseAPI* api{};
 
 		ptl::sparse_set<unsigned int, Card> cards{};
+		/**
+		 * \brief Built once the cards are loaded, the cards aren't changed afterwards.
+		 */
+		db::CardIndex<Card> cardIndex{};
 		ptl::sparse_set<unsigned int, MonsterCard> monsterCards{};
 		ptl::sparse_set<unsigned int, CardType> cardTypes{};
 		ptl::sparse_set<unsigned int, CardRarity> cardRarity{};
@@ -100,5 +152,13 @@ namespace tbsg {
 		ptl::sparse_set<unsigned int, Reward> rewards{};
 		ptl::unordered_map<unsigned int, ptl::vector<Deck>> decks{};
 		ptl::sparse_set<unsigned int, MonsterDeck> monsterDecks{};
+
+		std::chrono::milliseconds refreshInterval{ 0 };
+		std::chrono::steady_clock::time_point lastRefresh{};
+		bool refreshing{ false };
+		/**
+		 * \brief Expires with the database, so pending refreshes can tell whether it still exists.
+		 */
+		std::shared_ptr<bool> lifetime{ std::make_shared<bool>(true) };
 	};
 }
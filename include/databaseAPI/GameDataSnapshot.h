@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "memory/Containers.h"
+
+namespace tbsg
+{
+	class GameDataDatabase;
+
+	/**
+	 * \brief A binary file with the game data of a GameDataDatabase, so servers can start without loading it from the database.
+	 * The file is mapped into memory and read in place: records have a fixed size and refer to each other and to a string table by offset.
+	 * A header with the format version and a checksum of the rest of the file guards against old or damaged files.
+	 * \warning Files are written in the byte order of the machine that writes them.
+	 */
+	class GameDataSnapshot
+	{
+	public:
+		static constexpr std::uint32_t formatVersion = 1;
+
+		/**
+		 * \brief Writes the data loaded by the database to the file. The old file is only replaced once the new one is complete.
+		 * \return bool Whether writing succeeded.
+		 */
+		static bool Write(const GameDataDatabase& database, unsigned int projectId, const std::string& path);
+		/**
+		 * \brief Maps the file and checks its header, checksum and offsets.
+		 * \return The snapshot, or nullptr when the file is missing or can't be used.
+		 */
+		static std::unique_ptr<GameDataSnapshot> Open(const std::string& path);
+
+		GameDataSnapshot(const GameDataSnapshot&) = delete;
+		GameDataSnapshot& operator=(const GameDataSnapshot&) = delete;
+		~GameDataSnapshot();
+
+		unsigned int GetProjectId() const;
+		/**
+		 * \brief Whether every script of the snapshot is still at its latest revision.
+		 * \param latestRevisions The revisions of DatabaseAPI::GetLatestScriptRevisions().
+		 */
+		bool HasLatestScripts(const ptl::unordered_map<unsigned int, unsigned int>& latestRevisions) const;
+		/**
+		 * \brief Replaces the cards, monster cards, monster decks, card types, card rarities and scripts of the database with the ones of the snapshot.
+		 */
+		void Load(GameDataDatabase& database) const;
+
+	private:
+		struct Mapping;
+
+		explicit GameDataSnapshot(std::unique_ptr<Mapping> mapping);
+
+		/**
+		 * \brief Checks the offsets and sizes of the file, after which the records can be read without bounds checks.
+		 */
+		bool Validate(const std::string& path) const;
+		template<typename Record>
+		const Record* GetRecords(std::size_t section) const;
+		std::size_t GetCount(std::size_t section) const;
+
+		std::unique_ptr<Mapping> mapping;
+	};
+}
@@ -197,6 +197,8 @@ namespace tbsg
 		/// != "" when the script is not for any (monster) card.
 		ptl::string name{};
 		ptl::string code{};
+		/// The revision of the code, scripts are loaded at their latest revision.
+		unsigned int revision{ 0 };
 	};
 
 	/**
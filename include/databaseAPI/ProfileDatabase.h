@@ -2,6 +2,8 @@
 #include "core/SparseSet.h"
 #include "memory/String.h"
 #include "DatabaseAPI.h"
+#include <functional>
+#include <memory>
 
 namespace net
 {
@@ -30,6 +32,12 @@ namespace tbsg
 		void Initialize(db::DatabaseAPI* api);
 
 		SessionTokenResponse CheckSessionToken(net::Connection* connection, ptl::string token);
+		/**
+		 * \brief Looks the token and its profile up on a database worker, without blocking the calling thread.
+		 * \param callback Called from db::DatabaseAPI::DrainCompletions(), the profile is added by then.
+		 * Not called when this database was destroyed before the lookup completed.
+		 */
+		void CheckSessionTokenAsync(unsigned int connectionId, ptl::string token, std::function<void(SessionTokenResponse)> callback);
 		/**
 		 * \brief Load a profile using an id.
 		 * \warning Should only be used to simulate games!
@@ -42,10 +50,19 @@ namespace tbsg
 		tbsg::Profile* GetProfileUsingConnection(unsigned int connectionId);
 
 	private:
+		/**
+		 * \brief Adds the profile for the connection, unless another connection already uses it.
+		 */
+		SessionTokenResponse ClaimProfile(unsigned int connectionId, Profile profile);
+
 		db::DatabaseAPI* api{};
 		std::unordered_map<unsigned int, Profile> profiles{};
 
 		std::string prefix = "[ProfileDatabase]";
+		/**
+		 * \brief Expires with the database, so pending session token checks can tell whether it still exists.
+		 */
+		std::shared_ptr<bool> lifetime{ std::make_shared<bool>(true) };
 
 	};
 }
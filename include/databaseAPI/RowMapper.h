@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <mariadb++/result_set.hpp>
+
+namespace db
+{
+	/**
+	 * \brief A column of a RowMapper: its name and how to reach its field in the row.
+	 */
+	template<typename Access>
+	struct RowColumn
+	{
+		const char* name;
+		Access access;
+	};
+
+	/**
+	 * \brief Maps a column to a member of the row.
+	 */
+	template<typename Row, typename Field>
+	auto Column(const char* name, Field Row::* member)
+	{
+		auto access = [member](Row& row) -> Field& { return row.*member; };
+		return RowColumn<decltype(access)>{ name, access };
+	}
+	/**
+	 * \brief Maps a column to a member of a member of the row, like Card::meta and MetaData::name.
+	 */
+	template<typename Row, typename Outer, typename Field>
+	auto Column(const char* name, Outer Row::* outer, Field Outer::* member)
+	{
+		auto access = [outer, member](Row& row) -> Field& { return (row.*outer).*member; };
+		return RowColumn<decltype(access)>{ name, access };
+	}
+
+	/**
+	 * \brief Maps a column to whatever access(row) returns a reference to.
+	 */
+	template<typename Access>
+	RowColumn<Access> Column(const char* name, Access access)
+	{
+		return RowColumn<Access>{ name, access };
+	}
+
+	namespace detail
+	{
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, unsigned int& field) { field = result.get_unsigned32(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, int& field) { field = result.get_signed32(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, unsigned long long& field) { field = result.get_unsigned64(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, long long& field) { field = result.get_signed64(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, bool& field) { field = result.get_boolean(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, float& field) { field = result.get_float(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, double& field) { field = result.get_double(index); }
+		inline void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, std::string& field) { field = result.get_string(index); }
+		/**
+		 * \brief Strings with another allocator, like ptl::string, copy the characters straight from the row into their own buffer.
+		 */
+		template<typename Allocator>
+		void ReadColumn(const mariadb::result_set& result, mariadb::u32 index, std::basic_string<char, std::char_traits<char>, Allocator>& field)
+		{
+			const char* value = result.get_string_data(index);
+			field.assign(value, result.column_size(index));
+		}
+	}
+
+	/**
+	 * \brief Fills rows of a result set by column index, instead of looking every column up by name for every row.
+	 * The columns are known at compile time, Bind(..) looks their indices up once per result set.
+	 *
+	 * \code
+	 * auto mapper = db::MakeRowMapper<tbsg::CardType>(db::Column("id", &tbsg::CardType::id), db::Column("name", &tbsg::CardType::name));
+	 * mapper.Bind(*result);
+	 * while (result->next()) { tbsg::CardType type{}; mapper.Fill(*result, type); }
+	 * \endcode
+	 */
+	template<typename Row, typename... Columns>
+	class RowMapper
+	{
+	public:
+		explicit RowMapper(Columns... columns) : columns(std::move(columns)...)
+		{
+		}
+
+		/**
+		 * \brief Looks the indices of the columns up in the result set.
+		 * \throws std::out_of_range When the result set doesn't have one of the columns.
+		 */
+		void Bind(const mariadb::result_set& result)
+		{
+			BindColumns(result, std::index_sequence_for<Columns...>{});
+		}
+
+		/**
+		 * \brief Reads the current row of the result set, which has to be the one given to Bind(..).
+		 */
+		void Fill(const mariadb::result_set& result, Row& row) const
+		{
+			FillColumns(result, row, std::index_sequence_for<Columns...>{});
+		}
+
+	private:
+		template<std::size_t... Indices>
+		void BindColumns(const mariadb::result_set& result, std::index_sequence<Indices...>)
+		{
+			const char* names[] = { std::get<Indices>(this->columns).name... };
+			for (std::size_t i = 0; i < sizeof...(Columns); i++)
+			{
+				this->indices[i] = result.column_index(names[i]);
+				if (this->indices[i] == missingColumn)
+				{
+					throw std::out_of_range(std::string("Result set has no column ") + names[i]);
+				}
+			}
+		}
+
+		template<std::size_t... Indices>
+		void FillColumns(const mariadb::result_set& result, Row& row, std::index_sequence<Indices...>) const
+		{
+			int expand[] = { 0, (detail::ReadColumn(result, this->indices[Indices], std::get<Indices>(this->columns).access(row)), 0)... };
+			(void)expand;
+		}
+
+		static constexpr mariadb::u32 missingColumn = 0xffffffff;
+
+		std::tuple<Columns...> columns;
+		std::array<mariadb::u32, sizeof...(Columns)> indices{};
+	};
+
+	template<typename Row, typename... Columns>
+	RowMapper<Row, Columns...> MakeRowMapper(Columns... columns)
+	{
+		return RowMapper<Row, Columns...>(std::move(columns)...);
+	}
+}
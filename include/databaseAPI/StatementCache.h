@@ -0,0 +1,120 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <mariadb++/connection.hpp>
+#include <mariadb++/exceptions.hpp>
+
+namespace db
+{
+	/**
+	 * \brief The prepared statements of one connection, so a repeated query skips the prepare round trip and reuses its bind buffers.
+	 * Statements are keyed by their SQL text.
+	 * \warning Not thread safe, just like the connection. The result_set of a statement should be released before the statement runs again.
+	 */
+	class StatementCache
+	{
+	public:
+		StatementCache() = default;
+		explicit StatementCache(mariadb::connection_ref connection);
+
+		/**
+		 * \brief Runs a query without parameters.
+		 */
+		mariadb::result_set_ref Query(const std::string& sql);
+		/**
+		 * \brief Runs a query.
+		 * \param bind Sets the parameters of the statement, e.g. [&](mariadb::statement_ref& statement) { statement->set_unsigned32(0, id); }
+		 */
+		template<typename Bind>
+		mariadb::result_set_ref Query(const std::string& sql, Bind bind)
+		{
+			return Run(sql, bind, [](mariadb::statement_ref& statement) { return statement->query(); }, true);
+		}
+		/**
+		 * \brief Runs a query without buffering its result: rows are received one at a time by next(), into bind buffers that are reused for every row.
+		 * Use it for large results that are read once from start to end, row_count() is only known after the last row.
+		 * \warning The connection is busy until the result is read or released, no other statement can run on it before that.
+		 */
+		mariadb::result_set_ref QueryUnbuffered(const std::string& sql);
+		template<typename Bind>
+		mariadb::result_set_ref QueryUnbuffered(const std::string& sql, Bind bind)
+		{
+			return Run(sql, bind, [](mariadb::statement_ref& statement) { return statement->query_unbuffered(); }, true);
+		}
+		/**
+		 * \return mariadb::u64 The amount of affected rows.
+		 * \warning Throws when the connection was lost while the statement ran, the caller has to find out whether it was applied.
+		 */
+		template<typename Bind>
+		mariadb::u64 Execute(const std::string& sql, Bind bind)
+		{
+			return Run(sql, bind, [](mariadb::statement_ref& statement) { return statement->execute(); }, false);
+		}
+		/**
+		 * \return mariadb::u64 The id of the inserted row.
+		 * \warning Throws when the connection was lost while the statement ran, the caller has to find out whether it was applied.
+		 */
+		template<typename Bind>
+		mariadb::u64 Insert(const std::string& sql, Bind bind)
+		{
+			return Run(sql, bind, [](mariadb::statement_ref& statement) { return statement->insert(); }, false);
+		}
+
+		/**
+		 * \brief Get the prepared statement of the SQL, it is only prepared the first time.
+		 */
+		mariadb::statement_ref Get(const std::string& sql);
+		/**
+		 * \brief Closes all statements, they are prepared again when they are used.
+		 */
+		void Clear();
+		std::size_t GetSize() const noexcept { return statements.size(); }
+
+		/**
+		 * \brief Whether the error means the connection, and with it every prepared statement, is gone.
+		 */
+		static bool IsConnectionLost(unsigned int errorId);
+		/**
+		 * \brief Whether the connection was lost after the statement was sent, so the server may have run it.
+		 */
+		static bool MayHaveRun(unsigned int errorId);
+
+	private:
+		/**
+		 * \brief Binds and runs the statement. When the connection was lost, it reconnects and tries once more with freshly prepared statements.
+		 * \param repeatable Whether running the statement twice is harmless. Other statements only try again when they can't have run yet.
+		 */
+		template<typename Bind, typename Runner>
+		auto Run(const std::string& sql, Bind& bind, Runner run, bool repeatable) -> decltype(run(std::declval<mariadb::statement_ref&>()))
+		{
+			try
+			{
+				mariadb::statement_ref statement = Get(sql);
+				bind(statement);
+				return run(statement);
+			}
+			catch (const mariadb::exception::connection& exception)
+			{
+				if (!IsConnectionLost(exception.error_id()))
+				{
+					throw;
+				}
+				Reconnect();
+				// A write that was lost on the way back may already be applied, running it again could apply it twice.
+				if (!repeatable && MayHaveRun(exception.error_id()))
+				{
+					throw;
+				}
+			}
+			mariadb::statement_ref statement = Get(sql);
+			bind(statement);
+			return run(statement);
+		}
+
+		void Reconnect();
+
+		mariadb::connection_ref connection{};
+		std::unordered_map<std::string, mariadb::statement_ref> statements{};
+	};
+}
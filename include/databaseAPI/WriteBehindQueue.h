@@ -0,0 +1,109 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ConnectionPool.h"
+
+namespace db
+{
+	struct WriteBehindOptions
+	{
+		/**
+		 * \brief Flushes early once this many writes are queued.
+		 */
+		std::size_t maxPending{ 256 };
+		std::chrono::milliseconds flushInterval{ 1000 };
+		/**
+		 * \brief Rows per multi-row statement. Every row count is its own cached statement.
+		 */
+		std::size_t maxRowsPerStatement{ 64 };
+	};
+
+	/**
+	 * \brief Queues fire-and-forget writes and flushes them in the background as multi-row statements.
+	 * Duplicate updates are merged: only the last heartbeat or occupied state of a server is written.
+	 * Timestamps are taken by the database when the writes are flushed, so they may lag up to WriteBehindOptions::flushInterval.
+	 */
+	class WriteBehindQueue
+	{
+	public:
+		/**
+		 * \brief Called on the flushing thread with a description of the writes that were dropped.
+		 */
+		using FailureCallback = std::function<void(const std::string& description, const std::exception& exception)>;
+
+		WriteBehindQueue(ConnectionPool& pool, WriteBehindOptions options, FailureCallback onFailure = {});
+		WriteBehindQueue(const WriteBehindQueue&) = delete;
+		WriteBehindQueue& operator=(const WriteBehindQueue&) = delete;
+		/**
+		 * \brief Stops the background thread and flushes what is still queued.
+		 */
+		~WriteBehindQueue();
+
+		void RegisterIp(unsigned int profileId, unsigned int serverId, const std::string& ip);
+		void PingServer(unsigned int serverId);
+		void SetServerOccupied(unsigned int serverId, bool isOccupied);
+		void EndMatch(unsigned int matchId);
+
+		/**
+		 * \brief Writes everything that is queued before returning.
+		 */
+		void Flush();
+		std::size_t GetPendingCount() const;
+
+	private:
+		struct IpLogEntry
+		{
+			unsigned int profileId;
+			unsigned int serverId;
+			std::string ip;
+		};
+
+		struct Pending
+		{
+			std::vector<IpLogEntry> ipLog{};
+			std::set<unsigned int> pings{};
+			std::map<unsigned int, bool> occupied{};
+			std::set<unsigned int> endedMatches{};
+
+			std::size_t Count() const;
+		};
+
+		void Queued(std::unique_lock<std::mutex>& lock);
+		void FlushLoop();
+		void Write(Pending& pending);
+		/**
+		 * \brief Runs the write, reporting instead of throwing when it fails.
+		 */
+		template<typename Work>
+		void TryWrite(const char* description, std::size_t rows, Work work);
+		/**
+		 * \brief Runs UPDATE ... WHERE `id` IN (...) in chunks, prefix being everything before the IN list.
+		 */
+		void UpdateWhereIdIn(StatementCache& statements, const char* description, const std::string& prefix, const std::set<unsigned int>& ids,
+			const std::function<void(mariadb::statement_ref&)>& bindPrefix = {}, unsigned int prefixParameters = 0);
+		static std::string Repeat(const char* item, std::size_t count);
+
+		ConnectionPool& pool;
+		WriteBehindOptions options;
+		FailureCallback onFailure;
+
+		mutable std::mutex mutex{};
+		std::condition_variable wake{};
+		Pending pending{};
+		bool stopping{ false };
+		/**
+		 * \brief Keeps flushes in order when Flush() is called while the background thread flushes.
+		 */
+		std::mutex flushMutex{};
+
+		std::thread flusher{};
+	};
+}
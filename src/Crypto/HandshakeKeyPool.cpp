@@ -0,0 +1,65 @@
+#include "Crypto/HandshakeKeyPool.h"
+#include "Utility/ThreadPool.h"
+
+#include <algorithm>
+
+net::HandshakeKeyPool::HandshakeKeyPool(ThreadPool& workers, std::size_t readyTarget) : workers(workers), readyTarget(readyTarget)
+{
+	Refill();
+}
+
+bool net::HandshakeKeyPool::TryAcquire(NetRSAKey& privateKey, NetRSAKey& publicKey)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (ready.empty())
+		{
+			return false;
+		}
+
+		privateKey = std::move(ready.front().privateKey);
+		publicKey = std::move(ready.front().publicKey);
+		ready.pop_front();
+	}
+
+	Refill();
+	return true;
+}
+
+std::size_t net::HandshakeKeyPool::GetReadyCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return ready.size();
+}
+
+void net::HandshakeKeyPool::Refill()
+{
+	std::size_t jobs;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const std::size_t maxGenerating = std::max<std::size_t>(workers.GetWorkerCount(), 1);
+		const std::size_t missing = readyTarget > ready.size() + generating ? readyTarget - ready.size() - generating : 0;
+		jobs = std::min(missing, maxGenerating > generating ? maxGenerating - generating : 0);
+		generating += jobs;
+	}
+
+	for (std::size_t i = 0; i < jobs; i++)
+	{
+		workers.Submit([this]() { Generate(); });
+	}
+}
+
+void net::HandshakeKeyPool::Generate()
+{
+	KeyPair keyPair{};
+	NetRSA::GenerateKeyPair(NetRSA::keyLength, keyPair.publicKey, keyPair.privateKey);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.push_back(std::move(keyPair));
+		generating--;
+	}
+
+	// Keep going until the target is reached, without waiting for the server to take a key.
+	Refill();
+}
@@ -0,0 +1,112 @@
+#include "Crypto/KeyExchange.h"
+#include "Crypto/SecureRandom.h"
+
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#include <openssl/kdf.h>
+
+#include <cstring>
+#include <stdio.h>
+
+namespace net
+{
+	namespace
+	{
+		const char keyInfo[] = "tbsg x25519 data channel";
+	}
+
+	KeyExchange KeyExchange::Generate()
+	{
+		KeyExchange keyExchange;
+		SecureRandom::Fill(keyExchange.privateKey, keySize);
+
+		EVP_PKEY* pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr, keyExchange.privateKey, keySize);
+		size_t publicKeySize = keySize;
+		if (pkey == nullptr || EVP_PKEY_get_raw_public_key(pkey, keyExchange.publicKey, &publicKeySize) != 1)
+		{
+			ERR_print_errors_fp(stderr);
+			keyExchange.Clear();
+		}
+		else
+		{
+			keyExchange.valid = true;
+		}
+
+		EVP_PKEY_free(pkey);
+		return keyExchange;
+	}
+
+	bool KeyExchange::DeriveKey(const unsigned char* peerPublicKey, bool isServer, NetAESKey& keyOut) const
+	{
+		if (!this->valid)
+		{
+			return false;
+		}
+
+		EVP_PKEY* ownKey = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, nullptr, this->privateKey, keySize);
+		EVP_PKEY* peerKey = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, peerPublicKey, keySize);
+		EVP_PKEY_CTX* ctx = ownKey != nullptr ? EVP_PKEY_CTX_new(ownKey, nullptr) : nullptr;
+
+		unsigned char secret[keySize];
+		size_t secretSize = sizeof(secret);
+		// Fails for low order public keys, which would give an all zero secret.
+		const bool exchanged = ctx != nullptr && peerKey != nullptr &&
+			EVP_PKEY_derive_init(ctx) == 1 &&
+			EVP_PKEY_derive_set_peer(ctx, peerKey) == 1 &&
+			EVP_PKEY_derive(ctx, secret, &secretSize) == 1;
+
+		EVP_PKEY_CTX_free(ctx);
+		EVP_PKEY_free(peerKey);
+		EVP_PKEY_free(ownKey);
+
+		if (!exchanged)
+		{
+			OPENSSL_cleanse(secret, sizeof(secret));
+			return false;
+		}
+
+		unsigned char salt[keySize * 2];
+		memcpy(salt, isServer ? peerPublicKey : this->publicKey, keySize);
+		memcpy(salt + keySize, isServer ? this->publicKey : peerPublicKey, keySize);
+
+		const bool expanded = ExpandKey(secret, secretSize, salt, sizeof(salt), keyInfo, keyOut);
+		OPENSSL_cleanse(secret, sizeof(secret));
+		return expanded;
+	}
+
+	bool KeyExchange::ExpandKey(const unsigned char* secret, std::size_t secretSize, const unsigned char* salt, std::size_t saltSize, const char* info, NetAESKey& keyOut)
+	{
+		constexpr size_t derivedSize = NetAES::keyLength >> 3;
+		unsigned char* derived = new unsigned char[derivedSize];
+		size_t outSize = derivedSize;
+
+		EVP_PKEY_CTX* hkdf = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+		const bool expanded = hkdf != nullptr &&
+			EVP_PKEY_derive_init(hkdf) == 1 &&
+			EVP_PKEY_CTX_set_hkdf_md(hkdf, EVP_sha256()) == 1 &&
+			EVP_PKEY_CTX_set1_hkdf_salt(hkdf, salt, static_cast<int>(saltSize)) == 1 &&
+			EVP_PKEY_CTX_set1_hkdf_key(hkdf, secret, static_cast<int>(secretSize)) == 1 &&
+			EVP_PKEY_CTX_add1_hkdf_info(hkdf, reinterpret_cast<const unsigned char*>(info), static_cast<int>(strlen(info))) == 1 &&
+			EVP_PKEY_derive(hkdf, derived, &outSize) == 1;
+
+		EVP_PKEY_CTX_free(hkdf);
+
+		if (!expanded)
+		{
+			ERR_print_errors_fp(stderr);
+			OPENSSL_cleanse(derived, derivedSize);
+			delete[] derived;
+			return false;
+		}
+
+		keyOut = NetAESKey{ derivedSize << 3, std::shared_ptr<unsigned char>{ derived, [](unsigned char* p) { OPENSSL_cleanse(p, derivedSize); delete[] p; } } };
+		return true;
+	}
+
+	void KeyExchange::Clear() noexcept
+	{
+		OPENSSL_cleanse(this->privateKey, keySize);
+		memset(this->publicKey, 0, keySize);
+		this->valid = false;
+	}
+}
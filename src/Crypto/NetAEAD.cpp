@@ -0,0 +1,184 @@
+#include "Crypto/NetAEAD.h"
+
+#include <openssl/evp.h>
+#include <openssl/err.h>
+
+#include <cstring>
+#include <stdio.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace net
+{
+	namespace
+	{
+		const EVP_CIPHER* GetEvpCipher(AeadCipher cipher)
+		{
+			switch (cipher)
+			{
+			case AeadCipher::AesGcm: return EVP_aes_256_gcm();
+			case AeadCipher::ChaCha20Poly1305: return EVP_chacha20_poly1305();
+			default: return nullptr;
+			}
+		}
+
+		bool HasHardwareAes() noexcept
+		{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 25)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+			return __builtin_cpu_supports("aes");
+#else
+			return false;
+#endif
+		}
+	}
+
+	NetAEAD::NetAEAD(AeadCipher cipher, NetAESKey key, bool isServer) : cipher(cipher), key(std::move(key)), isServer(isServer)
+	{
+	}
+
+	NetAEAD::NetAEAD(const NetAEAD& other) :
+		cipher(other.cipher), key(other.key), isServer(other.isServer), sendCounter(other.sendCounter), receiveCounter(other.receiveCounter)
+	{
+	}
+
+	NetAEAD::NetAEAD(NetAEAD&& other) noexcept = default;
+
+	NetAEAD& NetAEAD::operator=(const NetAEAD& other)
+	{
+		if (this != &other)
+		{
+			this->cipher = other.cipher;
+			this->key = other.key;
+			this->isServer = other.isServer;
+			this->sendCounter = other.sendCounter;
+			this->receiveCounter = other.receiveCounter;
+			this->encryptContext.reset();
+			this->decryptContext.reset();
+		}
+		return *this;
+	}
+
+	NetAEAD& NetAEAD::operator=(NetAEAD&& other) noexcept = default;
+
+	NetAEAD::~NetAEAD() = default;
+
+	void NetAEAD::ContextDeleter::operator()(EVP_CIPHER_CTX* ctx) const
+	{
+		EVP_CIPHER_CTX_free(ctx);
+	}
+
+	EVP_CIPHER_CTX* NetAEAD::GetContext(ContextPtr& context, bool encrypt)
+	{
+		if (!context)
+		{
+			const EVP_CIPHER* evpCipher = GetEvpCipher(this->cipher);
+			if (evpCipher == nullptr || this->key.key == nullptr || this->key.bitSize != 256)
+			{
+				return nullptr;
+			}
+
+			context.reset(EVP_CIPHER_CTX_new());
+			if (!context
+				|| EVP_CipherInit_ex(context.get(), evpCipher, nullptr, nullptr, nullptr, encrypt ? 1 : 0) != 1
+				|| EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_AEAD_SET_IVLEN, static_cast<int>(nonceSize), nullptr) != 1
+				|| EVP_CipherInit_ex(context.get(), nullptr, nullptr, this->key.key.get(), nullptr, encrypt ? 1 : 0) != 1)
+			{
+				ERR_print_errors_fp(stderr);
+				context.reset();
+				return nullptr;
+			}
+		}
+		return context.get();
+	}
+
+	void NetAEAD::MakeNonce(unsigned char direction, unsigned long long counter, unsigned char* nonce) const noexcept
+	{
+		memset(nonce, 0, nonceSize);
+		nonce[0] = direction;
+		for (size_t i = 0; i < sizeof(counter); i++)
+		{
+			nonce[nonceSize - 1 - i] = static_cast<unsigned char>(counter >> (i * 8));
+		}
+	}
+
+	bool NetAEAD::Seal(unsigned char* buffer, const size_t dataSize, const unsigned char* additionalData, const size_t additionalDataSize, unsigned char* tagOut)
+	{
+		EVP_CIPHER_CTX* ctx = GetContext(this->encryptContext, true);
+		if (ctx == nullptr)
+		{
+			return false;
+		}
+
+		unsigned char nonce[nonceSize];
+		MakeNonce(this->isServer ? 1 : 0, this->sendCounter, nonce);
+
+		// Only the nonce changes, the expanded key stays in the context.
+		int len;
+		if (EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1
+			|| EVP_EncryptUpdate(ctx, nullptr, &len, additionalData, static_cast<int>(additionalDataSize)) != 1
+			|| EVP_EncryptUpdate(ctx, buffer, &len, buffer, static_cast<int>(dataSize)) != 1
+			|| EVP_EncryptFinal_ex(ctx, buffer + len, &len) != 1
+			|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, static_cast<int>(tagSize), tagOut) != 1)
+		{
+			ERR_print_errors_fp(stderr);
+			return false;
+		}
+
+		this->sendCounter++;
+		return true;
+	}
+
+	bool NetAEAD::Open(unsigned char* buffer, const size_t dataSize, const unsigned char* additionalData, const size_t additionalDataSize, const unsigned char* tag)
+	{
+		EVP_CIPHER_CTX* ctx = GetContext(this->decryptContext, false);
+		if (ctx == nullptr)
+		{
+			return false;
+		}
+
+		unsigned char nonce[nonceSize];
+		MakeNonce(this->isServer ? 0 : 1, this->receiveCounter, nonce);
+
+		int len;
+		if (EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) != 1
+			|| EVP_DecryptUpdate(ctx, nullptr, &len, additionalData, static_cast<int>(additionalDataSize)) != 1
+			|| EVP_DecryptUpdate(ctx, buffer, &len, buffer, static_cast<int>(dataSize)) != 1
+			|| EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, static_cast<int>(tagSize), const_cast<unsigned char*>(tag)) != 1)
+		{
+			return false;
+		}
+
+		// The tag is checked here, a failure is an attack or corruption and not an OpenSSL error worth printing.
+		if (EVP_DecryptFinal_ex(ctx, buffer + len, &len) != 1)
+		{
+			return false;
+		}
+
+		this->receiveCounter++;
+		return true;
+	}
+
+	unsigned int NetAEAD::SupportedCiphers() noexcept
+	{
+		return (1u << static_cast<unsigned int>(AeadCipher::AesGcm)) | (1u << static_cast<unsigned int>(AeadCipher::ChaCha20Poly1305));
+	}
+
+	AeadCipher NetAEAD::PreferredCipher(unsigned int cipherMask) noexcept
+	{
+		const unsigned int usable = cipherMask & SupportedCiphers();
+		const bool gcm = (usable & (1u << static_cast<unsigned int>(AeadCipher::AesGcm))) != 0;
+		const bool chaCha = (usable & (1u << static_cast<unsigned int>(AeadCipher::ChaCha20Poly1305))) != 0;
+
+		if (gcm && (HasHardwareAes() || !chaCha))
+		{
+			return AeadCipher::AesGcm;
+		}
+		return chaCha ? AeadCipher::ChaCha20Poly1305 : AeadCipher::None;
+	}
+}
@@ -1,11 +1,11 @@
 #include "Crypto/NetAES.h"
+#include "Crypto/SecureRandom.h"
 
 #include <openssl/conf.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
 
 #include <memory>
-#include <random>
 #include <functional>
 #include <algorithm>
 #include <iostream>
@@ -26,111 +26,157 @@ namespace net
 		this->key = key;
 	}
 
-	void NetAES::Encrypt(const unsigned char * data, const size_t dataSize, std::unique_ptr<unsigned char[]>& ivOut, std::unique_ptr<unsigned char[]>& encryptedData, size_t & encryptedDataSize, size_t& paddingSize)
+	NetAES::NetAES(const NetAES& other) : key(other.key)
+	{
+	}
+
+	NetAES::NetAES(NetAES&& other) noexcept = default;
+
+	NetAES& NetAES::operator=(const NetAES& other)
 	{
-		unsigned char* paddedData = new unsigned char[dataSize];
-		memcpy(paddedData, data, dataSize);
+		if (this != &other)
+		{
+			this->key = other.key;
+			this->encryptContext.reset();
+			this->decryptContext.reset();
+		}
+		return *this;
+	}
 
-		paddedData = AddPadding(paddedData, dataSize, paddingSize);
-		size_t paddedDataSize = dataSize + paddingSize;
+	NetAES& NetAES::operator=(NetAES&& other) noexcept = default;
 
-		EVP_CIPHER_CTX *ctx;
+	NetAES::~NetAES() = default;
 
-		int len;
-		int ciphertextLen;
+	void NetAES::ContextDeleter::operator()(EVP_CIPHER_CTX* ctx) const
+	{
+		EVP_CIPHER_CTX_free(ctx);
+	}
 
-		ctx = EVP_CIPHER_CTX_new();
-		if (!ctx)
+	EVP_CIPHER_CTX* NetAES::GetEncryptContext()
+	{
+		if (!this->encryptContext)
 		{
-			ERR_print_errors_fp(stderr);
+			this->encryptContext.reset(EVP_CIPHER_CTX_new());
+			if (!this->encryptContext)
+			{
+				ERR_print_errors_fp(stderr);
+				return nullptr;
+			}
+
+			if (EVP_EncryptInit_ex(this->encryptContext.get(), EVP_aes_256_cbc(), nullptr, this->key.key.get(), nullptr) != 1)
+			{
+				ERR_print_errors_fp(stderr);
+			}
+
+			EVP_CIPHER_CTX_set_padding(this->encryptContext.get(), 0);
 		}
+		return this->encryptContext.get();
+	}
 
-		ivOut = std::unique_ptr<unsigned char[]>{ GenerateIV(ivLength).release() };
-
-		if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, this->key.key.get(), ivOut.get()) != 1)
+	EVP_CIPHER_CTX* NetAES::GetDecryptContext()
+	{
+		if (!this->decryptContext)
 		{
-			ERR_print_errors_fp(stderr);
+			this->decryptContext.reset(EVP_CIPHER_CTX_new());
+			if (!this->decryptContext)
+			{
+				ERR_print_errors_fp(stderr);
+				return nullptr;
+			}
+
+			if (EVP_DecryptInit_ex(this->decryptContext.get(), EVP_aes_256_cbc(), nullptr, this->key.key.get(), nullptr) != 1)
+			{
+				ERR_print_errors_fp(stderr);
+			}
+
+			EVP_CIPHER_CTX_set_padding(this->decryptContext.get(), 0);
 		}
+		return this->decryptContext.get();
+	}
+
+	size_t NetAES::EncryptInPlace(unsigned char* buffer, const size_t dataSize, unsigned char* ivOut, size_t& paddingSize)
+	{
+		paddingSize = GetPaddingSize(dataSize);
+		SecureRandom::Fill(buffer + dataSize, paddingSize);
+		const size_t paddedDataSize = dataSize + paddingSize;
 
-		EVP_CIPHER_CTX_set_padding(ctx, 0);
+		SecureRandom::Fill(ivOut, ivLength >> 3);
 
-		unsigned char* cipherData = new unsigned char[paddedDataSize + 256];
+		EVP_CIPHER_CTX* ctx = GetEncryptContext();
 
-		if (EVP_EncryptUpdate(ctx, cipherData, &len, paddedData, static_cast<int>(paddedDataSize)) != 1)
+		// Only the IV changes, the expanded key stays in the context.
+		if (ctx == nullptr || EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, ivOut) != 1)
 		{
 			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		ciphertextLen = len;
-
-		if (EVP_EncryptFinal_ex(ctx, cipherData + len, &len) != 1)
+		int len = 0;
+		if (EVP_EncryptUpdate(ctx, buffer, &len, buffer, static_cast<int>(paddedDataSize)) != 1)
 		{
 			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		ciphertextLen += len;
-
-		unsigned char* trimmedCipherData = new unsigned char[ciphertextLen];
-
-		memcpy(trimmedCipherData, cipherData, ciphertextLen);
-
-		delete[] cipherData;
-
-		EVP_CIPHER_CTX_free(ctx);
-
-		encryptedData = std::unique_ptr<unsigned char[]>{ trimmedCipherData };
-		encryptedDataSize = ciphertextLen;
+		int finalLen = 0;
+		if (EVP_EncryptFinal_ex(ctx, buffer + len, &finalLen) != 1)
+		{
+			ERR_print_errors_fp(stderr);
+			return 0;
+		}
 
-		delete[] paddedData;
+		return static_cast<size_t>(len + finalLen);
 	}
 
-	void NetAES::Decrypt(const unsigned char * data, const size_t dataSize, unsigned char* ivIn, std::unique_ptr<unsigned char[]>& decryptedData, size_t & decryptedDataSize, size_t paddingSize)
+	size_t NetAES::DecryptInPlace(unsigned char* buffer, const size_t dataSize, const unsigned char* ivIn, size_t paddingSize)
 	{
-		EVP_CIPHER_CTX *ctx;
-
-		int len;
-		int decryptedLen;
-
-		ctx = EVP_CIPHER_CTX_new();
-		if (!ctx)
+		if (dataSize % blockSize != 0 || paddingSize > dataSize)
 		{
-			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, this->key.key.get(), ivIn) != 1)
+		EVP_CIPHER_CTX* ctx = GetDecryptContext();
+
+		if (ctx == nullptr || EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, ivIn) != 1)
 		{
 			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		EVP_CIPHER_CTX_set_padding(ctx, 0);
-
-		unsigned char* decrypted = new unsigned char[dataSize + 256];
-
-		if (EVP_DecryptUpdate(ctx, decrypted, &len, data, static_cast<int>(dataSize)) != 1)
+		int len = 0;
+		if (EVP_DecryptUpdate(ctx, buffer, &len, buffer, static_cast<int>(dataSize)) != 1)
 		{
 			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		decryptedLen = len;
-
-		if (EVP_DecryptFinal_ex(ctx, decrypted + len, &len) != 1)
+		int finalLen = 0;
+		if (EVP_DecryptFinal_ex(ctx, buffer + len, &finalLen) != 1)
 		{
 			ERR_print_errors_fp(stderr);
+			return 0;
 		}
 
-		decryptedLen += len;
+		const size_t decryptedSize = static_cast<size_t>(len + finalLen);
+		return decryptedSize < paddingSize ? 0 : decryptedSize - paddingSize;
+	}
 
-		unsigned char* trimmedDecryptedData = new unsigned char[decryptedLen];
+	void NetAES::Encrypt(const unsigned char * data, const size_t dataSize, std::unique_ptr<unsigned char[]>& ivOut, std::unique_ptr<unsigned char[]>& encryptedData, size_t & encryptedDataSize, size_t& paddingSize)
+	{
+		encryptedData = std::unique_ptr<unsigned char[]>{ new unsigned char[dataSize + blockSize] };
+		memcpy(encryptedData.get(), data, dataSize);
 
-		memcpy(trimmedDecryptedData, decrypted, decryptedLen);
+		ivOut = std::unique_ptr<unsigned char[]>{ new unsigned char[ivLength >> 3] };
 
-		delete[] decrypted;
+		encryptedDataSize = EncryptInPlace(encryptedData.get(), dataSize, ivOut.get(), paddingSize);
+	}
 
-		EVP_CIPHER_CTX_free(ctx);
+	void NetAES::Decrypt(const unsigned char * data, const size_t dataSize, unsigned char* ivIn, std::unique_ptr<unsigned char[]>& decryptedData, size_t & decryptedDataSize, size_t paddingSize)
+	{
+		decryptedData = std::unique_ptr<unsigned char[]>{ new unsigned char[dataSize] };
+		memcpy(decryptedData.get(), data, dataSize);
 
-		trimmedDecryptedData = RemovePadding(trimmedDecryptedData, decryptedLen, paddingSize);
-		decryptedData = std::unique_ptr<unsigned char[]>{ trimmedDecryptedData };
-		decryptedDataSize = decryptedLen - paddingSize;
+		decryptedDataSize = DecryptInPlace(decryptedData.get(), dataSize, ivIn, paddingSize);
 	}
 
 	NetAESKey NetAES::GenerateKey(const int keySize)
@@ -145,54 +191,10 @@ namespace net
 
 	std::unique_ptr<unsigned char[]> NetAES::GenerateBytes(const int size)
 	{
-		std::random_device r;
-		std::seed_seq seed{ r(), r(), r(), r(), r(), r(), r(), r() };
-		std::mt19937 gen(seed);
-		std::uniform_int_distribution<> dis(0, UCHAR_MAX);
-
-		auto rand = [&gen, &dis]() { return static_cast<unsigned char>(dis(gen)); };
-
-		std::unique_ptr<unsigned char[]> key = std::unique_ptr<unsigned char[]>{ new unsigned char[size] };
-
-		std::generate_n(key.get(), static_cast<size_t>(size), rand);
-
-		return key;
-	}
-
-	unsigned char* NetAES::AddPadding(unsigned char* data, const size_t dataSize, size_t& paddingSize)
-	{
-		int remaining = blockSize - (dataSize % blockSize);
-
-		if (remaining < blockSize)
-		{
-			unsigned char* newData = new unsigned char[dataSize + remaining];
-			memcpy(newData, data, dataSize);
-
-			auto remainderBytes = GenerateBytes(remaining);
-			memcpy(&newData[dataSize], remainderBytes.get(), remaining);
-
-			paddingSize = static_cast<size_t>(remaining);
-			delete[] data;
-			data = newData;
-		}
-		else
-		{
-			paddingSize = 0;
-		}
-
-		return data;
-	}
+		std::unique_ptr<unsigned char[]> bytes = std::unique_ptr<unsigned char[]>{ new unsigned char[size] };
 
-	unsigned char* NetAES::RemovePadding(unsigned char * data, const size_t dataSize, size_t paddingSize)
-	{
-		if (paddingSize > 0)
-		{
-			unsigned char* newData = new unsigned char[dataSize - paddingSize];
-			memcpy(newData, data, dataSize - paddingSize);
-			delete[] data;
-			data = newData;
-		}
+		SecureRandom::Fill(bytes.get(), static_cast<size_t>(size));
 
-		return data;
+		return bytes;
 	}
 }
@@ -150,6 +150,7 @@ namespace net
 		if (len == -1)
 		{
 			ERR_print_errors_fp(stderr);
+			len = 0;
 		}
 
 		unsigned char* trimmedData = new unsigned char[len];
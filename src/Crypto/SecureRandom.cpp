@@ -0,0 +1,146 @@
+#include "Crypto/SecureRandom.h"
+
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace net
+{
+	namespace
+	{
+		constexpr std::size_t keySize = 32;
+		constexpr std::size_t ivSize = 16;
+
+#ifndef _WIN32
+		/**
+		 * \brief Bumped in every forked child, so generators can tell they were copied from the parent without a system call per Fill(..).
+		 */
+		std::atomic<unsigned int> forkGeneration{ 0 };
+
+		void OnFork()
+		{
+			forkGeneration.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		unsigned int CurrentForkGeneration()
+		{
+			static const bool registered = pthread_atfork(nullptr, nullptr, &OnFork) == 0;
+			(void)registered;
+			return forkGeneration.load(std::memory_order_relaxed);
+		}
+#endif
+
+		class Generator
+		{
+		public:
+			~Generator()
+			{
+				EVP_CIPHER_CTX_free(this->ctx);
+				OPENSSL_cleanse(this->buffer, sizeof(this->buffer));
+			}
+
+			void Fill(unsigned char* out, std::size_t size)
+			{
+#ifndef _WIN32
+				// A forked child would otherwise hand out the same bytes as its parent.
+				const unsigned int generation = CurrentForkGeneration();
+				if (this->generation != generation)
+				{
+					this->available = 0;
+					this->sinceReseed = SecureRandom::reseedInterval;
+					this->generation = generation;
+				}
+#endif
+				while (size > 0)
+				{
+					if (this->available == 0)
+					{
+						Refill();
+					}
+
+					const std::size_t count = std::min(size, this->available);
+					unsigned char* source = this->buffer + SecureRandom::bufferSize - this->available;
+					memcpy(out, source, count);
+					OPENSSL_cleanse(source, count);
+
+					this->available -= count;
+					out += count;
+					size -= count;
+				}
+			}
+
+		private:
+			void Rekey(const unsigned char* key, const unsigned char* iv)
+			{
+				if (this->ctx == nullptr)
+				{
+					this->ctx = EVP_CIPHER_CTX_new();
+				}
+
+				if (this->ctx == nullptr || EVP_EncryptInit_ex(this->ctx, EVP_aes_256_ctr(), nullptr, key, iv) != 1)
+				{
+					ERR_print_errors_fp(stderr);
+					fprintf(stderr, "SecureRandom: couldn't initialize the generator.\n");
+					std::abort();
+				}
+			}
+
+			void Refill()
+			{
+				if (this->sinceReseed >= SecureRandom::reseedInterval)
+				{
+					unsigned char seed[keySize + ivSize];
+					if (RAND_bytes(seed, sizeof(seed)) != 1)
+					{
+						ERR_print_errors_fp(stderr);
+						fprintf(stderr, "SecureRandom: the OpenSSL RNG couldn't provide a seed.\n");
+						std::abort();
+					}
+					Rekey(seed, seed + keySize);
+					OPENSSL_cleanse(seed, sizeof(seed));
+					this->sinceReseed = 0;
+				}
+
+				// Encrypting zeros in counter mode gives the keystream.
+				memset(this->buffer, 0, SecureRandom::bufferSize);
+				int len;
+				if (EVP_EncryptUpdate(this->ctx, this->buffer, &len, this->buffer, static_cast<int>(SecureRandom::bufferSize)) != 1)
+				{
+					ERR_print_errors_fp(stderr);
+					std::abort();
+				}
+
+				// The first bytes become the next key, so the bytes handed out can't be recomputed from the state later.
+				Rekey(this->buffer, this->buffer + keySize);
+				OPENSSL_cleanse(this->buffer, keySize + ivSize);
+
+				this->available = SecureRandom::bufferSize - keySize - ivSize;
+				this->sinceReseed += SecureRandom::bufferSize;
+			}
+
+			EVP_CIPHER_CTX* ctx{ nullptr };
+			unsigned char buffer[SecureRandom::bufferSize];
+			std::size_t available{ 0 };
+			std::size_t sinceReseed{ SecureRandom::reseedInterval };
+#ifndef _WIN32
+			unsigned int generation{ CurrentForkGeneration() };
+#endif
+		};
+	}
+
+	void SecureRandom::Fill(unsigned char* out, std::size_t size)
+	{
+		thread_local Generator generator;
+		generator.Fill(out, size);
+	}
+}
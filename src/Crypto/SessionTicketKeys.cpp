@@ -0,0 +1,175 @@
+#include "Crypto/SessionTicketKeys.h"
+#include "Crypto/SecureRandom.h"
+
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+
+#include <cstring>
+
+namespace net
+{
+	namespace
+	{
+		bool RunGcm(bool encrypt, const unsigned char* key, const unsigned char* nonce, const unsigned char* additionalData, size_t additionalDataSize,
+			unsigned char* buffer, size_t size, unsigned char* tag)
+		{
+			EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+			int len;
+			bool success = ctx != nullptr &&
+				EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key, nonce, encrypt ? 1 : 0) == 1 &&
+				EVP_CipherUpdate(ctx, nullptr, &len, additionalData, static_cast<int>(additionalDataSize)) == 1 &&
+				(size == 0 || EVP_CipherUpdate(ctx, buffer, &len, buffer, static_cast<int>(size)) == 1);
+
+			if (success && !encrypt)
+			{
+				success = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(SessionTicketKeys::tagSize), tag) == 1;
+			}
+			success = success && EVP_CipherFinal_ex(ctx, buffer + size, &len) == 1;
+			if (success && encrypt)
+			{
+				success = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(SessionTicketKeys::tagSize), tag) == 1;
+			}
+
+			EVP_CIPHER_CTX_free(ctx);
+			return success;
+		}
+	}
+
+	SessionTicketKeys::SessionTicketKeys(std::chrono::seconds lifetime) : lifetime(std::chrono::duration_cast<std::chrono::microseconds>(lifetime).count())
+	{
+		Rotate(Now());
+	}
+
+	SessionTicketKeys::~SessionTicketKeys()
+	{
+		OPENSSL_cleanse(&current, sizeof(current));
+		OPENSSL_cleanse(&previous, sizeof(previous));
+	}
+
+	std::vector<unsigned char> SessionTicketKeys::Seal(const unsigned char* data, std::size_t size)
+	{
+		const long long now = Now();
+		const long long expiresAt = now + lifetime;
+
+		// [key id][nonce][expiry][data][tag], the key id and nonce are authenticated as additional data.
+		std::vector<unsigned char> ticket(overhead + size);
+		unsigned char* nonce = &ticket[1];
+		unsigned char* encrypted = nonce + nonceSize;
+		for (size_t i = 0; i < sizeof(long long); i++)
+		{
+			encrypted[i] = static_cast<unsigned char>(static_cast<unsigned long long>(expiresAt) >> (8 * (sizeof(long long) - 1 - i)));
+		}
+		if (size > 0)
+		{
+			memcpy(encrypted + sizeof(long long), data, size);
+		}
+		SecureRandom::Fill(nonce, nonceSize);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (now - current.createdAt >= lifetime)
+		{
+			Rotate(now);
+		}
+		ticket[0] = current.id;
+
+		const size_t encryptedSize = sizeof(long long) + size;
+		if (!RunGcm(true, current.bytes, nonce, &ticket[0], 1 + nonceSize, encrypted, encryptedSize, encrypted + encryptedSize))
+		{
+			ticket.clear();
+		}
+		return ticket;
+	}
+
+	bool SessionTicketKeys::Open(const unsigned char* ticket, std::size_t size, std::vector<unsigned char>& data, long long& expiresAt)
+	{
+		if (size < overhead)
+		{
+			return false;
+		}
+
+		const unsigned char* nonce = ticket + 1;
+		const size_t encryptedSize = size - 1 - nonceSize - tagSize;
+		std::vector<unsigned char> decrypted(nonce + nonceSize, nonce + nonceSize + encryptedSize);
+		unsigned char tag[tagSize];
+		memcpy(tag, ticket + size - tagSize, tagSize);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const Key* key = FindKey(ticket[0]);
+			if (key == nullptr || !RunGcm(false, key->bytes, nonce, ticket, 1 + nonceSize, decrypted.data(), encryptedSize, tag))
+			{
+				return false;
+			}
+		}
+
+		unsigned long long expiry = 0;
+		for (size_t i = 0; i < sizeof(long long); i++)
+		{
+			expiry = (expiry << 8) | decrypted[i];
+		}
+		expiresAt = static_cast<long long>(expiry);
+		if (Now() >= expiresAt)
+		{
+			return false;
+		}
+
+		data.assign(decrypted.begin() + sizeof(long long), decrypted.end());
+		OPENSSL_cleanse(decrypted.data(), decrypted.size());
+		return true;
+	}
+
+	bool SessionTicketKeys::Redeem(const unsigned char* ticket, std::size_t size, long long expiresAt)
+	{
+		if (size < overhead)
+		{
+			return false;
+		}
+
+		const long long now = Now();
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (now >= nextPurge)
+		{
+			for (auto it = redeemed.begin(); it != redeemed.end();)
+			{
+				it = it->second <= now ? redeemed.erase(it) : std::next(it);
+			}
+			nextPurge = now + lifetime / 4;
+		}
+
+		// The nonce is random per ticket, so it identifies the ticket.
+		return redeemed.emplace(std::string(reinterpret_cast<const char*>(ticket + 1), nonceSize), expiresAt).second;
+	}
+
+	long long SessionTicketKeys::Now() noexcept
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void SessionTicketKeys::Rotate(long long now)
+	{
+		const unsigned char nextId = static_cast<unsigned char>(current.id + 1);
+		if (current.createdAt != 0)
+		{
+			previous = current;
+			hasPrevious = true;
+		}
+
+		SecureRandom::Fill(current.bytes, keySize);
+		current.id = nextId;
+		current.createdAt = now;
+	}
+
+	const SessionTicketKeys::Key* SessionTicketKeys::FindKey(unsigned char id) const noexcept
+	{
+		if (id == current.id)
+		{
+			return &current;
+		}
+		if (hasPrevious && id == previous.id)
+		{
+			return &previous;
+		}
+		return nullptr;
+	}
+}
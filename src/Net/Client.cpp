@@ -1,408 +1,906 @@
 #include "Net/Client.h"
+#include "Net/CryptoFrame.h"
 #include "Net/NetCommands.h"
 #include "Net/Packet.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <numeric>
 #include "Crypto/NetAES.h"
+#include "Crypto/SecureRandom.h"
+#include "Crypto/SessionTicketKeys.h"
 
-net::Client::Client() : client(nullptr), serverPeer(nullptr), keyChain(net::EmptyKeyChain())
+net::Client::Client(std::size_t maxSessions) : client(nullptr), maxSessions(std::max<std::size_t>(maxSessions, 1))
 {
-	queueThread = std::thread(&Client::ReceivePackets, this);
-	
+	sessions.push_back(std::make_unique<ClientSession>(*this, "primary", this, 0));
+
 	if (enet_initialize() != 0)
 	{
 		fprintf(stderr, "An error occurred while initializing ENet.\n");
 	}
-	std::lock_guard<std::mutex> lock(clientMutex);
 
-	client = enet_host_create(nullptr, 1, 2, 0, 0);
+	client = enet_host_create(nullptr, this->maxSessions, 2, 0, 0);
 	if (client == nullptr)
 	{
 		fprintf(stderr, "An error occurred while trying to create an ENet client host.\n");
+		return;
 	}
+
+	networkThread = std::thread(&Client::NetworkLoop, this);
 }
 
 net::Client::~Client()
 {
-	Disconnect();
+	for (auto& session : sessions)
+	{
+		session->Disconnect();
+	}
 
 	alive = false;
 
-	queueThread.join();
-
-	if (serverPeer != nullptr)
+	if (networkThread.joinable())
 	{
-		enet_peer_reset(serverPeer);
+		networkThread.join();
 	}
 
-	enet_deinitialize();
+	for (ClientSession* session : networkSessions)
+	{
+		session->pendingRequests.FailAll(RequestStatus::Disconnected);
+		if (session->peer != nullptr)
+		{
+			enet_peer_reset(session->peer);
+			session->peer = nullptr;
+		}
+	}
 
-	std::lock_guard<std::mutex> lock(clientMutex);
+	if (client != nullptr)
+	{
+		enet_host_destroy(client);
+		client = nullptr;
+	}
 
-	client = nullptr;
+	enet_deinitialize();
 }
 
-void net::Client::Connect(const char * ip, unsigned short port, unsigned connectionId)
+net::ClientSession* net::Client::OpenSession(const std::string& name, SessionHandler* handler)
 {
-	std::lock_guard<std::mutex> lock(clientMutex);
+	if (handler == nullptr || GetSession(name) != nullptr)
+	{
+		return nullptr;
+	}
 
-	if (client == nullptr)
+	if (sessions.size() >= maxSessions)
 	{
-		return;
+		fprintf(stderr, "Can't open session %s, the client allows %zu sessions.\n", name.c_str(), maxSessions);
+		return nullptr;
 	}
 
-	ENetAddress address;
+	sessions.push_back(std::make_unique<ClientSession>(*this, name, handler, static_cast<unsigned int>(sessions.size())));
+	return sessions.back().get();
+}
 
-	enet_address_set_host(&address, ip);
-	address.port = port;
-	serverPeer = enet_host_connect(client, &address, 2, connectionId);
-	if (serverPeer == nullptr)
+net::ClientSession* net::Client::GetSession(const std::string& name) const
+{
+	for (auto& session : sessions)
 	{
-		fprintf(stderr, "No available peers for initiating an ENet connection.\n");
-		exit(EXIT_FAILURE);
+		if (session->GetName() == name)
+		{
+			return session.get();
+		}
 	}
+	return nullptr;
+}
+
+void net::Client::Connect(const char * ip, unsigned short port, unsigned connectionId)
+{
+	GetPrimarySession().Connect(ip, port, connectionId);
 }
 
 void net::Client::Disconnect() const
 {
-	if (IsConnected()) {
-		enet_peer_disconnect(serverPeer, 0);
-	}
+	GetPrimarySession().Disconnect();
 }
 
 void net::Client::SendPacket(NetCommands command) const
 {
-	Packet emptyPacket{};
-	this->SendPacket(command, emptyPacket);
+	GetPrimarySession().SendPacket(command);
 }
 
 void net::Client::SendPacket(NetCommands command, Packet& packet, bool encrypted) const
 {
-	if (client != nullptr) {
-		if (serverPeer != nullptr)
-		{
-			if (debug && command != NetCommands::CustomCommand)
-			{
-				printf("%s sending %s\n", netPrefix.c_str(), GetName(command).c_str());
-			}
-
-			Packet commandPacket = Packet{};
-			commandPacket << static_cast<unsigned int>(command);
-
-			commandPacket.Append(packet.GetData(), packet.GetDataSize());
-
-			size_t size = commandPacket.GetDataSize();
-			void* data = new unsigned char[size];
-			memcpy(data, commandPacket.GetData(), size);
-#ifndef DISABLE_ENCRYPTION
-			if (encrypted) {
-				size_t encryptedSize;
-				std::unique_ptr<unsigned char[]> encryptedData;
-				std::unique_ptr<unsigned char[]> iv;
-
-				auto key = keyChain.dataKey;
-				size_t paddingSize;
-				key.Encrypt(static_cast<const unsigned char*>(data), size, iv, encryptedData, encryptedSize, paddingSize);
-
-				Packet cryptoPacket;
-				cryptoPacket << static_cast<unsigned int>(NetCommands::CryptoPacket);
-				cryptoPacket << static_cast<unsigned int>(paddingSize);
-				cryptoPacket.Append(iv.get(), net::NetAES::ivLength >> 3);
-				cryptoPacket << static_cast<unsigned int>(encryptedSize);
-				cryptoPacket.Append(encryptedData.get(), encryptedSize);
-
-				delete[] static_cast<unsigned char*>(data);
-
-				size = cryptoPacket.GetDataSize();
-				data = new unsigned char[size];
-				memcpy(data, cryptoPacket.GetData(), size);
-			}
-#endif
-			ENetPacket * ePacket = enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+	GetPrimarySession().SendPacket(command, packet, encrypted);
+}
 
-			enet_peer_send(serverPeer, 0, ePacket);
+void net::Client::RegisterCommand(unsigned int customCommand, CommandOptions options)
+{
+	commandOptions[customCommand] = options;
+}
 
-			delete[] static_cast<unsigned char*>(data);
-		}
+net::CommandOptions net::Client::GetCommandOptions(unsigned int customCommand) const
+{
+	auto it = commandOptions.find(customCommand);
+	if (it == commandOptions.end())
+	{
+		return CommandOptions{};
 	}
+	return it->second;
 }
 
 void net::Client::SendCustomPacket(unsigned command) const
 {
-	Packet emptyPacket{};
-	this->SendCustomPacket(command, emptyPacket);
+	GetPrimarySession().SendCustomPacket(command);
 }
 
 void net::Client::SendCustomPacket(unsigned command, Packet& packet) const
 {
-	if (IsConnected()) {
-		if (debug)
+	GetPrimarySession().SendCustomPacket(command, packet);
+}
+
+net::RequestFuture net::Client::SendRequest(unsigned int command, Packet& packet, std::chrono::milliseconds timeout) const
+{
+	return GetPrimarySession().SendRequest(command, packet, timeout);
+}
+
+void net::Client::CancelRequest(unsigned int requestId) const
+{
+	GetPrimarySession().CancelRequest(requestId);
+}
+
+void net::Client::SendResponse(unsigned int requestId, Packet& packet, RequestStatus status) const
+{
+	GetPrimarySession().SendResponse(requestId, packet, status);
+}
+
+void net::Client::ReceivePackets()
+{
+}
+
+void net::Client::HandleEvents()
+{
+	if(client == nullptr)
+	{
+		return;
+	}
+
+	// Requests that didn't fit in the ring last frame go first, so the order is kept.
+	while (!pendingRequests.empty() && outgoingRequests.TryPush(std::move(pendingRequests.front())))
+	{
+		pendingRequests.pop_front();
+	}
+
+	while(NetEvent* netEvent = incomingEvents.Front())
+	{
+		ClientSession& session = *netEvent->session;
+
+		switch(netEvent->type)
 		{
-			printf("%s sending custom %u\n", netPrefix.c_str(), command);
+			case ENET_EVENT_TYPE_NONE:
+				break;
+			case ENET_EVENT_TYPE_CONNECT:
+			{
+				session.isConnected = true;
+				session.handler->OnConnect();
+			}
+			break;
+			case ENET_EVENT_TYPE_RECEIVE:
+			{
+				this->traceId = netEvent->traceId;
+				this->HandleAnyPacket(session, netEvent->packet);
+				this->traceId = 0;
+			}
+			break;
+			case ENET_EVENT_TYPE_DISCONNECT:
+			{
+				session.isConnected = false;
+				session.handler->OnDisconnect();
+			}
+			break;
 		}
 
-		Packet commandPacket = Packet{};
-		commandPacket << static_cast<unsigned int>(command);
-		commandPacket.Append(packet.GetData(), packet.GetDataSize());
+		incomingEvents.Pop();
+	}
+}
 
-		SendPacket(NetCommands::CustomCommand, commandPacket);
+void net::Client::PushRequest(NetRequest&& request) const
+{
+	if (!pendingRequests.empty() || !outgoingRequests.TryPush(std::move(request)))
+	{
+		pendingRequests.push_back(std::move(request));
 	}
 }
 
-void net::Client::ReceivePackets()
+void net::Client::PushEvent(NetEvent&& event)
 {
-	if (client == nullptr)
+	if (!pendingEvents.empty() || !incomingEvents.TryPush(std::move(event)))
 	{
-		return;
+		pendingEvents.push_back(std::move(event));
 	}
+}
 
+void net::Client::NetworkLoop()
+{
+	while (alive)
+	{
+		ProcessRequests();
+
+		long long now = ClockSync::LocalTimeNow();
+		for (ClientSession* session : networkSessions)
+		{
+			// Once synchronized, a sample waits for frames of the game to share a datagram with, until the session was idle for too long.
+			const bool due = session->established && now >= session->nextTimeSync;
+			if (due && (session->sentFrames || !session->clockSync.IsSynchronized() || now >= session->nextTimeSync + timeSyncIdleDelay))
+			{
+				SendTimeSync(*session);
+			}
+		}
+
+		ServiceHost(serviceTimeout);
+
+		now = ClockSync::LocalTimeNow();
+		for (ClientSession* session : networkSessions)
+		{
+			// Frames queued while servicing the host were sent by the next enet_host_service(..) already.
+			session->sentFrames = false;
+			session->pendingRequests.Expire(now);
+		}
+
+		while (!pendingEvents.empty() && incomingEvents.TryPush(std::move(pendingEvents.front())))
+		{
+			pendingEvents.pop_front();
+		}
+	}
+
+	// Send what was requested before the client got destroyed, like the disconnect.
+	// The game thread pushed its last request before it cleared alive, so the overflow is handed over too, after the older requests in the ring.
+	ProcessRequests();
+	for (NetRequest& request : pendingRequests)
+	{
+		ProcessRequest(request);
+	}
+	pendingRequests.clear();
+	enet_host_flush(client);
+}
+
+void net::Client::ServiceHost(enet_uint32 timeout)
+{
 	ENetEvent event;
-	while (enet_host_service(client, &event, 0) > 0)
+	while (enet_host_service(client, &event, timeout) > 0)
 	{
+		timeout = 0;
+
+		auto* session = static_cast<ClientSession*>(event.peer->data);
+		if (session == nullptr)
+		{
+			if (event.type == ENET_EVENT_TYPE_RECEIVE)
+			{
+				enet_packet_destroy(event.packet);
+			}
+			continue;
+		}
+
 		switch (event.type)
 		{
 		case ENET_EVENT_TYPE_NONE:
 			break;
 		case ENET_EVENT_TYPE_CONNECT: {
-			printf("Successfully connected to: %s:%u.\n", NetUtils::EnetHostToIpString(event.peer->address.host).c_str(), event.peer->address.port);
+			printf("Successfully connected %s to: %s:%u.\n", session->GetName().c_str(), NetUtils::EnetHostToIpString(event.peer->address.host).c_str(), event.peer->address.port);
+
+			session->peerConnected = true;
+			session->established = false;
+			session->clockSync.Reset();
+			session->lastResponseSend = 0;
+			session->lastResponseReceive = 0;
+			if (session->resuming)
+			{
+				SendResumption(*session);
+			}
 
-			netEventQueue.push({ event.type, Packet {} });
+			PushEvent({ event.type, Packet {}, 0, session });
 		}	break;
 		case ENET_EVENT_TYPE_RECEIVE: {
-			Packet packet;
+			const long long receiveTime = ClockSync::LocalTimeNow();
+			const unsigned int messageId = PacketTracer::NextMessageId();
 
-			packet.OnReceive(event.packet->data, event.packet->dataLength);
+			Packet packet;
+			{
+				TraceScope receiveScope(TraceStage::Receive, session->GetSessionId(), messageId);
+				packet.OnReceive(event.packet->data, event.packet->dataLength);
+				enet_packet_destroy(event.packet);
+			}
 
-			netEventQueue.push({ event.type, packet });
+			unsigned int commandInt{};
+			{
+				const std::size_t readPos = packet.m_readPos;
+				const bool isValid = packet.m_isValid;
+				packet >> commandInt;
+				packet.m_readPos = readPos;
+				packet.m_isValid = isValid;
+			}
 
-			enet_packet_destroy(event.packet);
+			if (static_cast<NetCommands>(commandInt) == NetCommands::HandshakeServerKey)
+			{
+				packet >> commandInt;
+				HandleServerKey(*session, packet);
+				break;
+			}
+			if (static_cast<NetCommands>(commandInt) == NetCommands::HandshakeKeyShare)
+			{
+				packet >> commandInt;
+				HandleKeyShare(*session, packet);
+				break;
+			}
+			SecurityLevel level = SecurityLevel::Plain;
+			if (static_cast<NetCommands>(commandInt) == NetCommands::CryptoPacket || static_cast<NetCommands>(commandInt) == NetCommands::AeadPacket || static_cast<NetCommands>(commandInt) == NetCommands::AuthenticatedPacket)
+			{
+				if (!DecryptPacket(*session, packet, static_cast<NetCommands>(commandInt), messageId, level))
+				{
+					break;
+				}
+				// The server accepted the ticket, it can no longer fall back to a key share.
+				session->resuming = false;
+
+				const std::size_t readPos = packet.m_readPos;
+				const bool isValid = packet.m_isValid;
+				packet >> commandInt;
+				packet.m_readPos = readPos;
+				packet.m_isValid = isValid;
+			}
+			if (session->keyChain.channelKey.IsActive() && level < GetRequiredSecurity(packet))
+			{
+				// Anything protected less than its command requires could have been injected or changed by anyone on the path.
+				break;
+			}
+			if (static_cast<NetCommands>(commandInt) == NetCommands::TimeSyncResponse)
+			{
+				HandleTimeSyncResponse(*session, packet, receiveTime);
+				break;
+			}
+			if (static_cast<NetCommands>(commandInt) == NetCommands::IdentifySuccessful)
+			{
+				// The server only answers NetCommands::TimeSync of identified connections.
+				session->established = true;
+				session->nextTimeSync = 0;
+			}
+			if (static_cast<NetCommands>(commandInt) == NetCommands::CustomResponse)
+			{
+				packet >> commandInt;
+				HandleCustomResponse(*session, packet);
+				break;
+			}
+			if (static_cast<NetCommands>(commandInt) == NetCommands::SessionTicket)
+			{
+				packet >> commandInt;
+				HandleSessionTicket(*session, packet);
+				break;
+			}
 
+			TraceScope enqueueScope(TraceStage::Enqueue, session->GetSessionId(), messageId);
+			PushEvent({ event.type, std::move(packet), messageId, session });
 		}	break;
 		case ENET_EVENT_TYPE_DISCONNECT: {
-			printf("Successfully disconnected.\n");
-			netEventQueue.push({ event.type, Packet {} });
+			printf("Successfully disconnected %s.\n", session->GetName().c_str());
+			event.peer->data = nullptr;
+			session->peer = nullptr;
+			session->peerConnected = false;
+			session->established = false;
+			session->pendingRequests.FailAll(RequestStatus::Disconnected);
+			PushEvent({ event.type, Packet {}, 0, session });
 		} break;
 		}
 	}
 }
 
-void net::Client::HandleEvents()
+void net::Client::ProcessRequests()
 {
-	//BROFILER_CATEGORY("(Network) Client::Update", Profiler::Color::Blue)
-	if(client == nullptr)
+	while (NetRequest* request = outgoingRequests.Front())
 	{
-		return;
+		ProcessRequest(*request);
+		outgoingRequests.Pop();
 	}
+}
 
-	std::lock_guard<std::mutex> lock(queueMutex);
+void net::Client::ProcessRequest(NetRequest& request)
+{
+	ClientSession& session = *request.session;
 
-	while(!netEventQueue.empty())
+	switch (request.type)
+	{
+	case NetRequest::Type::Connect:
 	{
-		NetEvent netEvent = netEventQueue.front();
+		if (std::find(networkSessions.begin(), networkSessions.end(), &session) == networkSessions.end())
+		{
+			networkSessions.push_back(&session);
+		}
 
-		switch(netEvent.type)
+		ENetAddress address;
+
+		enet_address_set_host(&address, request.host.c_str());
+		address.port = request.port;
+		unsigned int connectData = request.connectionId;
+		session.resuming = false;
+#ifndef DISABLE_ENCRYPTION
+		// Older servers don't know the flag, they assign a new connection id and start the RSA handshake.
+		connectData |= CONNECT_FLAG_KEY_EXCHANGE;
+		session.identity = request.packet;
+
+		const ClientSession::Ticket& ticket = session.resumption;
+		if (!ticket.ticket.empty() && ticket.expiresAt > ClockSync::LocalTimeNow() &&
+			ticket.address.host == address.host && ticket.address.port == address.port &&
+			(request.connectionId == CONNECTION_ID_INVALID || request.connectionId == ticket.connectionId))
 		{
-			case ENET_EVENT_TYPE_NONE:
-				break;
-			case ENET_EVENT_TYPE_CONNECT:
-			{
-				isConnected = true;
-				this->OnConnect();
-			}
-			break;
-			case ENET_EVENT_TYPE_RECEIVE:
-			{
-				this->HandleAnyPacket(netEvent.packet);
-			}
-			break;
-			case ENET_EVENT_TYPE_DISCONNECT:
-			{
-				isConnected = false;
-				this->OnDisconnect();
-			}
+			connectData = ticket.connectionId | CONNECT_FLAG_KEY_EXCHANGE | CONNECT_FLAG_RESUME;
+			session.resuming = true;
+		}
+#endif
+		session.peer = enet_host_connect(client, &address, 2, connectData);
+		if (session.peer == nullptr)
+		{
+			fprintf(stderr, "No available peers for initiating an ENet connection.\n");
+			PushEvent({ ENET_EVENT_TYPE_DISCONNECT, Packet {}, 0, &session });
 			break;
 		}
+		session.peer->data = &session;
+		session.keyChain = net::EmptyKeyChain();
+	}
+	break;
 
-		netEventQueue.pop();
+	case NetRequest::Type::Disconnect:
+	{
+		if (session.peer != nullptr)
+		{
+			enet_peer_disconnect(session.peer, 0);
+		}
 	}
-}
+	break;
 
-void net::Client::HandleAnyPacket(Packet& packet)
-{
-	unsigned int commandInt;
-	packet >> commandInt;
-	const auto command = NetCommands(commandInt);
+	case NetRequest::Type::Send:
+	{
+		SendFrame(session, request);
+	}
+	break;
 
-	if (command == NetCommands::CustomCommand)
+	case NetRequest::Type::Request:
 	{
-		unsigned int customCommand;
-		packet >> customCommand;
-		if (debug)
+		if (!session.peerConnected)
 		{
-			printf("%s handling custom %u\n", netPrefix.c_str(), customCommand);
+			request.promise.set_value(RequestResult{ RequestStatus::Disconnected, Packet{} });
+			break;
 		}
-		HandleCustomPacket(customCommand, packet);
+
+		PendingRequests::Entry entry;
+		entry.requestId = request.requestId;
+		entry.deadline = request.deadline;
+		entry.promise = std::move(request.promise);
+		session.pendingRequests.Insert(std::move(entry));
+
+		SendFrame(session, request);
 	}
-	else
+	break;
+
+	case NetRequest::Type::Cancel:
 	{
-		if (debug)
+		session.pendingRequests.Cancel(request.requestId);
+	}
+	break;
+
+	case NetRequest::Type::Ping:
+	{
+		if (session.peer != nullptr)
 		{
-			printf("%s handling NetCommands %s (%u)\n", netPrefix.c_str(), GetName(command).c_str(), command);
+			enet_peer_ping(session.peer);
+			if (session.established)
+			{
+				SendTimeSync(session);
+			}
+
+			TraceScope flushScope(TraceStage::Flush, session.GetSessionId(), 0);
+			enet_host_flush(client);
 		}
-		HandlePacket(command, packet);
+	}
+	break;
 	}
 }
 
-bool net::Client::IsConnected() const
+void net::Client::SendFrame(ClientSession& session, NetRequest& request)
 {
-	return isConnected;
+	if (session.peer == nullptr)
+	{
+		return;
+	}
+
+	session.sentFrames = true;
+
+	Packet* frame = &request.packet;
+#ifndef DISABLE_ENCRYPTION
+	Packet cryptoPacket;
+	if (request.security != SecurityLevel::Plain) {
+		TraceScope encryptScope(TraceStage::Encrypt, session.GetSessionId(), request.traceId);
+		if (session.keyChain.channelKey.IsActive())
+		{
+			const bool sealed = request.security == SecurityLevel::Authenticated ?
+				CryptoFrame::Authenticate(session.keyChain.channelKey, request.packet.GetData(), request.packet.GetDataSize(), cryptoPacket) :
+				CryptoFrame::Seal(session.keyChain.channelKey, request.packet.GetData(), request.packet.GetDataSize(), cryptoPacket);
+			if (!sealed)
+			{
+				return;
+			}
+		}
+		// NetAES can't only authenticate, so authenticated commands are encrypted as well.
+		else if (!CryptoFrame::Seal(session.keyChain.dataKey, request.packet.GetData(), request.packet.GetDataSize(), cryptoPacket))
+		{
+			return;
+		}
+		frame = &cryptoPacket;
+	}
+#endif
+	ENetPacket * ePacket = enet_packet_create(frame->GetData(), frame->GetDataSize(), ENET_PACKET_FLAG_RELIABLE);
+
+	enet_peer_send(session.peer, 0, ePacket);
 }
 
-void net::Client::AdditionalPing()
+void net::Client::HandleServerKey(ClientSession& session, Packet& packet)
 {
-	if(serverPeer)
-	{
-		enet_peer_ping(serverPeer);
-		enet_host_flush(client);
+	unsigned int modByteSize;
+	packet >> modByteSize;
+
+	auto* modulus = new unsigned char[modByteSize];
+
+	for (unsigned int i = 0; i < modByteSize; i++) {
+		unsigned char byte;
+		packet >> byte;
+		modulus[i] = byte;
 	}
+
+	unsigned int expByteSize;
+	packet >> expByteSize;
+
+	auto* exponent = new unsigned char[expByteSize];
+
+	for (unsigned int i = 0; i < expByteSize; i++) {
+		unsigned char byte;
+		packet >> byte;
+		exponent[i] = byte;
+	}
+
+	net::NetRSAKey serverPublic{
+		expByteSize << 3,
+		modByteSize << 3,
+		0,
+		std::shared_ptr<unsigned char>{ modulus, [](unsigned char *p) { delete[] p; } },
+		std::shared_ptr<unsigned char>{ exponent, [](unsigned char *p) { delete[] p; } },
+		std::shared_ptr<unsigned char>{},
+		std::shared_ptr<unsigned char>{},
+		std::shared_ptr<unsigned char>{}
+	};
+
+	// Older servers don't send the ciphers they support, the data channel then stays NetAES.
+	unsigned int serverCiphers = 0;
+	packet >> serverCiphers;
+	const AeadCipher cipher = packet ? NetAEAD::PreferredCipher(serverCiphers) : AeadCipher::None;
+
+	net::KeyChain& keyChain = session.keyChain;
+	keyChain.handshakeKey = net::NetRSA{ {}, serverPublic };
+	keyChain.dataKey = net::NetAES();
+
+	Packet plainResponse;
+	plainResponse << static_cast<unsigned int>(keyChain.dataKey.GetKey().bitSize >> 3);
+	plainResponse.Append(keyChain.dataKey.GetKey().key.get(), keyChain.dataKey.GetKey().bitSize >> 3);
+	plainResponse << static_cast<unsigned char>(cipher);
+
+	std::unique_ptr<unsigned char[]> encryptedData;
+	size_t encryptedDataSize;
+
+	keyChain.handshakeKey.Encrypt(static_cast<const unsigned char*>(plainResponse.GetData()), plainResponse.GetDataSize(), encryptedData, encryptedDataSize);
+
+	NetRequest response;
+	response.type = NetRequest::Type::Send;
+	response.session = &session;
+	response.packet << static_cast<unsigned int>(NetCommands::HandshakeDataKey);
+	response.packet << static_cast<unsigned int>(encryptedDataSize);
+	response.packet.Append(encryptedData.get(), encryptedDataSize);
+
+	SendFrame(session, response);
+
+	// The server switches when it receives the key, so everything after the key is sent with the cipher.
+	keyChain.channelKey = cipher != AeadCipher::None ? net::NetAEAD{ cipher, keyChain.dataKey.GetKey(), false } : net::NetAEAD{};
 }
 
-void net::Client::HandlePacket(NetCommands command, Packet& packet)
+void net::Client::HandleKeyShare(ClientSession& session, Packet& packet)
 {
-	switch(command)
-	{
-	case NetCommands::HandshakeServerKey:
+	// While resuming the channel key is already set, but the server can still reject the ticket.
+	if ((session.keyChain.channelKey.IsActive() && !session.resuming) || !packet.CheckSize(KeyExchange::keySize))
 	{
-		unsigned int modByteSize;
-		packet >> modByteSize;
+		return;
+	}
+	session.resuming = false;
 
-		auto* modulus = new unsigned char[modByteSize];
+	const unsigned char* serverPublic = static_cast<const unsigned char*>(packet.GetData(packet.m_readPos));
+	packet.m_readPos += KeyExchange::keySize;
 
-		for (unsigned int i = 0; i < modByteSize; i++) {
-			unsigned char byte;
-			packet >> byte;
-			modulus[i] = byte;
-		}
+	unsigned int serverCiphers = 0;
+	packet >> serverCiphers;
+	const AeadCipher cipher = packet ? NetAEAD::PreferredCipher(serverCiphers) : AeadCipher::None;
 
-		unsigned int expByteSize;
-		packet >> expByteSize;
+	KeyExchange keyExchange = KeyExchange::Generate();
+	NetAESKey key;
+	if (cipher == AeadCipher::None || !keyExchange.DeriveKey(serverPublic, false, key))
+	{
+		fprintf(stderr, "%s %s received an invalid key share, disconnecting.\n", netPrefix.c_str(), session.GetName().c_str());
+		enet_peer_disconnect(session.peer, 0);
+		return;
+	}
+	session.keyChain.channelKey = net::NetAEAD{ cipher, key, false };
+
+	NetRequest request;
+	request.type = NetRequest::Type::Send;
+	request.session = &session;
+	request.packet << static_cast<unsigned int>(NetCommands::HandshakeIdentify);
+	request.packet.Append(keyExchange.GetPublicKey(), KeyExchange::keySize);
+	request.packet << static_cast<unsigned char>(cipher);
+	keyExchange.Clear();
+
+	// The identity is sealed inside the handshake frame, with everything before it as additional data.
+	const std::size_t headerSize = request.packet.GetDataSize();
+	const std::size_t identitySize = session.identity.GetDataSize();
+	request.packet.Append(session.identity.GetData(), identitySize);
+	request.packet.m_data.resize(headerSize + identitySize + NetAEAD::tagSize);
+	session.identity.Clear();
+
+	auto* buffer = reinterpret_cast<unsigned char*>(&request.packet.m_data[0]);
+	if (!session.keyChain.channelKey.Seal(buffer + headerSize, identitySize, buffer, headerSize, buffer + headerSize + identitySize))
+	{
+		enet_peer_disconnect(session.peer, 0);
+		return;
+	}
 
-		auto* exponent = new unsigned char[expByteSize];
+	SendFrame(session, request);
+	printf("%s %s identifying with the key share...\n", netPrefix.c_str(), session.GetName().c_str());
+}
 
-		for (unsigned int i = 0; i < expByteSize; i++) {
-			unsigned char byte;
-			packet >> byte;
-			exponent[i] = byte;
-		}
+void net::Client::SendResumption(ClientSession& session)
+{
+	ClientSession::Ticket& ticket = session.resumption;
 
-		net::NetRSAKey serverPublic{
-			expByteSize << 3,
-			modByteSize << 3,
-			0,
-			std::shared_ptr<unsigned char>{ modulus, [](unsigned char *p) { delete[] p; } },
-			std::shared_ptr<unsigned char>{ exponent, [](unsigned char *p) { delete[] p; } },
-			std::shared_ptr<unsigned char>{},
-			std::shared_ptr<unsigned char>{},
-			std::shared_ptr<unsigned char>{}
-		};
+	unsigned char salt[KeyExchange::keySize];
+	SecureRandom::Fill(salt, sizeof(salt));
 
-		keyChain.handshakeKey = net::NetRSA{ {}, serverPublic };
-		keyChain.dataKey = net::NetAES();
+	NetAESKey key;
+	if (!KeyExchange::ExpandKey(ticket.secret, sizeof(ticket.secret), salt, sizeof(salt), resumptionKeyInfo, key))
+	{
+		enet_peer_disconnect(session.peer, 0);
+		return;
+	}
+	session.keyChain.channelKey = net::NetAEAD{ ticket.cipher, key, false };
+
+	NetRequest request;
+	request.type = NetRequest::Type::Send;
+	request.session = &session;
+	request.packet << static_cast<unsigned int>(NetCommands::ResumeSession);
+	request.packet << static_cast<unsigned int>(ticket.ticket.size());
+	request.packet.Append(ticket.ticket.data(), ticket.ticket.size());
+	request.packet.Append(salt, sizeof(salt));
+
+	// Tickets are single use, the server sends a new one after resuming.
+	ticket = ClientSession::Ticket{};
+
+	// The tag of an empty message proves the client knows the resumption secret.
+	const std::size_t headerSize = request.packet.GetDataSize();
+	request.packet.m_data.resize(headerSize + NetAEAD::tagSize);
+	auto* buffer = reinterpret_cast<unsigned char*>(&request.packet.m_data[0]);
+	if (!session.keyChain.channelKey.Seal(buffer + headerSize, 0, buffer, headerSize, buffer + headerSize))
+	{
+		enet_peer_disconnect(session.peer, 0);
+		return;
+	}
 
-		Packet plainResponse;
-		plainResponse << static_cast<unsigned int>(keyChain.dataKey.GetKey().bitSize >> 3);
-		plainResponse.Append(keyChain.dataKey.GetKey().key.get(), keyChain.dataKey.GetKey().bitSize >> 3);
+	SendFrame(session, request);
+	printf("%s %s resuming with a session ticket...\n", netPrefix.c_str(), session.GetName().c_str());
+}
 
-		std::unique_ptr<unsigned char[]> encryptedData;
-		size_t encryptedDataSize;
+void net::Client::HandleSessionTicket(ClientSession& session, Packet& packet)
+{
+	ClientSession::Ticket ticket;
+	unsigned int lifetime = 0;
+	packet >> ticket.connectionId >> lifetime;
+	if (!packet || !packet.CheckSize(sizeof(ticket.secret) + SessionTicketKeys::overhead) || session.peer == nullptr)
+	{
+		return;
+	}
+
+	memcpy(ticket.secret, packet.GetData(packet.m_readPos), sizeof(ticket.secret));
+	packet.m_readPos += sizeof(ticket.secret);
 
-		keyChain.handshakeKey.Encrypt(static_cast<const unsigned char*>(plainResponse.GetData()), plainResponse.GetDataSize(), encryptedData, encryptedDataSize);
+	const auto* ticketData = static_cast<const unsigned char*>(packet.GetData(packet.m_readPos));
+	ticket.ticket.assign(ticketData, ticketData + (packet.GetDataSize() - packet.m_readPos));
+	ticket.cipher = session.keyChain.channelKey.GetCipher();
+	ticket.expiresAt = ClockSync::LocalTimeNow() + static_cast<long long>(lifetime) * 1000000;
+	ticket.address = session.peer->address;
 
-		Packet response;
-		response << static_cast<unsigned int>(encryptedDataSize);
-		response.Append(encryptedData.get(), encryptedDataSize);
+	session.resumption = std::move(ticket);
+}
 
-		SendPacket(NetCommands::HandshakeDataKey, response, false);
+bool net::Client::DecryptPacket(ClientSession& session, Packet& packet, NetCommands command, unsigned int messageId, SecurityLevel& level)
+{
+	TraceScope decryptScope(TraceStage::Decrypt, session.GetSessionId(), messageId);
 
+	if (command == NetCommands::AeadPacket || command == NetCommands::AuthenticatedPacket)
+	{
+		const bool opened = command == NetCommands::AeadPacket ?
+			CryptoFrame::Open(session.keyChain.channelKey, packet) :
+			CryptoFrame::Verify(session.keyChain.channelKey, packet);
+		if (!opened)
+		{
+			fprintf(stderr, "%s %s rejected a tampered or replayed packet, disconnecting.\n", netPrefix.c_str(), session.GetName().c_str());
+			enet_peer_disconnect(session.peer, 0);
+			return false;
+		}
+		level = command == NetCommands::AeadPacket ? SecurityLevel::Encrypted : SecurityLevel::Authenticated;
+		return true;
 	}
-	break;
 
-	case NetCommands::CryptoPacket:
+	if (session.keyChain.channelKey.IsActive() || !CryptoFrame::Open(session.keyChain.dataKey, packet))
 	{
-		unsigned int paddingSize;
-		packet >> paddingSize;
+		return false;
+	}
+	level = SecurityLevel::Encrypted;
+	return true;
+}
 
-		unsigned int ivSize = net::NetAES::ivLength >> 3;
+net::SecurityLevel net::Client::GetRequiredSecurity(Packet& packet) const
+{
+	const std::size_t readPos = packet.m_readPos;
+	const bool isValid = packet.m_isValid;
 
-		auto* iv = new unsigned char[ivSize];
+	unsigned int commandInt = 0;
+	unsigned int customCommand = 0;
+	packet >> commandInt;
+	if (NetCommands(commandInt) == NetCommands::CustomCommand)
+	{
+		packet >> customCommand;
+	}
 
-		for (unsigned int i = 0; i < ivSize; i++) {
-			unsigned char byte;
-			packet >> byte;
-			iv[i] = byte;
-		}
+	packet.m_readPos = readPos;
+	packet.m_isValid = isValid;
+	return NetCommands(commandInt) == NetCommands::CustomCommand ? GetCommandOptions(customCommand).security : SecurityLevel::Encrypted;
+}
 
-		unsigned int encryptedSize;
-		packet >> encryptedSize;
+void net::Client::SendTimeSync(ClientSession& session)
+{
+	NetRequest request;
+	request.type = NetRequest::Type::Send;
+	request.session = &session;
+	request.security = SecurityLevel::Encrypted;
+	request.packet << static_cast<unsigned int>(NetCommands::TimeSync);
+	request.packet << static_cast<Packet::Int64>(ClockSync::LocalTimeNow());
+	request.packet << static_cast<Packet::Int64>(session.lastResponseSend);
+	request.packet << static_cast<Packet::Int64>(session.lastResponseReceive);
+
+	// Reliable and in order like everything else the channel key protects. A resent sample has a longer round trip, so ClockSync skips it.
+	SendFrame(session, request);
+
+	session.nextTimeSync = ClockSync::LocalTimeNow() + (session.clockSync.IsSynchronized() ? timeSyncInterval : timeSyncIntervalFast);
+}
 
-		auto* encryptedData = new unsigned char[encryptedSize];
+void net::Client::HandleTimeSyncResponse(ClientSession& session, Packet& packet, long long receiveTime)
+{
+	unsigned int command;
+	Packet::Int64 clientSend, serverReceive, serverSend;
+	packet >> command >> clientSend >> serverReceive >> serverSend;
+	if (packet)
+	{
+		session.clockSync.AddSample(clientSend, serverReceive, serverSend, receiveTime);
+		session.lastResponseSend = serverSend;
+		session.lastResponseReceive = receiveTime;
+	}
+}
 
-		for (unsigned int i = 0; i < encryptedSize; i++) {
-			unsigned char byte;
-			packet >> byte;
-			encryptedData[i] = byte;
-		}
+void net::Client::HandleCustomResponse(ClientSession& session, Packet& packet)
+{
+	unsigned int requestId, status;
+	packet >> requestId >> status;
+	if (!packet)
+	{
+		return;
+	}
 
-		auto key = keyChain.dataKey;
+	RequestResult result{ static_cast<RequestStatus>(status), Packet{} };
+	result.packet.Append(packet.GetData(packet.m_readPos), packet.GetDataSize() - packet.m_readPos);
 
-		std::unique_ptr<unsigned char[]> decryptedData;
-		size_t decryptedSize;
-		key.Decrypt(encryptedData, encryptedSize, iv, decryptedData, decryptedSize, paddingSize);
+	// Late responses of requests that timed out or were cancelled are dropped.
+	session.pendingRequests.Resolve(requestId, 0, std::move(result));
+}
 
-		delete[] iv;
-		delete[] encryptedData;
+void net::Client::HandleAnyPacket(Packet& packet)
+{
+	HandleAnyPacket(GetPrimarySession(), packet);
+}
 
-		Packet decryptedPacket;
-		decryptedPacket.Append(decryptedData.get(), decryptedSize);
+void net::Client::HandleAnyPacket(ClientSession& session, Packet& packet)
+{
+	TraceScope dispatchScope(TraceStage::Dispatch, session.GetSessionId(), traceId);
 
-		unsigned int commandInt;
-		decryptedPacket >> commandInt;
+	unsigned int commandInt;
+	packet >> commandInt;
+	const auto command = NetCommands(commandInt);
 
-		Packet trimmedPacket;
-		trimmedPacket << commandInt;
-		trimmedPacket.Append(decryptedPacket.GetData(sizeof(unsigned int)), decryptedPacket.GetDataSize() - sizeof(unsigned int));
+	if (command == NetCommands::CustomCommand || command == NetCommands::CustomRequest)
+	{
+		unsigned int requestId = 0;
+		if (command == NetCommands::CustomRequest)
+		{
+			packet >> requestId;
+		}
 
-		HandleAnyPacket(trimmedPacket);
+		unsigned int customCommand;
+		packet >> customCommand;
+		if (debug)
+		{
+			printf("%s %s handling custom %u\n", netPrefix.c_str(), session.GetName().c_str(), customCommand);
+		}
+		TraceScope handlerScope(TraceStage::Handler, session.GetSessionId(), traceId);
+		if (command == NetCommands::CustomCommand)
+		{
+			session.handler->HandleCustomPacket(customCommand, packet);
+		}
+		else if (!session.handler->HandleCustomRequest(customCommand, packet, requestId))
+		{
+			Packet emptyPacket{};
+			session.SendResponse(requestId, emptyPacket, RequestStatus::Unhandled);
+		}
 	}
-	break;
+	else
+	{
+		if (debug)
+		{
+			printf("%s %s handling NetCommands %s (%u)\n", netPrefix.c_str(), session.GetName().c_str(), GetName(command).c_str(), command);
+		}
+		HandlePacket(session, command, packet);
+	}
+}
+
+bool net::Client::IsConnected() const
+{
+	return GetPrimarySession().IsConnected();
+}
+
+void net::Client::AdditionalPing()
+{
+	NetRequest request;
+	request.type = NetRequest::Type::Ping;
+	request.session = &GetPrimarySession();
+	PushRequest(std::move(request));
+}
 
+void net::Client::HandlePacket(ClientSession& session, NetCommands command, Packet& packet)
+{
+	switch(command)
+	{
 	case NetCommands::HandshakeSuccess:
 	{
-		printf("%s Handshake successful\n", netPrefix.c_str());
+		printf("%s %s handshake successful\n", netPrefix.c_str(), session.GetName().c_str());
 		auto identificationPacket = Packet{};
-		GetIdentity(identificationPacket);
-		this->SendPacket(NetCommands::Identify, identificationPacket);
+		session.handler->GetIdentity(identificationPacket);
+		session.SendPacket(NetCommands::Identify, identificationPacket);
 		printf("%s Identifying...\n", netPrefix.c_str());
 	}
 	break;
 
 	case NetCommands::IdentifySuccessful:
 	{
-		this->isIdentified = true;
-		printf("%s Identify successful\n", netPrefix.c_str());
-		this->OnIdentificationSuccess();
+		session.isIdentified = true;
+		printf("%s %s identify successful\n", netPrefix.c_str(), session.GetName().c_str());
+		session.handler->OnIdentificationSuccess();
 	}
 	break;
 
 	case NetCommands::IdentifyFailure:
 	{
-		this->isIdentified = false;
-		printf("%s Identify failure!\n", netPrefix.c_str());
+		session.isIdentified = false;
+		printf("%s %s identify failure!\n", netPrefix.c_str(), session.GetName().c_str());
 		printf("%s The server didn't accept your access token! It might be already in use or it has expired. Please retry logging in.\n", netPrefix.c_str());
 		unsigned int response{};
 		packet >> response;
-		this->OnIdentificationFailure(static_cast<net::IdentifyResponse>(response));
+		session.handler->OnIdentificationFailure(static_cast<net::IdentifyResponse>(response));
 	}
 	break;
 
@@ -0,0 +1,152 @@
+#include "Net/ClientSession.h"
+#include "Net/Client.h"
+
+#include <cstdio>
+
+net::ClientSession::ClientSession(Client& client, std::string name, SessionHandler* handler, unsigned int sessionId) :
+	client(client), name(std::move(name)), handler(handler), sessionId(sessionId), keyChain(net::EmptyKeyChain())
+{
+}
+
+void net::ClientSession::Connect(const char* ip, unsigned short port, unsigned int connectionId)
+{
+	if (client.client == nullptr)
+	{
+		return;
+	}
+
+	Client::NetRequest request;
+	request.type = Client::NetRequest::Type::Connect;
+	request.session = this;
+	request.host = ip;
+	request.port = port;
+	request.connectionId = connectionId;
+#ifndef DISABLE_ENCRYPTION
+	handler->GetIdentity(request.packet);
+#endif
+	client.PushRequest(std::move(request));
+}
+
+void net::ClientSession::Disconnect() const
+{
+	if (IsConnected()) {
+		Client::NetRequest request;
+		request.type = Client::NetRequest::Type::Disconnect;
+		request.session = const_cast<ClientSession*>(this);
+		client.PushRequest(std::move(request));
+	}
+}
+
+void net::ClientSession::SendPacket(NetCommands command) const
+{
+	Packet emptyPacket{};
+	this->SendPacket(command, emptyPacket);
+}
+
+void net::ClientSession::SendPacket(NetCommands command, Packet& packet, bool encrypted) const
+{
+	SendPacket(command, packet, encrypted ? SecurityLevel::Encrypted : SecurityLevel::Plain);
+}
+
+void net::ClientSession::SendPacket(NetCommands command, Packet& packet, SecurityLevel security) const
+{
+	if (client.client != nullptr) {
+		if (client.debug && command != NetCommands::CustomCommand)
+		{
+			printf("%s %s sending %s\n", client.netPrefix.c_str(), name.c_str(), ::GetName(command).c_str());
+		}
+
+		Client::NetRequest request;
+		request.type = Client::NetRequest::Type::Send;
+		request.session = const_cast<ClientSession*>(this);
+		request.security = security;
+		request.traceId = PacketTracer::NextMessageId();
+
+		TraceScope sendScope(TraceStage::Send, sessionId, request.traceId);
+
+		request.packet << static_cast<unsigned int>(command);
+		request.packet.Append(packet.GetData(), packet.GetDataSize());
+
+		client.PushRequest(std::move(request));
+	}
+}
+
+void net::ClientSession::SendCustomPacket(unsigned int command) const
+{
+	Packet emptyPacket{};
+	this->SendCustomPacket(command, emptyPacket);
+}
+
+void net::ClientSession::SendCustomPacket(unsigned int command, Packet& packet) const
+{
+	if (IsConnected()) {
+		if (client.debug)
+		{
+			printf("%s %s sending custom %u\n", client.netPrefix.c_str(), name.c_str(), command);
+		}
+
+		Packet commandPacket = Packet{};
+		commandPacket << static_cast<unsigned int>(command);
+		commandPacket.Append(packet.GetData(), packet.GetDataSize());
+
+		SendPacket(NetCommands::CustomCommand, commandPacket, client.GetCommandOptions(command).security);
+	}
+}
+
+net::RequestFuture net::ClientSession::SendRequest(unsigned int command, Packet& packet, std::chrono::milliseconds timeout) const
+{
+	if (++nextRequestId == 0)
+	{
+		nextRequestId = 1;
+	}
+
+	Client::NetRequest request;
+	request.type = Client::NetRequest::Type::Request;
+	request.session = const_cast<ClientSession*>(this);
+	request.security = SecurityLevel::Encrypted;
+	request.requestId = nextRequestId;
+	request.deadline = ClockSync::LocalTimeNow() + std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
+	request.traceId = PacketTracer::NextMessageId();
+
+	RequestFuture future{ request.requestId, request.promise.get_future() };
+
+	if (client.client == nullptr)
+	{
+		request.promise.set_value(RequestResult{ RequestStatus::Disconnected, Packet{} });
+		return future;
+	}
+
+	if (client.debug)
+	{
+		printf("%s %s sending request %u (%u)\n", client.netPrefix.c_str(), name.c_str(), command, request.requestId);
+	}
+
+	TraceScope sendScope(TraceStage::Send, sessionId, request.traceId);
+
+	request.packet << static_cast<unsigned int>(NetCommands::CustomRequest);
+	request.packet << request.requestId;
+	request.packet << command;
+	request.packet.Append(packet.GetData(), packet.GetDataSize());
+
+	client.PushRequest(std::move(request));
+	return future;
+}
+
+void net::ClientSession::CancelRequest(unsigned int requestId) const
+{
+	Client::NetRequest request;
+	request.type = Client::NetRequest::Type::Cancel;
+	request.session = const_cast<ClientSession*>(this);
+	request.requestId = requestId;
+	client.PushRequest(std::move(request));
+}
+
+void net::ClientSession::SendResponse(unsigned int requestId, Packet& packet, RequestStatus status) const
+{
+	Packet responsePacket = Packet{};
+	responsePacket << requestId;
+	responsePacket << static_cast<unsigned int>(status);
+	responsePacket.Append(packet.GetData(), packet.GetDataSize());
+
+	SendPacket(NetCommands::CustomResponse, responsePacket);
+}
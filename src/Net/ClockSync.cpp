@@ -0,0 +1,38 @@
+#include "Net/ClockSync.h"
+
+#include <algorithm>
+#include <chrono>
+
+long long net::ClockSync::LocalTimeNow() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void net::ClockSync::AddSample(long long clientSend, long long serverReceive, long long serverSend, long long clientReceive)
+{
+	Sample& sample = samples[nextSample];
+	sample.offset = ((serverReceive - clientSend) + (serverSend - clientReceive)) / 2;
+	sample.roundTripTime = std::max((clientReceive - clientSend) - (serverSend - serverReceive), 0ll);
+
+	nextSample = (nextSample + 1) % sampleWindow;
+	sampleCount = std::min(sampleCount + 1, sampleWindow);
+
+	const auto best = std::min_element(samples.begin(), samples.begin() + sampleCount, [](const Sample& lhs, const Sample& rhs)
+	{
+		return lhs.roundTripTime < rhs.roundTripTime;
+	});
+
+	offset.store(best->offset, std::memory_order_release);
+	roundTripTime.store(best->roundTripTime, std::memory_order_release);
+	synchronized.store(sampleCount >= minimumSamples, std::memory_order_release);
+}
+
+void net::ClockSync::Reset()
+{
+	sampleCount = 0;
+	nextSample = 0;
+
+	offset.store(0, std::memory_order_release);
+	roundTripTime.store(0, std::memory_order_release);
+	synchronized.store(false, std::memory_order_release);
+}
@@ -1,6 +1,6 @@
 #include "Net/Connection.h"
 
-unsigned int net::Connection::idCount = 0;
+std::atomic<unsigned int> net::Connection::idCount{ 0 };
 
 net::Connection::Connection(ENetPeer* peer, unsigned int connectionId)
 {
@@ -10,11 +10,19 @@ net::Connection::Connection(ENetPeer* peer, unsigned int connectionId)
 
 unsigned net::Connection::NewConnectionId()
 {
-	idCount++;
-	return idCount;
+	return ++idCount;
 }
 
 bool net::Connection::Valid() const
 {
 	return this->connectionId != CONNECTION_ID_INVALID;
 }
+
+long long net::Connection::GetRoundTripTime() const
+{
+	if (this->clockSynchronized || this->peer == nullptr)
+	{
+		return this->roundTripTime;
+	}
+	return static_cast<long long>(this->peer->roundTripTime) * 1000;
+}
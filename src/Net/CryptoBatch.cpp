@@ -0,0 +1,80 @@
+#include "Net/CryptoBatch.h"
+#include "Net/CryptoFrame.h"
+#include "Net/PacketTracer.h"
+#include "Utility/ThreadPool.h"
+
+#include <unordered_map>
+
+void net::CryptoBatch::Add(Job&& job)
+{
+	jobs.push_back(std::move(job));
+}
+
+void net::CryptoBatch::Seal(ThreadPool* pool)
+{
+	std::unordered_map<const void*, std::size_t> groupOfKey;
+	groupCount = 0;
+
+	for (std::size_t i = 0; i < jobs.size(); i++)
+	{
+		const void* key = jobs[i].channelKey != nullptr ? static_cast<const void*>(jobs[i].channelKey) : static_cast<const void*>(jobs[i].dataKey);
+		if (key == nullptr)
+		{
+			continue;
+		}
+
+		auto it = groupOfKey.find(key);
+		if (it == groupOfKey.end())
+		{
+			it = groupOfKey.emplace(key, groupCount++).first;
+			if (groups.size() < groupCount)
+			{
+				groups.emplace_back();
+			}
+			groups[it->second].clear();
+		}
+		groups[it->second].push_back(i);
+	}
+
+	auto sealGroup = [this](std::size_t group)
+	{
+		for (std::size_t index : groups[group])
+		{
+			SealJob(jobs[index]);
+		}
+	};
+
+	if (pool == nullptr || groupCount < 2)
+	{
+		for (std::size_t group = 0; group < groupCount; group++)
+		{
+			sealGroup(group);
+		}
+	}
+	else
+	{
+		pool->ParallelFor(groupCount, sealGroup);
+	}
+}
+
+void net::CryptoBatch::Clear()
+{
+	jobs.clear();
+}
+
+void net::CryptoBatch::SealJob(Job& job)
+{
+	TraceScope encryptScope(TraceStage::Encrypt, job.connectionId, job.messageId);
+	if (job.channelKey != nullptr && job.authenticateOnly)
+	{
+		job.failed = !CryptoFrame::Authenticate(*job.channelKey, job.data.GetData(), job.data.GetDataSize(), job.frame);
+	}
+	else if (job.channelKey != nullptr)
+	{
+		job.failed = !CryptoFrame::Seal(*job.channelKey, job.data.GetData(), job.data.GetDataSize(), job.frame);
+	}
+	else
+	{
+		job.failed = !CryptoFrame::Seal(*job.dataKey, job.data.GetData(), job.data.GetDataSize(), job.frame);
+	}
+}
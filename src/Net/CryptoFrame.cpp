@@ -0,0 +1,137 @@
+#include "Net/CryptoFrame.h"
+#include "Net/NetCommands.h"
+
+bool net::CryptoFrame::Seal(NetAES& key, const void* data, std::size_t dataSize, Packet& frame)
+{
+	constexpr std::size_t ivSize = NetAES::ivLength >> 3;
+	const std::size_t paddingSize = NetAES::GetPaddingSize(dataSize);
+	const std::size_t encryptedSize = dataSize + paddingSize;
+
+	frame.Clear();
+	frame << static_cast<unsigned int>(NetCommands::CryptoPacket);
+	frame << static_cast<unsigned int>(paddingSize);
+	const std::size_t ivOffset = frame.m_data.size();
+	frame.m_data.resize(ivOffset + ivSize);
+	frame << static_cast<unsigned int>(encryptedSize);
+	const std::size_t dataOffset = frame.m_data.size();
+
+	frame.m_data.resize(dataOffset + encryptedSize);
+	memcpy(&frame.m_data[dataOffset], data, dataSize);
+
+	size_t usedPadding;
+	return key.EncryptInPlace(reinterpret_cast<unsigned char*>(&frame.m_data[dataOffset]), dataSize, reinterpret_cast<unsigned char*>(&frame.m_data[ivOffset]), usedPadding) == encryptedSize;
+}
+
+bool net::CryptoFrame::Open(NetAES& key, Packet& frame)
+{
+	constexpr std::size_t ivSize = NetAES::ivLength >> 3;
+
+	frame.m_readPos = 0;
+	frame.m_isValid = true;
+
+	unsigned int command, paddingSize;
+	frame >> command >> paddingSize;
+	if (!frame || NetCommands(command) != NetCommands::CryptoPacket || !frame.CheckSize(ivSize))
+	{
+		return false;
+	}
+	const std::size_t ivOffset = frame.m_readPos;
+	frame.m_readPos += ivSize;
+
+	unsigned int encryptedSize;
+	frame >> encryptedSize;
+	if (!frame || !frame.CheckSize(encryptedSize) || encryptedSize % NetAES::blockSize != 0 || paddingSize >= NetAES::blockSize || encryptedSize < paddingSize + sizeof(unsigned int))
+	{
+		return false;
+	}
+	const std::size_t dataOffset = frame.m_readPos;
+
+	const std::size_t decryptedSize = key.DecryptInPlace(reinterpret_cast<unsigned char*>(&frame.m_data[dataOffset]), encryptedSize,
+		reinterpret_cast<const unsigned char*>(&frame.m_data[ivOffset]), paddingSize);
+
+	// Move the plaintext to the front, it starts with the command of the encrypted packet.
+	frame.m_data.erase(frame.m_data.begin(), frame.m_data.begin() + dataOffset);
+	frame.m_data.resize(decryptedSize);
+	frame.m_readPos = 0;
+	frame.m_isValid = decryptedSize >= sizeof(unsigned int);
+	return frame.m_isValid;
+}
+
+bool net::CryptoFrame::Seal(NetAEAD& key, const void* data, std::size_t dataSize, Packet& frame)
+{
+	frame.Clear();
+	frame << static_cast<unsigned int>(NetCommands::AeadPacket);
+	const std::size_t dataOffset = frame.m_data.size();
+
+	frame.m_data.resize(dataOffset + dataSize + NetAEAD::tagSize);
+	memcpy(&frame.m_data[dataOffset], data, dataSize);
+
+	auto* buffer = reinterpret_cast<unsigned char*>(&frame.m_data[0]);
+	return key.Seal(buffer + dataOffset, dataSize, buffer, dataOffset, buffer + dataOffset + dataSize);
+}
+
+bool net::CryptoFrame::Open(NetAEAD& key, Packet& frame)
+{
+	constexpr std::size_t headerSize = sizeof(unsigned int);
+
+	frame.m_readPos = 0;
+	frame.m_isValid = true;
+
+	unsigned int command;
+	frame >> command;
+	if (!frame || NetCommands(command) != NetCommands::AeadPacket || frame.m_data.size() < headerSize + sizeof(unsigned int) + NetAEAD::tagSize)
+	{
+		return false;
+	}
+
+	const std::size_t decryptedSize = frame.m_data.size() - headerSize - NetAEAD::tagSize;
+	auto* buffer = reinterpret_cast<unsigned char*>(&frame.m_data[0]);
+	if (!key.Open(buffer + headerSize, decryptedSize, buffer, headerSize, buffer + headerSize + decryptedSize))
+	{
+		return false;
+	}
+
+	frame.m_data.erase(frame.m_data.begin(), frame.m_data.begin() + headerSize);
+	frame.m_data.resize(decryptedSize);
+	frame.m_readPos = 0;
+	return true;
+}
+
+bool net::CryptoFrame::Authenticate(NetAEAD& key, const void* data, std::size_t dataSize, Packet& frame)
+{
+	frame.Clear();
+	frame << static_cast<unsigned int>(NetCommands::AuthenticatedPacket);
+	frame.Append(data, dataSize);
+	const std::size_t tagOffset = frame.m_data.size();
+	frame.m_data.resize(tagOffset + NetAEAD::tagSize);
+
+	auto* buffer = reinterpret_cast<unsigned char*>(&frame.m_data[0]);
+	return key.Seal(buffer + tagOffset, 0, buffer, tagOffset, buffer + tagOffset);
+}
+
+bool net::CryptoFrame::Verify(NetAEAD& key, Packet& frame)
+{
+	constexpr std::size_t headerSize = sizeof(unsigned int);
+
+	frame.m_readPos = 0;
+	frame.m_isValid = true;
+
+	unsigned int command;
+	frame >> command;
+	if (!frame || NetCommands(command) != NetCommands::AuthenticatedPacket || frame.m_data.size() < headerSize + sizeof(unsigned int) + NetAEAD::tagSize)
+	{
+		return false;
+	}
+
+	const std::size_t tagOffset = frame.m_data.size() - NetAEAD::tagSize;
+	auto* buffer = reinterpret_cast<unsigned char*>(&frame.m_data[0]);
+	if (!key.Open(buffer + tagOffset, 0, buffer, tagOffset, buffer + tagOffset))
+	{
+		return false;
+	}
+
+	frame.m_data.erase(frame.m_data.begin(), frame.m_data.begin() + headerSize);
+	frame.m_data.resize(tagOffset - headerSize);
+	frame.m_readPos = 0;
+	return true;
+}
@@ -0,0 +1,135 @@
+#include "Net/PacketScheduler.h"
+
+#include <cassert>
+
+net::PacketScheduler::PacketScheduler()
+{
+	SetLaneWeight(PacketLane::Turn, 4);
+	SetLaneWeight(PacketLane::Bulk, 1);
+}
+
+void net::PacketScheduler::Push(PacketLane lane, Entry&& entry)
+{
+	Lane& target = lanes[static_cast<std::size_t>(lane)];
+
+	auto& queue = target.queues[entry.connectionId];
+	if (queue.empty())
+	{
+		target.active.push_back(entry.connectionId);
+	}
+	queue.push_back(std::move(entry));
+
+	target.size++;
+	size++;
+}
+
+net::PacketScheduler::Entry& net::PacketScheduler::Front()
+{
+	assert(!Empty() && "Front() called on an empty PacketScheduler");
+
+	if (selected == nullptr)
+	{
+		selected = &SelectLane();
+	}
+	return selected->queues[selected->active.front()].front();
+}
+
+void net::PacketScheduler::Pop()
+{
+	if (selected == nullptr)
+	{
+		if (Empty())
+		{
+			return;
+		}
+		selected = &SelectLane();
+	}
+
+	Lane& lane = *selected;
+	selected = nullptr;
+
+	const unsigned int connectionId = lane.active.front();
+	lane.active.pop_front();
+
+	auto queue = lane.queues.find(connectionId);
+	queue->second.pop_front();
+	if (queue->second.empty())
+	{
+		lane.queues.erase(queue);
+	}
+	else
+	{
+		// Move the connection to the back, so the other connections get their turn first.
+		lane.active.push_back(connectionId);
+	}
+
+	if (lane.credit > 0)
+	{
+		lane.credit--;
+	}
+	lane.size--;
+	size--;
+}
+
+void net::PacketScheduler::Remove(unsigned int connectionId)
+{
+	selected = nullptr;
+
+	for (Lane& lane : lanes)
+	{
+		auto queue = lane.queues.find(connectionId);
+		if (queue == lane.queues.end())
+		{
+			continue;
+		}
+
+		lane.size -= queue->second.size();
+		size -= queue->second.size();
+		lane.queues.erase(queue);
+
+		for (auto it = lane.active.begin(); it != lane.active.end(); ++it)
+		{
+			if (*it == connectionId)
+			{
+				lane.active.erase(it);
+				break;
+			}
+		}
+	}
+}
+
+void net::PacketScheduler::SetLaneWeight(PacketLane lane, unsigned int weight)
+{
+	Lane& target = lanes[static_cast<std::size_t>(lane)];
+	target.weight = weight > 0 ? weight : 1;
+	target.credit = target.weight;
+}
+
+net::PacketScheduler::Lane& net::PacketScheduler::SelectLane()
+{
+	Lane& control = lanes[static_cast<std::size_t>(PacketLane::Control)];
+	if (control.size > 0)
+	{
+		return control;
+	}
+
+	for (int round = 0; round < 2; round++)
+	{
+		for (std::size_t i = static_cast<std::size_t>(PacketLane::Control) + 1; i < lanes.size(); i++)
+		{
+			if (lanes[i].size > 0 && lanes[i].credit > 0)
+			{
+				return lanes[i];
+			}
+		}
+
+		// Every lane with packets used up its credit, start a new round.
+		for (Lane& lane : lanes)
+		{
+			lane.credit = lane.weight;
+		}
+	}
+
+	assert(false && "SelectLane() called on an empty PacketScheduler");
+	return control;
+}
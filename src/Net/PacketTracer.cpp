@@ -0,0 +1,172 @@
+#include "Net/PacketTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct TraceRing
+	{
+		std::mutex mutex;
+		std::vector<net::TraceSpan> spans;
+		std::size_t next{ 0 };
+		bool wrapped{ false };
+		unsigned int threadIndex{ 0 };
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::shared_ptr<TraceRing>> rings;
+
+	std::atomic<unsigned int> messageIdCount{ 0 };
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::shared_ptr<TraceRing> RegisterRing()
+	{
+		auto ring = std::make_shared<TraceRing>();
+		ring->spans.resize(net::PacketTracer::ringSize);
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		ring->threadIndex = static_cast<unsigned int>(rings.size()) + 1;
+		// The registry keeps the ring alive after its thread exits, so its spans can still be dumped.
+		rings.push_back(ring);
+		return ring;
+	}
+
+	TraceRing& LocalRing()
+	{
+		thread_local std::shared_ptr<TraceRing> ring = RegisterRing();
+		return *ring;
+	}
+}
+
+std::atomic<bool> net::PacketTracer::enabled{ false };
+
+const char* net::GetName(TraceStage stage)
+{
+	switch (stage)
+	{
+	case TraceStage::Receive: return "Receive";
+	case TraceStage::Enqueue: return "Enqueue";
+	case TraceStage::Decrypt: return "Decrypt";
+	case TraceStage::Dispatch: return "Dispatch";
+	case TraceStage::Handler: return "Handler";
+	case TraceStage::Send: return "Send";
+	case TraceStage::Encrypt: return "Encrypt";
+	case TraceStage::Flush: return "Flush";
+	}
+	return "Unknown";
+}
+
+unsigned int net::PacketTracer::NextMessageId() noexcept
+{
+	if (!IsEnabled())
+	{
+		return 0;
+	}
+	return messageIdCount.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+long long net::PacketTracer::Now() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void net::PacketTracer::Record(TraceStage stage, unsigned int connectionId, unsigned int messageId, long long begin, long long end)
+{
+	TraceRing& ring = LocalRing();
+
+	// Only contended while a dump is in progress.
+	std::lock_guard<std::mutex> lock(ring.mutex);
+	ring.spans[ring.next] = TraceSpan{ stage, connectionId, messageId, begin, end };
+	ring.next++;
+	if (ring.next == ring.spans.size())
+	{
+		ring.next = 0;
+		ring.wrapped = true;
+	}
+}
+
+bool net::PacketTracer::DumpChromeTrace(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::vector<std::shared_ptr<TraceRing>> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		snapshot = rings;
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	bool first = true;
+	std::vector<TraceSpan> spans;
+	for (const auto& ring : snapshot)
+	{
+		{
+			std::lock_guard<std::mutex> lock(ring->mutex);
+			if (ring->wrapped)
+			{
+				spans.assign(ring->spans.begin() + ring->next, ring->spans.end());
+				spans.insert(spans.end(), ring->spans.begin(), ring->spans.begin() + ring->next);
+			}
+			else
+			{
+				spans.assign(ring->spans.begin(), ring->spans.begin() + ring->next);
+			}
+		}
+
+		for (const TraceSpan& span : spans)
+		{
+			if (!first)
+			{
+				file << ',';
+			}
+			first = false;
+
+			file << "{\"name\":\"" << GetName(span.stage) << "\",\"cat\":\"net\",\"ph\":\"X\""
+				<< ",\"ts\":" << span.begin << ",\"dur\":" << std::max(span.end - span.begin, 0LL)
+				<< ",\"pid\":1,\"tid\":" << ring->threadIndex
+				<< ",\"args\":{\"message\":" << span.messageId << ",\"connection\":" << span.connectionId << "}}";
+		}
+	}
+
+	file << "]}\n";
+	return static_cast<bool>(file);
+}
+
+void net::PacketTracer::Clear()
+{
+	std::lock_guard<std::mutex> registryLock(registryMutex);
+	for (const auto& ring : rings)
+	{
+		std::lock_guard<std::mutex> lock(ring->mutex);
+		ring->next = 0;
+		ring->wrapped = false;
+	}
+}
+
+net::TraceScope::TraceScope(TraceStage stage, unsigned int connectionId, unsigned int messageId) noexcept
+	: stage(stage), connectionId(connectionId), messageId(messageId)
+{
+	if (PacketTracer::IsEnabled())
+	{
+		begin = PacketTracer::Now();
+	}
+}
+
+net::TraceScope::~TraceScope()
+{
+	if (begin >= 0)
+	{
+		PacketTracer::Record(stage, connectionId, messageId, begin, PacketTracer::Now());
+	}
+}
@@ -0,0 +1,187 @@
+#include "Net/PendingRequests.h"
+
+#include <algorithm>
+#include <limits>
+
+net::PendingRequests::PendingRequests(std::size_t capacity)
+{
+	std::size_t size = 16;
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+	slots.resize(size);
+	nextDeadline = std::numeric_limits<long long>::max();
+}
+
+void net::PendingRequests::Insert(Entry&& entry)
+{
+	if ((count + 1) * 2 > slots.size())
+	{
+		Grow();
+	}
+
+	nextDeadline = std::min(nextDeadline, entry.deadline);
+
+	std::size_t index = Home(entry.requestId);
+	while (slots[index].requestId != 0)
+	{
+		index = (index + 1) & (slots.size() - 1);
+	}
+	slots[index] = std::move(entry);
+	count++;
+}
+
+bool net::PendingRequests::Resolve(unsigned int requestId, unsigned int connectionId, RequestResult&& result)
+{
+	const std::size_t index = Find(requestId);
+	if (index == npos || slots[index].connectionId != connectionId)
+	{
+		return false;
+	}
+
+	slots[index].promise.set_value(std::move(result));
+	Erase(index);
+	return true;
+}
+
+bool net::PendingRequests::Cancel(unsigned int requestId)
+{
+	const std::size_t index = Find(requestId);
+	if (index == npos)
+	{
+		return false;
+	}
+
+	slots[index].promise.set_value(RequestResult{ RequestStatus::Cancelled, Packet{} });
+	Erase(index);
+	return true;
+}
+
+void net::PendingRequests::Expire(long long now)
+{
+	if (now < nextDeadline)
+	{
+		return;
+	}
+
+	nextDeadline = std::numeric_limits<long long>::max();
+
+	std::size_t index = 0;
+	while (index < slots.size())
+	{
+		Entry& entry = slots[index];
+		if (entry.requestId != 0 && entry.deadline <= now)
+		{
+			entry.promise.set_value(RequestResult{ RequestStatus::Timeout, Packet{} });
+			// Erasing may shift another entry into this slot, so check it again.
+			Erase(index);
+			continue;
+		}
+		if (entry.requestId != 0)
+		{
+			nextDeadline = std::min(nextDeadline, entry.deadline);
+		}
+		index++;
+	}
+}
+
+void net::PendingRequests::Fail(unsigned int connectionId, RequestStatus status)
+{
+	std::size_t index = 0;
+	while (index < slots.size())
+	{
+		Entry& entry = slots[index];
+		if (entry.requestId != 0 && entry.connectionId == connectionId)
+		{
+			entry.promise.set_value(RequestResult{ status, Packet{} });
+			Erase(index);
+			continue;
+		}
+		index++;
+	}
+}
+
+void net::PendingRequests::FailAll(RequestStatus status)
+{
+	for (Entry& entry : slots)
+	{
+		if (entry.requestId != 0)
+		{
+			entry.promise.set_value(RequestResult{ status, Packet{} });
+			entry = Entry{};
+		}
+	}
+	count = 0;
+	nextDeadline = std::numeric_limits<long long>::max();
+}
+
+std::size_t net::PendingRequests::Home(unsigned int requestId) const noexcept
+{
+	// Fibonacci hashing, the ids are sequential so this spreads them over the table.
+	return static_cast<std::size_t>(requestId * 2654435769u) & (slots.size() - 1);
+}
+
+std::size_t net::PendingRequests::Find(unsigned int requestId) const noexcept
+{
+	if (requestId == 0)
+	{
+		return npos;
+	}
+
+	std::size_t index = Home(requestId);
+	while (slots[index].requestId != 0)
+	{
+		if (slots[index].requestId == requestId)
+		{
+			return index;
+		}
+		index = (index + 1) & (slots.size() - 1);
+	}
+	return npos;
+}
+
+void net::PendingRequests::Erase(std::size_t index)
+{
+	const std::size_t mask = slots.size() - 1;
+
+	slots[index] = Entry{};
+	count--;
+
+	std::size_t hole = index;
+	std::size_t next = (index + 1) & mask;
+	while (slots[next].requestId != 0)
+	{
+		const std::size_t home = Home(slots[next].requestId);
+		// Move the entry into the hole when the hole lies between its home slot and where it is now.
+		if (((next - home) & mask) >= ((next - hole) & mask))
+		{
+			slots[hole] = std::move(slots[next]);
+			slots[next] = Entry{};
+			hole = next;
+		}
+		next = (next + 1) & mask;
+	}
+}
+
+void net::PendingRequests::Grow()
+{
+	std::vector<Entry> old;
+	old.swap(slots);
+	slots.resize(old.size() * 2);
+	count = 0;
+
+	for (Entry& entry : old)
+	{
+		if (entry.requestId != 0)
+		{
+			std::size_t index = Home(entry.requestId);
+			while (slots[index].requestId != 0)
+			{
+				index = (index + 1) & (slots.size() - 1);
+			}
+			slots[index] = std::move(entry);
+			count++;
+		}
+	}
+}
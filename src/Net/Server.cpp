@@ -1,11 +1,18 @@
 #include "Net/Server.h"
+#include "Net/CryptoFrame.h"
 #include "Net/NetCommands.h"
 #include "Net/Packet.h"
 #include "Net/NetUtils.h"
+#include "Crypto/SecureRandom.h"
 #include "Logger.h"
 
+#include <chrono>
 #include <cstdio>
 
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 net::Server::Server() : address{}, server(nullptr), debug(false), logger(nullptr)
 {
 	if (enet_initialize() != 0)
@@ -26,6 +33,9 @@ net::Server::Server(cof::basic_logger::Logger* logger) : address{}, server(nullp
 
 net::Server::~Server()
 {
+	// Finishes the running handshake jobs, which use the members of the server.
+	handshakeWorkers.reset();
+
 	if (server != nullptr)
 	{
 		enet_host_destroy(server);
@@ -41,7 +51,31 @@ void net::Server::StartServer(const unsigned short port, const unsigned short ma
 	address.host = ENET_HOST_ANY;
 	address.port = port;
 
-	server = enet_host_create(&address, maxSessions * 2, 2, 0, 0);
+#ifdef __linux__
+	if (reusePort)
+	{
+		// Create the host unbound, so SO_REUSEPORT can be set before binding to the shared port.
+		server = enet_host_create(nullptr, maxSessions * 2, 2, 0, 0);
+
+		int enable = 1;
+		if (server != nullptr &&
+			(setsockopt(server->socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0 ||
+			enet_socket_bind(server->socket, &address) != 0))
+		{
+			enet_host_destroy(server);
+			server = nullptr;
+		}
+
+		if (server != nullptr)
+		{
+			server->address = address;
+		}
+	}
+	else
+#endif
+	{
+		server = enet_host_create(&address, maxSessions * 2, 2, 0, 0);
+	}
 
 	if (logger != nullptr)
 	{
@@ -49,20 +83,43 @@ void net::Server::StartServer(const unsigned short port, const unsigned short ma
 		{
 			logger->Error("{} An error occurred while trying to create an ENet server host.", netPrefix);
 		}
-		logger->Info("{} Successfully started server at {}", netPrefix, address.port);
+		else
+		{
+			logger->Info("{} Successfully started server at {}", netPrefix, address.port);
+		}
+	}
+
+#ifndef DISABLE_ENCRYPTION
+	if (handshakeWorkerCount > 0 && handshakeWorkers == nullptr)
+	{
+		handshakeWorkers.reset(new ThreadPool(handshakeWorkerCount));
+		handshakeKeys.reset(new HandshakeKeyPool(*handshakeWorkers, readyHandshakeKeys));
 	}
+#endif
 }
 
-void net::Server::ReceivePackets()
+void net::Server::ReceivePackets(enet_uint32 timeout)
 {
 	if (server == nullptr)
 	{
 		return;
 	}
 
+	ServeAwaitingHandshakes();
+	Flush();
+	if (PacketTracer::IsEnabled())
+	{
+		// Only traced runs flush here, to time the stage. Otherwise enet_host_service(..) sends as before.
+		TraceScope flushScope(TraceStage::Flush, CONNECTION_ID_INVALID, 0);
+		enet_host_flush(server);
+	}
+
 	ENetEvent event;
-	while (enet_host_service(server, &event, 0) > 0)
+	while (enet_host_service(server, &event, timeout) > 0)
 	{
+		// Only wait for the first event, drain the rest without blocking.
+		timeout = 0;
+
 		switch (event.type)
 		{
 		case ENET_EVENT_TYPE_NONE:
@@ -74,7 +131,9 @@ void net::Server::ReceivePackets()
 				logger->Info("{} A new client connected from {}.", netPrefix, NetUtils::EnetAddressToString(event.peer->address));
 			}
 
-			unsigned int connectionId = event.data;
+			unsigned int connectionId = event.data & ~(CONNECT_FLAG_KEY_EXCHANGE | CONNECT_FLAG_RESUME);
+			const bool keyExchange = (event.data & CONNECT_FLAG_KEY_EXCHANGE) != 0;
+			const bool resume = (event.data & CONNECT_FLAG_RESUME) != 0;
 
 			if (connectionId == CONNECTION_ID_INVALID || connectionId > Connection::IDCount())
 			{
@@ -88,49 +147,85 @@ void net::Server::ReceivePackets()
 #ifdef DISABLE_ENCRYPTION
 			SendPacket(NetCommands::HandshakeSuccess, event.peer);
 #else
-
-			auto rsa = net::NetRSA();
-
-			clientKeys[NetUtils::EnetAddressToString(event.peer->address)] = net::KeyChain{
-				rsa,
-				{ {} }
-			};
-
-			Packet packet;
-
-			auto key = rsa.GetPublicKey();
-
-			auto modulusBytes = static_cast<unsigned int>(key.modBitSize >> 3);
-			auto exponentBytes = static_cast<unsigned int>(key.bitSize >> 3);
-
-			packet << modulusBytes;
-
-			for (unsigned int i = 0; i < modulusBytes; i++)
+			NetRSAKey privateKey, publicKey;
+			if (keyExchange && resume && ticketKeys != nullptr)
 			{
-				packet << key.modulus.get()[i];
+				// The client sends its ticket right away, AcceptResumption(..) answers it.
+				Flush();
+				clientKeys[NetUtils::EnetAddressToString(event.peer->address)] = net::EmptyKeyChain();
 			}
-
-			packet << exponentBytes;
-
-			for (unsigned int i = 0; i < exponentBytes; i++)
+			else if (keyExchange)
 			{
-				packet << key.exponent.get()[i];
+				SendKeyShare(connection);
+			}
+			else if (handshakeKeys == nullptr)
+			{
+				SendServerKey(connection, net::NetRSA());
+			}
+			else if (awaitingKeys.empty() && handshakeKeys->TryAcquire(privateKey, publicKey))
+			{
+				SendServerKey(connection, net::NetRSA{ privateKey, publicKey });
+			}
+			else
+			{
+				// Served in order by ServeAwaitingHandshakes() once the workers generated more keys.
+				awaitingKeys.push_back(connectionId);
 			}
-
-			SendPacket(NetCommands::HandshakeServerKey, packet, event.peer);
 #endif
 		}
 		break;
 
 		case ENET_EVENT_TYPE_RECEIVE:
 		{
+			Connection* connection = GetConnection(event.peer);
+			if (connection == nullptr)
+			{
+				enet_packet_destroy(event.packet);
+				break;
+			}
+
+			const long long receiveTime = ServerTimeNow();
+			const unsigned int connectionId = connection->GetConnectionId();
+			const unsigned int messageId = PacketTracer::NextMessageId();
+
 			Packet packet;
+			{
+				TraceScope receiveScope(TraceStage::Receive, connectionId, messageId);
+				packet.OnReceive(event.packet->data, event.packet->dataLength);
+				enet_packet_destroy(event.packet);
+			}
+
+			const NetCommands command = PeekCommand(packet);
 
-			packet.OnReceive(event.packet->data, event.packet->dataLength);
+			// Decrypt right away, the lane depends on the command inside.
+			if (command == NetCommands::HandshakeIdentify)
+			{
+				if (!AcceptKeyShare(connection, packet, messageId))
+				{
+					break;
+				}
+			}
+			else if (command == NetCommands::ResumeSession)
+			{
+				if (!AcceptResumption(connection, packet, messageId))
+				{
+					break;
+				}
+			}
+			else if (!DecryptPacket(connection, packet, command, messageId))
+			{
+				break;
+			}
 
-			packetQueue.push(std::pair<Connection*, Packet>(GetConnection(event.peer), packet));
+			if (PeekCommand(packet) == NetCommands::TimeSync)
+			{
+				HandleTimeSync(connection, packet, receiveTime);
+				break;
+			}
 
-			enet_packet_destroy(event.packet);
+			TraceScope enqueueScope(TraceStage::Enqueue, connectionId, messageId);
+			const PacketLane lane = GetLane(packet);
+			packetQueue.Push(lane, PacketScheduler::Entry{ connectionId, std::move(packet), messageId });
 		}
 		break;
 
@@ -150,6 +245,10 @@ void net::Server::ReceivePackets()
 
 			if(connection != connections.end())
 			{
+				packetQueue.Remove(connection->GetConnectionId());
+				resumptions.erase(connection->GetConnectionId());
+				timeSyncs.erase(connection->GetConnectionId());
+				pendingRequests.Fail(connection->GetConnectionId(), RequestStatus::Disconnected);
 				this->OnPlayerDisconnected(&*connection);
 				connections.erase(connection);
 			}
@@ -161,23 +260,81 @@ void net::Server::ReceivePackets()
 
 void net::Server::HandlePackets()
 {
-	while(!packetQueue.empty())
+	HandlePackets(HandleBudget{});
+}
+
+void net::Server::HandlePackets(const HandleBudget& budget)
+{
+	const auto start = std::chrono::steady_clock::now();
+	unsigned int handled = 0;
+
+	pendingRequests.Expire(ServerTimeNow());
+	ServeAwaitingHandshakes();
+
+	while(!packetQueue.Empty())
+	{
+		PacketScheduler::Entry& queued = packetQueue.Front();
+
+		// The connection might have been closed while the packet was queued.
+		Connection* connection = GetConnection(queued.connectionId);
+		if (connection != nullptr)
+		{
+			this->traceId = queued.traceId;
+			this->HandleAnyPacket(connection, queued.packet);
+			this->traceId = 0;
+		}
+
+		packetQueue.Pop();
+		handled++;
+
+		if (budget.maxPackets != 0 && handled >= budget.maxPackets)
+		{
+			break;
+		}
+		if (budget.maxTime.count() != 0 && std::chrono::steady_clock::now() - start >= budget.maxTime)
+		{
+			break;
+		}
+	}
+
+	Flush();
+}
+
+void net::Server::SetSendBatching(bool enable, unsigned int workerCount)
+{
+	Flush();
+	this->batchSends = enable;
+	this->cryptoPool.reset(enable && workerCount > 0 ? new ThreadPool(workerCount) : nullptr);
+}
+
+void net::Server::Flush()
+{
+	if (sendBatch.Empty())
 	{
-		auto pair = packetQueue.front();
+		return;
+	}
 
-		this->HandleAnyPacket(pair.first, pair.second);
+	sendBatch.Seal(cryptoPool.get());
 
-		packetQueue.pop();
+	for (auto& job : sendBatch.GetJobs())
+	{
+		if (!job.failed)
+		{
+			SendFrame(job.peer, job.Output());
+		}
 	}
+	sendBatch.Clear();
 }
 
 void net::Server::HandleAnyPacket(Connection* connection, Packet& packet)
 {
+	TraceScope dispatchScope(TraceStage::Dispatch, connection->GetConnectionId(), traceId);
+
 	unsigned int commandInt;
 	packet >> commandInt;
 	auto command = NetCommands(commandInt);
 
-	if (command == NetCommands::CustomCommand)
+	if (command == NetCommands::CustomCommand || command == NetCommands::CustomRequest || command == NetCommands::CustomResponse)
 	{
 		if (!connection->identified)
 		{
@@ -187,15 +344,34 @@ void net::Server::HandleAnyPacket(Connection* connection, Packet& packet)
 			}
 			SendPacket(NetCommands::NotIdentified, connection->GetPeer());
 		}
+		else if (command == NetCommands::CustomResponse)
+		{
+			HandleCustomResponse(packet, connection);
+		}
 		else
 		{
+			unsigned int requestId = 0;
+			if (command == NetCommands::CustomRequest)
+			{
+				packet >> requestId;
+			}
+
 			unsigned int customCommand;
 			packet >> customCommand;
 			if (debug)
 			{
 				logger->Debug("{} Client > Server: handling custom {} from {}", netPrefix, static_cast<int>(customCommand), NetUtils::EnetAddressToString(connection->peer->address));
 			}
-			HandleCustomPacket(customCommand, packet, connection);
+			TraceScope handlerScope(TraceStage::Handler, connection->GetConnectionId(), traceId);
+			if (command == NetCommands::CustomCommand)
+			{
+				HandleCustomPacket(customCommand, packet, connection);
+			}
+			else if (!HandleCustomRequest(customCommand, packet, connection, requestId))
+			{
+				Packet emptyPacket{};
+				SendResponse(requestId, emptyPacket, connection, RequestStatus::Unhandled);
+			}
 		}
 	}
 	else
@@ -239,6 +415,19 @@ net::Connection* net::Server::GetConnection(ENetPeer* client)
 	return nullptr;
 }
 
+unsigned net::Server::GetConnectionId(ENetPeer* client) const
+{
+	for (const auto& connection : connections)
+	{
+		if (connection.GetPeer()->connectID == client->connectID)
+		{
+			return connection.GetConnectionId();
+		}
+	}
+
+	return CONNECTION_ID_INVALID;
+}
+
 void net::Server::SendCustomPacket(unsigned command, Connection* connection)
 {
 	Packet emptyPacket{};
@@ -252,187 +441,783 @@ void net::Server::SendCustomPacket(unsigned command, Packet& packet, Connection*
 	Packet commandPacket{};
 	commandPacket << command;
 	commandPacket.Append(packet.GetData(), packet.GetDataSize());
-	SendPacket(NetCommands::CustomCommand, commandPacket, connection->GetPeer());
+	SendPacket(NetCommands::CustomCommand, commandPacket, connection->GetPeer(), GetCommandOptions(command).security);
 }
 
-unsigned net::Server::GetPort() const
+void net::Server::BroadcastCustomPacket(unsigned int command, Packet& packet)
 {
-	return this->address.port;
+	std::vector<Connection*> recipients;
+	recipients.reserve(connections.size());
+	for (auto& connection : connections)
+	{
+		if (connection.identified)
+		{
+			recipients.push_back(&connection);
+		}
+	}
+	BroadcastCustomPacket(command, packet, recipients);
 }
 
-void net::Server::SendPacket(NetCommands command, ENetPeer* client) const
+void net::Server::BroadcastCustomPacket(unsigned int command, Packet& packet, const std::vector<Connection*>& recipients)
 {
-	Packet emptyPacket{};
-	SendPacket(command, emptyPacket, client);
+	if (GetCommandOptions(command).security != SecurityLevel::Plain)
+	{
+		for (Connection* connection : recipients)
+		{
+			SendCustomPacket(command, packet, connection);
+		}
+		return;
+	}
+
+	if (server == nullptr || recipients.empty())
+	{
+		return;
+	}
+	if (debug)
+		logger->Debug("{} Client < Server: broadcasting custom {} to {} connections", netPrefix, static_cast<int>(command), recipients.size());
+
+	// The batch goes first, so the broadcast doesn't overtake packets that were sent before it.
+	Flush();
+
+	Packet commandPacket{};
+	commandPacket << static_cast<unsigned int>(NetCommands::CustomCommand);
+	commandPacket << command;
+	commandPacket.Append(packet.GetData(), packet.GetDataSize());
+
+	// One buffer for all recipients, ENet counts the references and frees it after the last send.
+	ENetPacket* epacket = enet_packet_create(commandPacket.GetData(), commandPacket.GetDataSize(), ENET_PACKET_FLAG_RELIABLE);
+	for (Connection* connection : recipients)
+	{
+		enet_peer_send(connection->GetPeer(), 0, epacket);
+	}
+	if (epacket->referenceCount == 0)
+	{
+		enet_packet_destroy(epacket);
+	}
 }
 
-void net::Server::SendPacket(NetCommands command, Packet& packet, ENetPeer* client) const
+net::RequestFuture net::Server::SendRequest(unsigned int command, Packet& packet, Connection* connection, std::chrono::milliseconds timeout)
 {
-	if (server != nullptr)
+	if (++nextRequestId == 0)
 	{
-		if (debug && command != NetCommands::CustomCommand)
-			logger->Debug("{} Client < Server: sending NetCommands {} to {}", netPrefix, GetName(command), NetUtils::EnetAddressToString(client->address));
+		nextRequestId = 1;
+	}
 
-		Packet commandPacket{};
-		commandPacket << static_cast<unsigned int>(command);
+	PendingRequests::Entry entry;
+	entry.requestId = nextRequestId;
+	entry.connectionId = connection->GetConnectionId();
+	entry.deadline = ServerTimeNow() + std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
 
-		commandPacket.Append(packet.GetData(), packet.GetDataSize());
+	RequestFuture request{ entry.requestId, entry.promise.get_future() };
+	pendingRequests.Insert(std::move(entry));
 
-		size_t size = commandPacket.GetDataSize();
-		void* data = new unsigned char[size];
-		memcpy(data, commandPacket.GetData(), size);
+	if (debug)
+		logger->Debug("{} Client < Server: sending request {} ({}) to {}", netPrefix, static_cast<int>(command), request.requestId, NetUtils::EnetAddressToString(connection->peer->address));
+	Packet commandPacket{};
+	commandPacket << request.requestId;
+	commandPacket << command;
+	commandPacket.Append(packet.GetData(), packet.GetDataSize());
+	SendPacket(NetCommands::CustomRequest, commandPacket, connection->GetPeer());
 
-#ifndef DISABLE_ENCRYPTION
-		auto it = clientKeys.find(NetUtils::EnetAddressToString(client->address));
+	return request;
+}
 
-		if (it != clientKeys.end() && it->second.dataKey.GetKey().bitSize > 0)
-		{
-			size_t encryptedSize;
-			std::unique_ptr<unsigned char[]> encryptedData;
-			std::unique_ptr<unsigned char[]> iv;
+void net::Server::SendResponse(unsigned int requestId, Packet& packet, Connection* connection, RequestStatus status)
+{
+	Packet commandPacket{};
+	commandPacket << requestId;
+	commandPacket << static_cast<unsigned int>(status);
+	commandPacket.Append(packet.GetData(), packet.GetDataSize());
+	SendPacket(NetCommands::CustomResponse, commandPacket, connection->GetPeer());
+}
 
-			auto key = it->second.dataKey;
-			size_t paddingSize;
-			key.Encrypt(static_cast<const unsigned char*>(data), size, iv, encryptedData, encryptedSize, paddingSize);
+bool net::Server::CancelRequest(unsigned int requestId)
+{
+	return pendingRequests.Cancel(requestId);
+}
+
+void net::Server::HandleCustomResponse(Packet& packet, Connection* connection)
+{
+	unsigned int requestId, status;
+	packet >> requestId >> status;
+	if (!packet)
+	{
+		return;
+	}
 
-			Packet cryptoPacket;
-			cryptoPacket << static_cast<unsigned int>(NetCommands::CryptoPacket);
-			cryptoPacket << static_cast<unsigned int>(paddingSize);
-			cryptoPacket.Append(iv.get(), net::NetAES::ivLength >> 3);
-			cryptoPacket << static_cast<unsigned int>(encryptedSize);
-			cryptoPacket.Append(encryptedData.get(), encryptedSize);
+	RequestResult result{ static_cast<RequestStatus>(status), Packet{} };
+	result.packet.Append(packet.GetData(packet.m_readPos), packet.GetDataSize() - packet.m_readPos);
 
-			delete[] static_cast<unsigned char*>(data);
+	// Late responses of requests that timed out or were cancelled are dropped.
+	pendingRequests.Resolve(requestId, connection->GetConnectionId(), std::move(result));
+}
 
-			size = cryptoPacket.GetDataSize();
-			data = new unsigned char[size];
-			memcpy(data, cryptoPacket.GetData(), size);
-		}
-#endif
-		ENetPacket* epacket = enet_packet_create(data, size, ENET_PACKET_FLAG_RELIABLE);
+void net::Server::SendServerKey(Connection* connection, const NetRSA& rsa)
+{
+	// Queued packets still point at the keys of the previous client of this address.
+	Flush();
 
-		enet_peer_send(client, 0, epacket);
+	clientKeys[NetUtils::EnetAddressToString(connection->GetPeer()->address)] = net::KeyChain{
+		rsa,
+		{ {} }
+	};
 
-		delete[] static_cast<unsigned char*>(data);
+	Packet packet;
+
+	auto& key = rsa.GetPublicKey();
+
+	auto modulusBytes = static_cast<unsigned int>(key.modBitSize >> 3);
+	auto exponentBytes = static_cast<unsigned int>(key.bitSize >> 3);
+
+	packet << modulusBytes;
+
+	for (unsigned int i = 0; i < modulusBytes; i++)
+	{
+		packet << key.modulus.get()[i];
+	}
+
+	packet << exponentBytes;
+
+	for (unsigned int i = 0; i < exponentBytes; i++)
+	{
+		packet << key.exponent.get()[i];
 	}
+
+	// Older clients stop reading after the exponent and keep using NetAES.
+	packet << NetAEAD::SupportedCiphers();
+
+	SendPacket(NetCommands::HandshakeServerKey, packet, connection->GetPeer());
 }
 
-void net::Server::HandlePacket(NetCommands command, Packet& packet, Connection* connection)
+void net::Server::SendKeyShare(Connection* connection)
 {
-	switch(command)
+	// Queued packets still point at the keys of the previous client of this address.
+	Flush();
+
+	auto& keyChain = clientKeys[NetUtils::EnetAddressToString(connection->GetPeer()->address)];
+	keyChain = net::EmptyKeyChain();
+	keyChain.keyExchange = KeyExchange::Generate();
+	if (!keyChain.keyExchange.IsValid())
 	{
-		
-	case NetCommands::HandshakeDataKey:
+		enet_peer_disconnect(connection->GetPeer(), 0);
+		return;
+	}
+
+	Packet packet;
+	packet.Append(keyChain.keyExchange.GetPublicKey(), KeyExchange::keySize);
+	packet << NetAEAD::SupportedCiphers();
+
+	SendPacket(NetCommands::HandshakeKeyShare, packet, connection->GetPeer());
+}
+
+bool net::Server::AcceptKeyShare(Connection* connection, Packet& packet, unsigned int messageId)
+{
+	TraceScope decryptScope(TraceStage::Decrypt, connection->GetConnectionId(), messageId);
+	constexpr std::size_t headerSize = sizeof(unsigned int) + KeyExchange::keySize + sizeof(unsigned char);
+
+	auto it = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+	if (it == clientKeys.end() || !it->second.keyExchange.IsValid() || packet.m_data.size() < headerSize + NetAEAD::tagSize)
 	{
-		unsigned int size;
-		packet >> size;
+		return false;
+	}
 
-		auto* encryptedData = new unsigned char[size];
+	auto* buffer = reinterpret_cast<unsigned char*>(&packet.m_data[0]);
+	const std::size_t identitySize = packet.m_data.size() - headerSize - NetAEAD::tagSize;
+	const unsigned char cipher = buffer[headerSize - 1];
 
-		for (unsigned int i = 0; i < size; i++)
+	NetAESKey key;
+	NetAEAD channelKey;
+	bool accepted = cipher != 0 && cipher < 32 && (NetAEAD::SupportedCiphers() & (1u << cipher)) != 0 &&
+		it->second.keyExchange.DeriveKey(buffer + sizeof(unsigned int), true, key);
+	it->second.keyExchange.Clear();
+
+	if (accepted)
+	{
+		channelKey = net::NetAEAD{ static_cast<AeadCipher>(cipher), key, true };
+		accepted = channelKey.Open(buffer + headerSize, identitySize, buffer, headerSize, buffer + headerSize + identitySize);
+	}
+
+	if (!accepted)
+	{
+		if (logger)
 		{
-			unsigned char byte;
-			packet >> byte;
-			encryptedData[i] = byte;
+			logger->Warn("{} Client > Server: rejected the key share of {}, disconnecting.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address));
 		}
+		enet_peer_disconnect(connection->GetPeer(), 0);
+		return false;
+	}
 
-		auto keyChain = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+	Flush();
+	it->second.channelKey = std::move(channelKey);
+
+	// Handled like an Identify, the answer is the first message encrypted with the new key.
+	Packet identify;
+	identify << static_cast<unsigned int>(NetCommands::Identify);
+	identify.Append(buffer + headerSize, identitySize);
+	packet = identify;
+	return true;
+}
+
+bool net::Server::AcceptResumption(Connection* connection, Packet& packet, unsigned int messageId)
+{
+	TraceScope decryptScope(TraceStage::Decrypt, connection->GetConnectionId(), messageId);
+	constexpr std::size_t saltSize = KeyExchange::keySize;
+
+	auto it = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+	if (ticketKeys == nullptr || it == clientKeys.end() || it->second.channelKey.IsActive() || it->second.keyExchange.IsValid() || connection->identified)
+	{
+		return false;
+	}
 
-		std::unique_ptr<unsigned char[]> decryptedData;
-		size_t decryptedDataSize;
-		keyChain->second.handshakeKey.Decrypt(encryptedData, size, decryptedData, decryptedDataSize);
+	unsigned int command, ticketSize;
+	packet >> command >> ticketSize;
+	if (!packet || packet.m_data.size() != packet.m_readPos + std::size_t{ ticketSize } + saltSize + NetAEAD::tagSize)
+	{
+		return false;
+	}
 
-		Packet decrypted;
-		decrypted.Append(decryptedData.get(), decryptedDataSize);
-		unsigned int keySize;
+	auto* buffer = reinterpret_cast<unsigned char*>(&packet.m_data[0]);
+	const unsigned char* ticket = buffer + packet.m_readPos;
+	const unsigned char* salt = ticket + ticketSize;
+	const std::size_t headerSize = packet.m_readPos + ticketSize + saltSize;
 
-		decrypted >> keySize;
+	std::vector<unsigned char> ticketData;
+	long long expiresAt = 0;
+	Packet ticketContents;
+	unsigned int ticketConnectionId = CONNECTION_ID_INVALID;
+	unsigned char cipher = 0;
+	NetAESKey key;
 
-		unsigned char* keyData = new unsigned char[keySize];
+	bool valid = ticketKeys->Open(ticket, ticketSize, ticketData, expiresAt);
+	if (valid)
+	{
+		ticketContents.Append(ticketData.data(), ticketData.size());
+		ticketContents >> ticketConnectionId;
+		valid = ticketContents && ticketContents.CheckSize(KeyExchange::keySize);
+	}
+	if (valid)
+	{
+		const auto* secret = static_cast<const unsigned char*>(ticketContents.GetData(ticketContents.m_readPos));
+		ticketContents.m_readPos += KeyExchange::keySize;
+		ticketContents >> cipher;
+
+		valid = ticketContents && ticketConnectionId == connection->GetConnectionId() &&
+			cipher != 0 && cipher < 32 && (NetAEAD::SupportedCiphers() & (1u << cipher)) != 0 &&
+			KeyExchange::ExpandKey(secret, KeyExchange::keySize, salt, saltSize, resumptionKeyInfo, key);
+	}
 
-		for (unsigned int i = 0; i < keySize; i++)
+	if (!valid)
+	{
+		// Expired, issued before a restart or for another connection: do the full handshake instead.
+		if (debug && logger != nullptr)
 		{
-			unsigned char byte;
-			decrypted >> byte;
-			keyData[i] = byte;
+			logger->Debug("{} Client > Server: {} presented an invalid session ticket.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address));
 		}
+		SendKeyShare(connection);
+		return false;
+	}
 
- 		keyChain->second.dataKey = net::NetAES{ {keySize << 3, std::shared_ptr<unsigned char>{keyData, [](unsigned char *p) { delete[] p; } }} };
+	NetAEAD channelKey{ static_cast<AeadCipher>(cipher), key, true };
+	if (!channelKey.Open(buffer + headerSize, 0, buffer, headerSize, buffer + headerSize) || !ticketKeys->Redeem(ticket, ticketSize, expiresAt))
+	{
+		if (logger)
+		{
+			logger->Warn("{} Client > Server: rejected a forged or replayed session ticket from {}, disconnecting.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address));
+		}
+		enet_peer_disconnect(connection->GetPeer(), 0);
+		return false;
+	}
 
-		delete[] encryptedData;
+	Flush();
+	it->second.channelKey = std::move(channelKey);
 
-		SendPacket(NetCommands::HandshakeSuccess, connection->GetPeer());
+	Packet resumptionData;
+	resumptionData.Append(ticketContents.GetData(ticketContents.m_readPos), ticketContents.GetDataSize() - ticketContents.m_readPos);
+	resumptions.erase(connection->GetConnectionId());
+	resumptions.emplace(connection->GetConnectionId(), std::move(resumptionData));
 
-	} break;
-	case NetCommands::CryptoPacket:
+	Packet resumeSession;
+	resumeSession << static_cast<unsigned int>(NetCommands::ResumeSession);
+	packet = resumeSession;
+	return true;
+}
+
+void net::Server::CompleteIdentification(Connection* connection, IdentifyResponse response)
+{
+	if (response == IdentifyResponse::Pending)
+	{
+		return;
+	}
+	if (response == IdentifyResponse::Success)
+	{
+		connection->identified = true;
+		this->SendPacket(NetCommands::IdentifySuccessful, connection->peer);
+		SendSessionTicket(connection);
+		OnPlayerIdentified(connection);
+	}
+	else
+	{
+		Packet failurePacket{};
+		failurePacket << static_cast<unsigned int>(response);
+		this->SendPacket(NetCommands::IdentifyFailure, failurePacket, connection->peer);
+	}
+}
+
+void net::Server::CompleteIdentification(unsigned int connectionId, IdentifyResponse response)
+{
+	Connection* connection = GetConnection(connectionId);
+	if (connection == nullptr || connection->identified)
+	{
+		return;
+	}
+	CompleteIdentification(connection, response);
+}
+
+void net::Server::SendSessionTicket(Connection* connection)
+{
+	if (ticketKeys == nullptr)
+	{
+		return;
+	}
+
+	// Only clients with a negotiated cipher can resume, older clients wouldn't understand the ticket either.
+	auto it = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+	if (it == clientKeys.end() || !it->second.channelKey.IsActive())
+	{
+		return;
+	}
+
+	unsigned char secret[KeyExchange::keySize];
+	SecureRandom::Fill(secret, sizeof(secret));
+
+	Packet resumptionData;
+	GetResumptionData(resumptionData, connection);
+
+	Packet ticketContents;
+	ticketContents << connection->GetConnectionId();
+	ticketContents.Append(secret, sizeof(secret));
+	ticketContents << static_cast<unsigned char>(it->second.channelKey.GetCipher());
+	ticketContents.Append(resumptionData.GetData(), resumptionData.GetDataSize());
+
+	const std::vector<unsigned char> ticket = ticketKeys->Seal(static_cast<const unsigned char*>(ticketContents.GetData()), ticketContents.GetDataSize());
+	if (ticket.empty())
+	{
+		return;
+	}
+
+	Packet packet;
+	packet << connection->GetConnectionId();
+	packet << static_cast<unsigned int>(ticketKeys->GetLifetime().count());
+	packet.Append(secret, sizeof(secret));
+	packet.Append(ticket.data(), ticket.size());
+	SendPacket(NetCommands::SessionTicket, packet, connection->GetPeer());
+}
+
+void net::Server::EnableSessionTickets(std::chrono::seconds lifetime)
+{
+	this->ticketKeys = std::make_shared<SessionTicketKeys>(lifetime);
+}
+
+void net::Server::ServeAwaitingHandshakes()
+{
+	if (handshakeKeys == nullptr)
+	{
+		return;
+	}
+
+	std::size_t served = 0;
+	NetRSAKey privateKey, publicKey;
+	while (served < awaitingKeys.size())
+	{
+		// The client might have disconnected while it waited.
+		Connection* connection = GetConnection(awaitingKeys[served]);
+		if (connection != nullptr)
+		{
+			if (!handshakeKeys->TryAcquire(privateKey, publicKey))
+			{
+				break;
+			}
+			SendServerKey(connection, net::NetRSA{ privateKey, publicKey });
+		}
+		served++;
+	}
+	awaitingKeys.erase(awaitingKeys.begin(), awaitingKeys.begin() + served);
+
+	std::vector<HandshakeResult> results;
 	{
-		auto it = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+		std::lock_guard<std::mutex> lock(handshakeMutex);
+		results.swap(handshakeResults);
+	}
+
+	for (auto& result : results)
+	{
+		decryptingDataKeys.erase(result.connectionId);
+		Connection* connection = GetConnection(result.connectionId);
+		if (connection != nullptr)
+		{
+			ApplyDataKey(connection, result.data.get(), result.size);
+		}
+	}
+}
 
-		if (it != clientKeys.end())
+void net::Server::ApplyDataKey(Connection* connection, const unsigned char* data, std::size_t size)
+{
+	auto keyChain = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+	// Queued packets are sealed with the keys they were sent with.
+	Flush();
+
+	Packet decrypted;
+	decrypted.Append(data, size);
+	unsigned int keySize = 0;
+
+	decrypted >> keySize;
+	if (!decrypted || keySize == 0 || !decrypted.CheckSize(keySize) || keyChain == clientKeys.end())
+	{
+		if (logger != nullptr)
 		{
-			unsigned int paddingSize;
-			packet >> paddingSize;
+			logger->Warn("{} Couldn't decrypt the data key of {}, disconnecting.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address));
+		}
+		enet_peer_disconnect(connection->GetPeer(), 0);
+		return;
+	}
+
+	unsigned char* keyData = new unsigned char[keySize];
+
+	for (unsigned int i = 0; i < keySize; i++)
+	{
+		unsigned char byte;
+		decrypted >> byte;
+		keyData[i] = byte;
+	}
+
+	keyChain->second.dataKey = net::NetAES{ {keySize << 3, std::shared_ptr<unsigned char>{keyData, [](unsigned char *p) { delete[] p; } }} };
+
+	// The cipher the client picked from the ones in HandshakeServerKey, older clients don't send it.
+	unsigned char cipher = 0;
+	decrypted >> cipher;
+	if (decrypted && cipher != 0 && cipher < 32 && (NetAEAD::SupportedCiphers() & (1u << cipher)) != 0)
+	{
+		keyChain->second.channelKey = net::NetAEAD{ static_cast<AeadCipher>(cipher), keyChain->second.dataKey.GetKey(), true };
+	}
+
+	SendPacket(NetCommands::HandshakeSuccess, connection->GetPeer());
+}
+
+void net::Server::SetHandshakeWorkers(unsigned int workerCount, std::size_t readyKeys)
+{
+	this->handshakeWorkerCount = workerCount;
+	this->readyHandshakeKeys = readyKeys;
+}
+
+unsigned net::Server::GetPort() const
+{
+	return this->address.port;
+}
+
+void net::Server::HandleTimeSync(Connection* connection, Packet& packet, long long receiveTime)
+{
+	unsigned int command;
+	Packet::Int64 clientSend, lastResponseSend, lastResponseReceive;
+	packet >> command >> clientSend >> lastResponseSend >> lastResponseReceive;
+	if (!packet || !connection->identified)
+	{
+		return;
+	}
+
+	TimeSyncState& state = timeSyncs[connection->GetConnectionId()];
+
+	// The last response and this request are a sample with the roles reversed, timed by the clock of the server.
+	// The client only tells how long it held on to the response, which can't be longer than the server saw pass.
+	const long long clientHold = clientSend - lastResponseReceive;
+	if (lastResponseSend != 0 && lastResponseSend == state.lastResponseSend && clientHold >= 0 && clientHold <= receiveTime - lastResponseSend)
+	{
+		state.clockSync.AddSample(lastResponseSend, lastResponseReceive, clientSend, receiveTime);
+
+		// ClockSync estimates client minus server, the connection converts client timestamps the other way.
+		connection->clockOffset = -state.clockSync.GetOffset();
+		connection->roundTripTime = state.clockSync.GetRoundTripTime();
+		connection->clockSynchronized = state.clockSync.IsSynchronized();
+	}
+
+	state.lastResponseSend = ServerTimeNow();
+
+	Packet response;
+	response << clientSend;
+	response << static_cast<Packet::Int64>(receiveTime);
+	response << static_cast<Packet::Int64>(state.lastResponseSend);
+	SendPacket(NetCommands::TimeSyncResponse, response, connection->GetPeer());
+}
+
+void net::Server::SendPacket(NetCommands command, ENetPeer* client) const
+{
+	Packet emptyPacket{};
+	SendPacket(command, emptyPacket, client);
+}
+
+void net::Server::SendPacket(NetCommands command, Packet& packet, ENetPeer* client, SecurityLevel security) const
+{
+	if (server != nullptr)
+	{
+		if (debug && command != NetCommands::CustomCommand)
+			logger->Debug("{} Client < Server: sending NetCommands {} to {}", netPrefix, GetName(command), NetUtils::EnetAddressToString(client->address));
+
+		const unsigned int messageId = PacketTracer::NextMessageId();
+		const unsigned int connectionId = messageId != 0 ? GetConnectionId(client) : CONNECTION_ID_INVALID;
+		TraceScope sendScope(TraceStage::Send, connectionId, messageId);
+
+		Packet commandPacket{};
+		commandPacket << static_cast<unsigned int>(command);
+
+		commandPacket.Append(packet.GetData(), packet.GetDataSize());
 
-			unsigned int ivSize = net::NetAES::ivLength >> 3;
+		Packet* frame = &commandPacket;
+#ifndef DISABLE_ENCRYPTION
+		Packet cryptoPacket;
+		auto it = security != SecurityLevel::Plain ? clientKeys.find(NetUtils::EnetAddressToString(client->address)) : clientKeys.end();
 
-			unsigned char* iv = new unsigned char[ivSize];
+		if (batchSends)
+		{
+			// The key is picked now, the handshake may change keys before the batch is flushed.
+			CryptoBatch::Job job{ client, connectionId, messageId, nullptr, nullptr, std::move(commandPacket) };
+			if (it != clientKeys.end() && it->second.channelKey.IsActive())
+			{
+				job.channelKey = &it->second.channelKey;
+				job.authenticateOnly = security == SecurityLevel::Authenticated;
+			}
+			else if (it != clientKeys.end() && it->second.dataKey.GetKey().bitSize > 0)
+			{
+				job.dataKey = &it->second.dataKey;
+			}
+			sendBatch.Add(std::move(job));
+			return;
+		}
 
-			for (unsigned int i = 0; i < ivSize; i++)
+		if (it != clientKeys.end() && it->second.channelKey.IsActive())
+		{
+			TraceScope encryptScope(TraceStage::Encrypt, connectionId, messageId);
+			const bool sealed = security == SecurityLevel::Authenticated ?
+				CryptoFrame::Authenticate(it->second.channelKey, commandPacket.GetData(), commandPacket.GetDataSize(), cryptoPacket) :
+				CryptoFrame::Seal(it->second.channelKey, commandPacket.GetData(), commandPacket.GetDataSize(), cryptoPacket);
+			if (!sealed)
+			{
+				return;
+			}
+			frame = &cryptoPacket;
+		}
+		// NetAES can't only authenticate, so authenticated commands are encrypted as well.
+		else if (it != clientKeys.end() && it->second.dataKey.GetKey().bitSize > 0)
+		{
+			TraceScope encryptScope(TraceStage::Encrypt, connectionId, messageId);
+			if (!CryptoFrame::Seal(it->second.dataKey, commandPacket.GetData(), commandPacket.GetDataSize(), cryptoPacket))
 			{
-				unsigned char byte;
-				packet >> byte;
-				iv[i] = byte;
+				return;
 			}
+			frame = &cryptoPacket;
+		}
+#endif
+		SendFrame(client, *frame);
+	}
+}
+
+void net::Server::SendFrame(ENetPeer* client, Packet& frame)
+{
+	ENetPacket* epacket = enet_packet_create(frame.GetData(), frame.GetDataSize(), ENET_PACKET_FLAG_RELIABLE);
+
+	if (enet_peer_send(client, 0, epacket) < 0)
+	{
+		// The peer disconnected, ENet only takes ownership of packets it queues.
+		enet_packet_destroy(epacket);
+	}
+}
+
+bool net::Server::DecryptPacket(Connection* connection, Packet& packet, NetCommands command, unsigned int messageId)
+{
+	const bool protectedFrame = command == NetCommands::CryptoPacket || command == NetCommands::AeadPacket || command == NetCommands::AuthenticatedPacket;
+
+	auto it = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
 
-			unsigned int encryptedSize;
-			packet >> encryptedSize;
+	if (it == clientKeys.end())
+	{
+		return !protectedFrame;
+	}
 
-			unsigned char* encryptedData = new unsigned char[encryptedSize];
+	NetAEAD& channelKey = it->second.channelKey;
+	SecurityLevel level = SecurityLevel::Plain;
 
-			for (unsigned int i = 0; i < encryptedSize; i++)
+	if (command == NetCommands::AeadPacket || command == NetCommands::AuthenticatedPacket)
+	{
+		TraceScope decryptScope(TraceStage::Decrypt, connection->GetConnectionId(), messageId);
+		const bool opened = channelKey.IsActive() &&
+			(command == NetCommands::AeadPacket ? CryptoFrame::Open(channelKey, packet) : CryptoFrame::Verify(channelKey, packet));
+		if (!opened)
+		{
+			if (logger)
 			{
-				unsigned char byte;
-				packet >> byte;
-				encryptedData[i] = byte;
+				logger->Warn("{} Client > Server: rejected a tampered or replayed packet from {}, disconnecting.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address));
 			}
+			enet_peer_disconnect(connection->GetPeer(), 0);
+			return false;
+		}
+		level = command == NetCommands::AeadPacket ? SecurityLevel::Encrypted : SecurityLevel::Authenticated;
+	}
+	else if (command == NetCommands::CryptoPacket)
+	{
+		TraceScope decryptScope(TraceStage::Decrypt, connection->GetConnectionId(), messageId);
+		if (channelKey.IsActive() || !CryptoFrame::Open(it->second.dataKey, packet))
+		{
+			return false;
+		}
+		level = SecurityLevel::Encrypted;
+	}
 
-			auto key = it->second.dataKey;
+	if (!channelKey.IsActive())
+	{
+		// NetAES connections never verified what arrived in plain, that is left as it was.
+		return true;
+	}
 
-			std::unique_ptr<unsigned char[]> decryptedData;
-			size_t decryptedSize;
-			key.Decrypt(encryptedData, encryptedSize, iv, decryptedData, decryptedSize, paddingSize);
+	// Anything protected less than its command requires could have been injected or changed by anyone on the path.
+	return level >= GetRequiredSecurity(packet);
+}
+
+net::SecurityLevel net::Server::GetRequiredSecurity(Packet& packet) const
+{
+	unsigned int customCommand = 0;
+	const NetCommands command = PeekCommand(packet, &customCommand);
+	if (command == NetCommands::CustomCommand)
+	{
+		return GetCommandOptions(customCommand).security;
+	}
+	return SecurityLevel::Encrypted;
+}
+
+NetCommands net::Server::PeekCommand(Packet& packet, unsigned int* customCommand)
+{
+	const std::size_t readPos = packet.m_readPos;
+	const bool isValid = packet.m_isValid;
+
+	unsigned int commandInt = 0;
+	packet >> commandInt;
+	if (customCommand != nullptr && NetCommands(commandInt) == NetCommands::CustomCommand)
+	{
+		packet >> *customCommand;
+	}
+	else if (customCommand != nullptr && NetCommands(commandInt) == NetCommands::CustomRequest)
+	{
+		unsigned int requestId;
+		packet >> requestId >> *customCommand;
+	}
+
+	packet.m_readPos = readPos;
+	packet.m_isValid = isValid;
+	return NetCommands(commandInt);
+}
+
+net::PacketLane net::Server::GetLane(Packet& packet) const
+{
+	unsigned int customCommand = 0;
+	const NetCommands command = PeekCommand(packet, &customCommand);
+	if (command == NetCommands::CustomResponse)
+	{
+		return PacketLane::Turn;
+	}
+	if (command != NetCommands::CustomCommand && command != NetCommands::CustomRequest)
+	{
+		return PacketLane::Control;
+	}
+	return GetCommandOptions(customCommand).lane;
+}
+
+void net::Server::RegisterCommand(unsigned int customCommand, CommandOptions options)
+{
+	commandOptions[customCommand] = options;
+}
+
+net::CommandOptions net::Server::GetCommandOptions(unsigned int customCommand) const
+{
+	auto it = commandOptions.find(customCommand);
+	if (it == commandOptions.end())
+	{
+		return CommandOptions{};
+	}
+	return it->second;
+}
 
-			delete[] iv;
-			delete[] encryptedData;
+void net::Server::HandlePacket(NetCommands command, Packet& packet, Connection* connection)
+{
+	switch(command)
+	{
+		
+	case NetCommands::HandshakeDataKey:
+	{
+		unsigned int size;
+		packet >> size;
+		auto keyChain = clientKeys.find(NetUtils::EnetAddressToString(connection->GetPeer()->address));
+		if (!packet || !packet.CheckSize(size) || keyChain == clientKeys.end())
+		{
+			break;
+		}
 
-			Packet decryptedPacket;
-			decryptedPacket.Append(decryptedData.get(), decryptedSize);
+		// Every RSA decryption is expensive, so a client gets exactly one and the workers only take a limited amount at once.
+		const unsigned int connectionId = connection->GetConnectionId();
+		const bool duplicate = keyChain->second.dataKey.GetKey().bitSize > 0 || decryptingDataKeys.count(connectionId) != 0;
+		if (duplicate || (handshakeWorkers != nullptr && decryptingDataKeys.size() >= maxDecryptingDataKeys))
+		{
+			if (logger != nullptr)
+			{
+				logger->Warn("{} {} {}, disconnecting.", netPrefix, NetUtils::EnetAddressToString(connection->GetPeer()->address),
+					duplicate ? "sent its data key more than once" : "can't be handshaked, too many data keys are being decrypted");
+			}
+			enet_peer_disconnect(connection->GetPeer(), 0);
+			break;
+		}
 
-			unsigned int commandInt;
-			decryptedPacket >> commandInt;
+		std::vector<unsigned char> encryptedData(size);
 
-			Packet trimmedPacket;
-			trimmedPacket << commandInt;
-			trimmedPacket.Append(decryptedPacket.GetData(sizeof(unsigned int)), decryptedPacket.GetDataSize() - sizeof(unsigned int));
+		for (unsigned int i = 0; i < size; i++)
+		{
+			packet >> encryptedData[i];
+		}
 
-			HandleAnyPacket(connection, trimmedPacket);
+		if (handshakeWorkers == nullptr)
+		{
+			std::unique_ptr<unsigned char[]> decryptedData;
+			size_t decryptedDataSize;
+			keyChain->second.handshakeKey.Decrypt(encryptedData.data(), size, decryptedData, decryptedDataSize);
+			ApplyDataKey(connection, decryptedData.get(), decryptedDataSize);
+			break;
 		}
+
+		// The private key operation runs on a worker, ServeAwaitingHandshakes() applies the key on this thread.
+		decryptingDataKeys.insert(connectionId);
+		handshakeWorkers->Submit([this, connectionId, rsa = keyChain->second.handshakeKey, encryptedData = std::move(encryptedData)]() mutable
+		{
+			HandshakeResult result{ connectionId, nullptr, 0 };
+			rsa.Decrypt(encryptedData.data(), encryptedData.size(), result.data, result.size);
+
+			std::lock_guard<std::mutex> lock(handshakeMutex);
+			handshakeResults.push_back(std::move(result));
+		});
+
 	} break;
 	case NetCommands::Identify:
 	{
-		auto response = this->IdentifyClient(packet, connection);
-		if (response == IdentifyResponse::Success)
-		{
-			connection->identified = true;
-			this->SendPacket(NetCommands::IdentifySuccessful, connection->peer);
-			OnPlayerIdentified(connection);
-		}
-		else
+		CompleteIdentification(connection, this->IdentifyClient(packet, connection));
+	}
+	break;
+
+	case NetCommands::ResumeSession:
+	{
+		// Only present when AcceptResumption(..) verified the ticket, a ResumeSession sent over the channel is ignored.
+		auto resumption = resumptions.find(connection->GetConnectionId());
+		if (resumption == resumptions.end())
 		{
-			Packet failurePacket{};
-			failurePacket << static_cast<unsigned int>(response);
-			this->SendPacket(NetCommands::IdentifyFailure, failurePacket, connection->peer);
+			break;
 		}
+		Packet resumptionData{ std::move(resumption->second) };
+		resumptions.erase(resumption);
+
+		CompleteIdentification(connection, this->ResumeClient(resumptionData, connection));
 	}
 	break;
 
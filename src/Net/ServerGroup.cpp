@@ -0,0 +1,141 @@
+#include "Net/ServerGroup.h"
+#include "Net/Server.h"
+
+#include <algorithm>
+#include <cstdio>
+
+net::ServerGroup::ServerGroup(ServerFactory factory) : factory(std::move(factory))
+{
+}
+
+net::ServerGroup::~ServerGroup()
+{
+	Stop();
+}
+
+bool net::ServerGroup::Start(unsigned short port, unsigned short maxSessions, unsigned int shardCount)
+{
+	if (running)
+	{
+		return true;
+	}
+
+	if (shardCount == 0)
+	{
+		shardCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+#ifndef __linux__
+	if (shardCount > 1)
+	{
+		fprintf(stderr, "SO_REUSEPORT sharding is only supported on Linux, starting a single shard.\n");
+		shardCount = 1;
+	}
+#endif
+
+	for (unsigned int i = 0; i < shardCount; i++)
+	{
+		auto shard = std::make_unique<Shard>();
+		shard->server = factory(i);
+		shard->server->group = this;
+		shard->server->shardIndex = i;
+		shard->server->SetReusePort(shardCount > 1);
+		if (i > 0 && shard->server->ticketKeys != nullptr && shards.front()->server->ticketKeys != nullptr)
+		{
+			// A reconnecting client can land on any shard.
+			shard->server->ticketKeys = shards.front()->server->ticketKeys;
+		}
+		shard->server->StartServer(port, maxSessions);
+		if (!shard->server->IsStarted())
+		{
+			// A shard without a host would make its thread spin, ReceivePackets(..) returns right away.
+			fprintf(stderr, "Failed to start shard %u on port %u, stopping the server group.\n", i, static_cast<unsigned int>(port));
+			shards.clear();
+			return false;
+		}
+		shards.push_back(std::move(shard));
+	}
+
+	running = true;
+
+	for (auto& shard : shards)
+	{
+		shard->thread = std::thread(&ServerGroup::RunShard, this, std::ref(*shard));
+	}
+	return true;
+}
+
+void net::ServerGroup::Stop()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	running = false;
+
+	for (auto& shard : shards)
+	{
+		if (shard->thread.joinable())
+		{
+			shard->thread.join();
+		}
+	}
+
+	shards.clear();
+}
+
+net::Server* net::ServerGroup::GetShard(unsigned int shardIndex) const
+{
+	if (shardIndex >= shards.size())
+	{
+		return nullptr;
+	}
+	return shards[shardIndex]->server.get();
+}
+
+void net::ServerGroup::SendToShard(unsigned int sourceShard, unsigned int targetShard, const Packet& packet)
+{
+	if (targetShard >= shards.size())
+	{
+		return;
+	}
+
+	Shard& shard = *shards[targetShard];
+	std::lock_guard<std::mutex> lock(shard.inboxMutex);
+	shard.inbox.emplace_back(sourceShard, packet);
+}
+
+void net::ServerGroup::Broadcast(unsigned int sourceShard, const Packet& packet)
+{
+	for (unsigned int i = 0; i < shards.size(); i++)
+	{
+		if (i != sourceShard)
+		{
+			SendToShard(sourceShard, i, packet);
+		}
+	}
+}
+
+void net::ServerGroup::RunShard(Shard& shard)
+{
+	std::vector<std::pair<unsigned int, Packet>> inbox;
+
+	while (running)
+	{
+		shard.server->ReceivePackets(serviceTimeout);
+
+		{
+			std::lock_guard<std::mutex> lock(shard.inboxMutex);
+			inbox.swap(shard.inbox);
+		}
+
+		for (auto& message : inbox)
+		{
+			shard.server->HandleShardPacket(message.first, message.second);
+		}
+		inbox.clear();
+
+		shard.server->HandlePackets();
+	}
+}
@@ -0,0 +1,112 @@
+#include "Utility/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int workerCount)
+{
+	workers.reserve(workerCount);
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	if (workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::ParallelFor(std::size_t count, const std::function<void(std::size_t)>& job)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	struct Batch
+	{
+		std::atomic<std::size_t> next{ 0 };
+		std::atomic<std::size_t> done{ 0 };
+		std::mutex mutex{};
+		std::condition_variable finished{};
+	};
+	// Shared, because a worker may only get to its share after all indices are done and this call returned.
+	auto batch = std::make_shared<Batch>();
+
+	auto run = [batch, count, &job]()
+	{
+		std::size_t ran = 0;
+		for (std::size_t i = batch->next++; i < count; i = batch->next++)
+		{
+			job(i);
+			ran++;
+		}
+		// The last index to finish wakes the caller. job is only used before done reaches count.
+		if (ran > 0 && batch->done.fetch_add(ran) + ran == count)
+		{
+			std::lock_guard<std::mutex> lock(batch->mutex);
+			batch->finished.notify_all();
+		}
+	};
+
+	const std::size_t helpers = std::min<std::size_t>(workers.size(), count - 1);
+	for (std::size_t i = 0; i < helpers; i++)
+	{
+		Submit(run);
+	}
+	run();
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished.wait(lock, [&batch, count]() { return batch->done.load() == count; });
+}
+
+unsigned int ThreadPool::DefaultWorkerCount() noexcept
+{
+	const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+			{
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
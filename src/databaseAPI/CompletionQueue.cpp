@@ -0,0 +1,39 @@
+#include "CompletionQueue.h"
+#include <utility>
+#include <iterator>
+
+void db::CompletionQueue::Post(std::function<void()> completion)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	completions.push_back(std::move(completion));
+}
+
+std::size_t db::CompletionQueue::Drain(std::size_t maxCompletions)
+{
+	std::deque<std::function<void()>> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (maxCompletions == 0 || maxCompletions >= completions.size())
+		{
+			ready.swap(completions);
+		}
+		else
+		{
+			ready.assign(std::make_move_iterator(completions.begin()), std::make_move_iterator(completions.begin() + maxCompletions));
+			completions.erase(completions.begin(), completions.begin() + maxCompletions);
+		}
+	}
+
+	// Completions run without the lock, they may start new calls that post again.
+	for (auto& completion : ready)
+	{
+		completion();
+	}
+	return ready.size();
+}
+
+bool db::CompletionQueue::Empty() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return completions.empty();
+}
@@ -0,0 +1,205 @@
+#include "ConnectionPool.h"
+#include <algorithm>
+#include <utility>
+#include <errmsg.h>
+
+db::ConnectionPool::Lease::Lease(ConnectionPool* pool, std::unique_ptr<PooledConnection> pooled) : pool(pool), pooled(std::move(pooled))
+{
+}
+
+db::ConnectionPool::Lease::Lease(Lease&& other) noexcept : pool(other.pool), pooled(std::move(other.pooled))
+{
+	other.pool = nullptr;
+}
+
+db::ConnectionPool::Lease& db::ConnectionPool::Lease::operator=(Lease&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (this->pool != nullptr && this->pooled)
+		{
+			this->pool->Release(std::move(this->pooled));
+		}
+		this->pool = other.pool;
+		this->pooled = std::move(other.pooled);
+		other.pool = nullptr;
+	}
+	return *this;
+}
+
+db::ConnectionPool::Lease::~Lease()
+{
+	if (this->pool != nullptr && this->pooled)
+	{
+		this->pool->Release(std::move(this->pooled));
+	}
+}
+
+db::ConnectionPool::ConnectionPool(DatabaseCredentials credentials, PoolOptions options) : credentials(std::move(credentials)), options(options)
+{
+	this->options.maxConnections = std::max<std::size_t>(this->options.maxConnections, 1);
+	this->options.minConnections = std::min(this->options.minConnections, this->options.maxConnections);
+
+	this->account = mariadb::account::create(
+		this->credentials.host,
+		this->credentials.username,
+		this->credentials.password,
+		this->credentials.database,
+		this->credentials.port
+	);
+}
+
+bool db::ConnectionPool::Open()
+{
+	bool connected = true;
+	while (GetSize() < this->options.minConnections)
+	{
+		auto pooled = std::make_unique<PooledConnection>();
+		pooled->connection = mariadb::connection::create(this->account);
+		pooled->statements = StatementCache{ pooled->connection };
+		if (!Connect(*pooled))
+		{
+			connected = false;
+			break;
+		}
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->idle.push_back(std::move(pooled));
+		++this->size;
+	}
+	return connected;
+}
+
+db::ConnectionPool::Lease db::ConnectionPool::Acquire()
+{
+	const auto deadline = std::chrono::steady_clock::now() + this->options.acquireTimeout;
+
+	while (true)
+	{
+		std::unique_ptr<PooledConnection> pooled;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			const bool available = this->released.wait_until(lock, deadline, [this]()
+			{
+				return !this->idle.empty() || this->size < this->options.maxConnections;
+			});
+			if (!available)
+			{
+				throw mariadb::exception::connection(CR_CONNECTION_ERROR, "Timed out waiting for a pooled database connection.");
+			}
+
+			if (!this->idle.empty())
+			{
+				// The most recently used connection is the least likely to have timed out.
+				pooled = std::move(this->idle.back());
+				this->idle.pop_back();
+			}
+			else
+			{
+				++this->size;
+			}
+		}
+
+		if (!pooled)
+		{
+			pooled = std::make_unique<PooledConnection>();
+			pooled->connection = mariadb::connection::create(this->account);
+			pooled->statements = StatementCache{ pooled->connection };
+		}
+
+		// Connecting and pinging happen outside the lock, other threads keep borrowing meanwhile.
+		if (CheckHealth(*pooled))
+		{
+			return Lease{ this, std::move(pooled) };
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			--this->size;
+		}
+		this->released.notify_one();
+
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			throw mariadb::exception::connection(CR_CONNECTION_ERROR, "Failed to connect a pooled database connection.");
+		}
+		std::unique_lock<std::mutex> lock(this->mutex);
+		const auto retryAt = std::min(this->nextConnectAttempt, deadline);
+		lock.unlock();
+		std::this_thread::sleep_until(retryAt);
+	}
+}
+
+std::size_t db::ConnectionPool::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->size;
+}
+
+std::size_t db::ConnectionPool::GetIdleCount() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->idle.size();
+}
+
+void db::ConnectionPool::Release(std::unique_ptr<PooledConnection> pooled)
+{
+	pooled->lastUsed = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->idle.push_back(std::move(pooled));
+	}
+	this->released.notify_one();
+}
+
+bool db::ConnectionPool::CheckHealth(PooledConnection& pooled)
+{
+	if (pooled.lastUsed != std::chrono::steady_clock::time_point{})
+	{
+		if (std::chrono::steady_clock::now() - pooled.lastUsed < this->options.healthCheckInterval)
+		{
+			return true;
+		}
+		if (pooled.connection->connected())
+		{
+			return true;
+		}
+		// The server dropped the session, its prepared statements are gone as well.
+		pooled.statements.Clear();
+		pooled.connection->disconnect();
+	}
+	return Connect(pooled);
+}
+
+bool db::ConnectionPool::Connect(PooledConnection& pooled)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (std::chrono::steady_clock::now() < this->nextConnectAttempt)
+		{
+			return false;
+		}
+	}
+
+	bool connected = false;
+	try
+	{
+		connected = pooled.connection->connect();
+	}
+	catch (const mariadb::exception::base&)
+	{
+		connected = false;
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (connected)
+	{
+		this->backoff = std::chrono::milliseconds{ 0 };
+		pooled.lastUsed = std::chrono::steady_clock::now();
+		return true;
+	}
+
+	this->backoff = std::min(this->options.maxReconnectBackoff, std::max(this->options.reconnectBackoff, this->backoff * 2));
+	this->nextConnectAttempt = std::chrono::steady_clock::now() + this->backoff;
+	return false;
+}
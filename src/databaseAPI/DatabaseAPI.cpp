@@ -1,46 +1,83 @@
 #include "DatabaseAPI.h"
+#include <algorithm>
 #include <utility>
 #include "LoggingFunction.h"
+#include "RowMapper.h"
 #include <windows.h>
 
-inline tbsg::Card* GetCard(unsigned int cardId, ptl::sparse_set<unsigned int, tbsg::Card>& cards)
+db::DatabaseAPI::DatabaseAPI(DatabaseCredentials credentials, unsigned int projectId, PoolOptions poolOptions) : projectId(projectId), credentials(std::move(credentials)), poolOptions(poolOptions)
 {
-	return &cards.at(cardId);
 }
 
-db::DatabaseAPI::DatabaseAPI(DatabaseCredentials credentials, unsigned int projectId) : projectId(projectId), credentials(std::move(credentials))
+db::DatabaseAPI::~DatabaseAPI()
 {
+	this->asyncWorkers.reset();
 }
 
-void db::DatabaseAPI::OpenDatabaseConnection()
+db::DatabaseAPI& db::DatabaseAPI::operator=(DatabaseAPI&& other)
 {
-	this->account = mariadb::account::create(
-		this->credentials.host,
-		this->credentials.username,
-		this->credentials.password,
-		this->credentials.database,
-		this->credentials.port
-	);
-	this->connection = mariadb::connection::create(this->account);
-	try{
-		if(!this->connection->connect())
+	if (this != &other)
+	{
+		// Same order as the destructor: nothing may still use the old pool once it is replaced.
+		this->asyncWorkers.reset();
+		this->writeBehind.reset();
+
+		this->projectId = other.projectId;
+		this->credentials = std::move(other.credentials);
+		this->poolOptions = other.poolOptions;
+		this->pool = std::move(other.pool);
+		this->completions = std::move(other.completions);
+		this->writeBehind = std::move(other.writeBehind);
+		this->asyncWorkers = std::move(other.asyncWorkers);
+		this->databasePrefix = std::move(other.databasePrefix);
+	}
+	return *this;
+}
+
+void db::DatabaseAPI::EnableWriteBehind(WriteBehindOptions options, WriteBehindQueue::FailureCallback onFailure)
+{
+	assert(this->pool != nullptr);
+	if (!onFailure)
+	{
+		onFailure = [prefix = this->databasePrefix](const std::string& description, const std::exception& exception)
 		{
-			cof::Error("{} Failed to connect to database!", databasePrefix);
-			assert(false);
-		}
-	}catch(std::exception e)
+			cof::Error("{} Dropped queued writes, {} failed: {}", prefix, description, exception.what());
+		};
+	}
+	this->writeBehind = std::make_unique<WriteBehindQueue>(*this->pool, options, std::move(onFailure));
+}
+
+void db::DatabaseAPI::FlushWrites() const
+{
+	if (this->writeBehind)
+	{
+		this->writeBehind->Flush();
+	}
+}
+
+void db::DatabaseAPI::OpenDatabaseConnection()
+{
+	this->pool = std::make_shared<ConnectionPool>(this->credentials, this->poolOptions);
+	if(!this->pool->Open())
 	{
 		cof::Error("{} Failed to connect to database!", databasePrefix);
 		assert(false);
 	}
-	cof::Info("{} Connected to database!", databasePrefix);
+	cof::Info("{} Connected to database with {} connections!", databasePrefix, this->pool->GetSize());
+
+	// More workers than connections would only wait for a lease.
+	this->asyncWorkers = std::make_unique<ThreadPool>(static_cast<unsigned int>(this->poolOptions.maxConnections));
 }
 
 unsigned db::DatabaseAPI::GetProfileId(const ptl::string& token) const
 {
-	mariadb::statement_ref tokenStatement = connection->create_statement("SELECT * FROM `sessions` WHERE `token`=?;");
-	tokenStatement->set_string(0, std::string(token));
-	mariadb::result_set_ref tokenResult = tokenStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref tokenResult = statements.Query("SELECT * FROM `sessions` WHERE `token`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_string(0, std::string(token));
+	});
 
 	if (tokenResult->row_count() <= 0)
 	{
@@ -54,9 +91,13 @@ unsigned db::DatabaseAPI::GetProfileId(const ptl::string& token) const
 
 tbsg::Profile db::DatabaseAPI::GetProfile(unsigned profileId) const
 {
-	mariadb::statement_ref profileStatement = connection->create_statement("SELECT * FROM `profiles` WHERE `id`=?;");
-	profileStatement->set_unsigned32(0, profileId);
-	mariadb::result_set_ref profileResult = profileStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref profileResult = statements.Query("SELECT * FROM `profiles` WHERE `id`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, profileId);
+	});
 
 	tbsg::Profile profile{};
 
@@ -76,48 +117,69 @@ tbsg::Profile db::DatabaseAPI::GetProfile(unsigned profileId) const
 
 ptl::sparse_set<unsigned int, tbsg::Card> db::DatabaseAPI::GetCards() const
 {
-	mariadb::statement_ref cardsStatement = connection->create_statement("SELECT * FROM `cards` WHERE `projectId`=?;");
-	cardsStatement->set_unsigned32(0, this->projectId);
-	mariadb::result_set_ref cardsResult = cardsStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref cardsResult = statements.QueryUnbuffered("SELECT * FROM `cards` WHERE `projectId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, this->projectId);
+	});
 
 	ptl::sparse_set<unsigned int, tbsg::Card> cards;
-	cards.reserve(cardsResult->row_count());
 
-	auto handleCardEffects = [](tbsg::Card& card, tbsg::BaseEffect effect, int value)
+	auto mapper = MakeRowMapper<tbsg::Card>(
+		Column("id", &tbsg::Card::id),
+		Column("name", &tbsg::Card::meta, &tbsg::MetaData::name),
+		Column("description", &tbsg::Card::meta, &tbsg::MetaData::description),
+		Column("cardRarityId", &tbsg::Card::meta, &tbsg::MetaData::rarity),
+		Column("cardTypeId", &tbsg::Card::meta, &tbsg::MetaData::type));
+	mapper.Bind(*cardsResult);
+
+	struct EffectColumn
 	{
-		if (value != 0)
-		{
-			card.data.baseCardEffects.emplace_back(tbsg::BaseCardEffects{ effect, value });
-		}
+		tbsg::BaseEffect effect;
+		const char* name;
 	};
+	static const EffectColumn effectColumns[] = {
+		{ tbsg::BaseEffect::MonsterDamage, "monsterDamage" },
+		{ tbsg::BaseEffect::OpponentDamage, "opponentDamage" },
+		{ tbsg::BaseEffect::SelfDamage, "selfDamage" },
 
-	while (cardsResult->next())
-	{
-		tbsg::Card card;
+		{ tbsg::BaseEffect::MonsterHealth, "monsterHealth" },
+		{ tbsg::BaseEffect::OpponentHealth, "opponentHealth" },
+		{ tbsg::BaseEffect::SelfHealth, "selfHealth" },
 
-		card.id = cardsResult->get_unsigned32("id");
-		card.meta.name = cardsResult->get_string("name");
-		card.meta.description = cardsResult->get_string("description");
-		card.meta.rarity = cardsResult->get_unsigned32("cardRarityId");
-		card.meta.type = cardsResult->get_unsigned32("cardTypeId");
+		{ tbsg::BaseEffect::MonsterArmor, "monsterArmor" },
+		{ tbsg::BaseEffect::OpponentArmor, "opponentArmor" },
+		{ tbsg::BaseEffect::SelfArmor, "selfArmor" },
 
-		handleCardEffects(card, tbsg::BaseEffect::MonsterDamage, cardsResult->get_signed32("monsterDamage"));
-		handleCardEffects(card, tbsg::BaseEffect::OpponentDamage, cardsResult->get_signed32("opponentDamage"));
-		handleCardEffects(card, tbsg::BaseEffect::SelfDamage, cardsResult->get_signed32("selfDamage"));
+		{ tbsg::BaseEffect::OpponentDrawCard, "opponentDraw" },
+		{ tbsg::BaseEffect::SelfDrawCard, "selfDraw" },
 
-		handleCardEffects(card, tbsg::BaseEffect::MonsterHealth, cardsResult->get_signed32("monsterHealth"));
-		handleCardEffects(card, tbsg::BaseEffect::OpponentHealth, cardsResult->get_signed32("opponentHealth"));
-		handleCardEffects(card, tbsg::BaseEffect::SelfHealth, cardsResult->get_signed32("selfHealth"));
+		{ tbsg::BaseEffect::OpponentDiscardCard, "opponentDiscard" },
+		{ tbsg::BaseEffect::SelfDiscardCard, "selfDiscard" },
+	};
+	constexpr std::size_t effectCount = sizeof(effectColumns) / sizeof(effectColumns[0]);
 
-		handleCardEffects(card, tbsg::BaseEffect::MonsterArmor, cardsResult->get_signed32("monsterArmor"));
-		handleCardEffects(card, tbsg::BaseEffect::OpponentArmor, cardsResult->get_signed32("opponentArmor"));
-		handleCardEffects(card, tbsg::BaseEffect::SelfArmor, cardsResult->get_signed32("selfArmor"));
+	mariadb::u32 effectIndices[effectCount];
+	for (std::size_t i = 0; i < effectCount; i++)
+	{
+		effectIndices[i] = cardsResult->column_index(effectColumns[i].name);
+	}
 
-		handleCardEffects(card, tbsg::BaseEffect::OpponentDrawCard, cardsResult->get_signed32("opponentDraw"));
-		handleCardEffects(card, tbsg::BaseEffect::SelfDrawCard, cardsResult->get_signed32("selfDraw"));
+	while (cardsResult->next())
+	{
+		tbsg::Card card;
+		mapper.Fill(*cardsResult, card);
 
-		handleCardEffects(card, tbsg::BaseEffect::OpponentDiscardCard, cardsResult->get_signed32("opponentDiscard"));
-		handleCardEffects(card, tbsg::BaseEffect::SelfDiscardCard, cardsResult->get_signed32("selfDiscard"));
+		for (std::size_t i = 0; i < effectCount; i++)
+		{
+			const int value = cardsResult->get_signed32(effectIndices[i]);
+			if (value != 0)
+			{
+				card.data.baseCardEffects.emplace_back(tbsg::BaseCardEffects{ effectColumns[i].effect, value });
+			}
+		}
 
 		cards.insert(card.id, card);
 	}
@@ -127,23 +189,30 @@ ptl::sparse_set<unsigned int, tbsg::Card> db::DatabaseAPI::GetCards() const
 
 ptl::sparse_set<unsigned, tbsg::MonsterCard> db::DatabaseAPI::GetMonsterCards() const
 {
-	mariadb::statement_ref cardsStatement = connection->create_statement("SELECT * FROM `monsters` WHERE `projectId`=?;");
-	cardsStatement->set_unsigned32(0, this->projectId);
-	mariadb::result_set_ref cardsResult = cardsStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref cardsResult = statements.Query("SELECT * FROM `monsters` WHERE `projectId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, this->projectId);
+	});
 
 	ptl::sparse_set<unsigned int, tbsg::MonsterCard> cards;
 	cards.reserve(cardsResult->row_count());
 
+	auto mapper = MakeRowMapper<tbsg::MonsterCard>(
+		Column("id", &tbsg::MonsterCard::id),
+		Column("name", &tbsg::MonsterCard::meta, &tbsg::MetaData::name),
+		Column("description", &tbsg::MonsterCard::meta, &tbsg::MetaData::description),
+		Column("maxHealth", &tbsg::MonsterCard::data, &tbsg::MonsterData::maxHealth),
+		Column("trait", &tbsg::MonsterCard::data, &tbsg::MonsterData::monsterTrait));
+	mapper.Bind(*cardsResult);
+
 	while (cardsResult->next())
 	{
 		tbsg::MonsterCard card;
-
-		card.id = cardsResult->get_unsigned32("id");
-		card.meta.name = cardsResult->get_string("name");
-		card.meta.description = cardsResult->get_string("description");
-		card.data.maxHealth = cardsResult->get_unsigned32("maxHealth");
+		mapper.Fill(*cardsResult, card);
 		card.data.health = card.data.maxHealth;
-		card.data.monsterTrait = cardsResult->get_unsigned32("trait");
 
 		cards.insert(card.id, card);
 	}
@@ -153,17 +222,21 @@ ptl::sparse_set<unsigned, tbsg::MonsterCard> db::DatabaseAPI::GetMonsterCards()
 
 ptl::sparse_set<unsigned, tbsg::CardType> db::DatabaseAPI::GetCardTypes() const
 {
-	mariadb::result_set_ref cardTypesResult = connection->query("SELECT * FROM `cardTypes`;");
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref cardTypesResult = statements.Query("SELECT * FROM `cardTypes`;");
 
 	ptl::sparse_set<unsigned, tbsg::CardType> cardTypes;
 	cardTypes.reserve(cardTypesResult->row_count());
 
+	auto mapper = MakeRowMapper<tbsg::CardType>(Column("id", &tbsg::CardType::id), Column("name", &tbsg::CardType::name));
+	mapper.Bind(*cardTypesResult);
+
 	while (cardTypesResult->next())
 	{
 		tbsg::CardType type{};
-
-		type.id = cardTypesResult->get_unsigned32("id");
-		type.name = cardTypesResult->get_string("name");
+		mapper.Fill(*cardTypesResult, type);
 
 		cardTypes.insert(type.id, type);
 	}
@@ -173,17 +246,21 @@ ptl::sparse_set<unsigned, tbsg::CardType> db::DatabaseAPI::GetCardTypes() const
 
 ptl::sparse_set<unsigned, tbsg::CardRarity> db::DatabaseAPI::GetCardRarities() const
 {
-	mariadb::result_set_ref cardRarityResult = connection->query("SELECT * FROM `cardRarity`;");
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref cardRarityResult = statements.Query("SELECT * FROM `cardRarity`;");
 
 	ptl::sparse_set<unsigned, tbsg::CardRarity> cardRarities;
 	cardRarities.reserve(cardRarityResult->row_count());
 
+	auto mapper = MakeRowMapper<tbsg::CardRarity>(Column("id", &tbsg::CardRarity::id), Column("name", &tbsg::CardRarity::name));
+	mapper.Bind(*cardRarityResult);
+
 	while (cardRarityResult->next())
 	{
 		tbsg::CardRarity rarity{};
-
-		rarity.id = cardRarityResult->get_unsigned32("id");
-		rarity.name = cardRarityResult->get_string("name");
+		mapper.Fill(*cardRarityResult, rarity);
 
 		cardRarities.insert(rarity.id, rarity);
 	}
@@ -193,28 +270,81 @@ ptl::sparse_set<unsigned, tbsg::CardRarity> db::DatabaseAPI::GetCardRarities() c
 
 ptl::vector<tbsg::Deck> db::DatabaseAPI::GetDecksOfProfile(unsigned int profileId, ptl::sparse_set<unsigned int, tbsg::Card>& cards) const
 {
-	mariadb::statement_ref deckStatement = connection->create_statement("SELECT * FROM `decks` WHERE `profileId`=? AND `projectId`=?;");
-	deckStatement->set_unsigned32(0, profileId);
-	deckStatement->set_unsigned32(1, this->projectId);
-	mariadb::result_set_ref deckResult = deckStatement->query();
+	const CardIndex<tbsg::Card> cardIndex{ cards };
+	auto decks = GetDecksOfProfiles(ptl::vector<unsigned int>{ profileId }, cardIndex);
+	return std::move(decks[profileId]);
+}
+
+ptl::unordered_map<unsigned int, ptl::vector<tbsg::Deck>> db::DatabaseAPI::GetDecksOfProfiles(const ptl::vector<unsigned int>& profileIds, const CardIndex<tbsg::Card>& cards) const
+{
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
 
-	ptl::vector<tbsg::Deck> decks{};
-	decks.reserve(deckResult->row_count());
+	ptl::unordered_map<unsigned int, ptl::vector<tbsg::Deck>> decks{};
+	decks.reserve(profileIds.size());
 
-	while (deckResult->next())
+	// Every amount of profiles is its own cached statement, so large batches are split into a few fixed sizes.
+	for (std::size_t first = 0; first < profileIds.size(); first += maxProfilesPerQuery)
 	{
-		tbsg::Deck deck;
+		const std::size_t count = std::min(maxProfilesPerQuery, profileIds.size() - first);
 
-		deck.id = deckResult->get_unsigned32("id");
-		deck.name = deckResult->get_string("name");
+		std::string placeholders = "?";
+		for (std::size_t i = 1; i < count; i++)
+		{
+			placeholders += ", ?";
+		}
 
-		const mariadb::result_set_ref cardsResult = connection->query(std::string("SELECT * FROM `deckCardRelation` WHERE `deckId`=" + ptl::to_string(deck.id) + ";" ));
-		while (cardsResult->next())
+		// Decks without cards still have one row, with a NULL cardId.
+		const mariadb::result_set_ref deckResult = statements.Query(
+			"SELECT `decks`.`id`, `decks`.`profileId`, `decks`.`name`, `deckCardRelation`.`cardId` FROM `decks` "
+			"LEFT JOIN `deckCardRelation` ON `deckCardRelation`.`deckId` = `decks`.`id` "
+			"WHERE `decks`.`projectId`=? AND `decks`.`profileId` IN (" + placeholders + ") "
+			"ORDER BY `decks`.`profileId`, `decks`.`id`;",
+			[&](mariadb::statement_ref& statement)
+			{
+				statement->set_unsigned32(0, this->projectId);
+				for (std::size_t i = 0; i < count; i++)
+				{
+					statement->set_unsigned32(static_cast<mariadb::u32>(i + 1), profileIds[first + i]);
+				}
+			});
+
+		for (std::size_t i = 0; i < count; i++)
 		{
-			deck.cards.push_back(GetCard(cardsResult->get_unsigned32("cardId"), cards));
+			decks[profileIds[first + i]];
 		}
 
-		decks.push_back(deck);
+		ptl::vector<tbsg::Deck>* profileDecks = nullptr;
+		unsigned int currentProfile = 0;
+		while (deckResult->next())
+		{
+			const unsigned int profileId = deckResult->get_unsigned32("profileId");
+			const unsigned int deckId = deckResult->get_unsigned32("id");
+			if (profileDecks == nullptr || profileId != currentProfile)
+			{
+				profileDecks = &decks[profileId];
+				currentProfile = profileId;
+			}
+			if (profileDecks->empty() || profileDecks->back().id != deckId)
+			{
+				tbsg::Deck deck;
+				deck.id = deckId;
+				deck.name = deckResult->get_string("name");
+				profileDecks->push_back(std::move(deck));
+			}
+
+			if (deckResult->get_is_null("cardId"))
+			{
+				continue;
+			}
+			tbsg::Card* card = cards.Find(deckResult->get_unsigned32("cardId"));
+			if (card == nullptr)
+			{
+				cof::Warn("{} Deck {} contains card {} that isn't loaded.", databasePrefix, static_cast<int>(deckId), static_cast<int>(deckResult->get_unsigned32("cardId")));
+				continue;
+			}
+			profileDecks->back().cards.push_back(card);
+		}
 	}
 
 	return decks;
@@ -222,10 +352,14 @@ ptl::vector<tbsg::Deck> db::DatabaseAPI::GetDecksOfProfile(unsigned int profileI
 
 tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(unsigned id, ptl::sparse_set<unsigned, tbsg::MonsterCard>& cards) const
 {
-	mariadb::statement_ref deckStatement = connection->create_statement("SELECT * FROM `monsterDecks` WHERE `id`=? AND `projectId`=?;");
-	deckStatement->set_unsigned32(0, id);
-	deckStatement->set_unsigned32(1, this->projectId);
-	mariadb::result_set_ref deckResult = deckStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref deckResult = statements.Query("SELECT * FROM `monsterDecks` WHERE `id`=? AND `projectId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, id);
+		statement->set_unsigned32(1, this->projectId);
+	});
 
 	tbsg::MonsterDeck deck{};
 
@@ -238,7 +372,10 @@ tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(unsigned id, ptl::sparse_set<u
 	deck.id = deckResult->get_unsigned32("id");
 	deck.name = deckResult->get_string("name");
 
-	const mariadb::result_set_ref cardsResult = connection->query(std::string("SELECT * FROM `monsterDeckRelation` WHERE `deckId`=" + ptl::to_string(deck.id) + ";"));
+	const mariadb::result_set_ref cardsResult = statements.Query("SELECT * FROM `monsterDeckRelation` WHERE `deckId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, deck.id);
+	});
 	while (cardsResult->next())
 	{
 		deck.cards.push_back(&cards.at(cardsResult->get_unsigned32("id")));
@@ -249,10 +386,14 @@ tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(unsigned id, ptl::sparse_set<u
 
 tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(const ptl::string& name, ptl::sparse_set<unsigned, tbsg::MonsterCard>& cards) const
 {
-	mariadb::statement_ref deckStatement = connection->create_statement("SELECT * FROM `monsterDecks` WHERE `name`=? AND `projectId`=?;");
-	deckStatement->set_string(0, std::string(name));
-	deckStatement->set_unsigned32(1, this->projectId);
-	mariadb::result_set_ref deckResult = deckStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref deckResult = statements.Query("SELECT * FROM `monsterDecks` WHERE `name`=? AND `projectId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_string(0, std::string(name));
+		statement->set_unsigned32(1, this->projectId);
+	});
 
 	tbsg::MonsterDeck deck{};
 
@@ -267,7 +408,10 @@ tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(const ptl::string& name, ptl::
 	deck.id = deckResult->get_unsigned32("id");
 	deck.name = deckResult->get_string("name");
 
-	const mariadb::result_set_ref cardsResult = connection->query(std::string("SELECT * FROM `monsterDeckRelation` WHERE `deckId`=" + ptl::to_string(deck.id) + ";"));
+	const mariadb::result_set_ref cardsResult = statements.Query("SELECT * FROM `monsterDeckRelation` WHERE `deckId`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, deck.id);
+	});
 	while (cardsResult->next())
 	{
 		deck.cards.push_back(&cards.at(cardsResult->get_unsigned32("monsterId")));
@@ -278,82 +422,140 @@ tbsg::MonsterDeck db::DatabaseAPI::GetMonsterDeck(const ptl::string& name, ptl::
 
 void db::DatabaseAPI::GetMonsterDecks(ptl::sparse_set<unsigned int, tbsg::MonsterDeck>& monsterDecks,ptl::sparse_set<unsigned int, tbsg::MonsterCard>& cards) const
 {
-	mariadb::statement_ref deckStatement = connection->create_statement("SELECT monsterDecks.*,monsterDeckRelation.monsterId as monsterId FROM monsterDecks INNER JOIN monsterDeckRelation ON monsterDeckRelation.deckId = monsterDecks.id WHERE projectId = ?");
-	deckStatement->set_unsigned32(0, this->projectId);
-	mariadb::result_set_ref deckResults = deckStatement->query();
+	const ptl::vector<UnlinkedMonsterDeck> decks = GetUnlinkedMonsterDecks();
+	LinkMonsterDecks(decks, monsterDecks, cards);
+	cof::Debug("Found {} monster decks", decks.size());
+}
+
+ptl::vector<db::UnlinkedMonsterDeck> db::DatabaseAPI::GetUnlinkedMonsterDecks() const
+{
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
 
-	if (deckResults->row_count() <= 0)
+	mariadb::result_set_ref deckResults = statements.Query("SELECT monsterDecks.*,monsterDeckRelation.monsterId as monsterId FROM monsterDecks INNER JOIN monsterDeckRelation ON monsterDeckRelation.deckId = monsterDecks.id WHERE projectId = ?", [&](mariadb::statement_ref& statement)
 	{
-		return;
-	}
-	monsterDecks.reserve(deckResults->row_count());
+		statement->set_unsigned32(0, this->projectId);
+	});
+
+	ptl::vector<UnlinkedMonsterDeck> decks{};
+	// Every card of a deck is a row, the decks keep the order of their first row.
+	ptl::unordered_map<unsigned int, std::size_t> deckIndices{};
 	while (deckResults->next())
 	{
-		if(!monsterDecks.has(deckResults->get_unsigned32("id"))){
-			tbsg::MonsterDeck deck{ };
-			deck.id = deckResults->get_unsigned32("id");
+		const unsigned int deckId = deckResults->get_unsigned32("id");
+		auto it = deckIndices.find(deckId);
+		if (it == deckIndices.end())
+		{
+			it = deckIndices.emplace(deckId, decks.size()).first;
+			UnlinkedMonsterDeck deck{};
+			deck.id = deckId;
 			deck.name = deckResults->get_string("name");
-			deck.cards.push_back(&cards.at(deckResults->get_unsigned32("monsterId")));
-			monsterDecks.insert(deck.id, deck);
-		}else
+			decks.push_back(std::move(deck));
+		}
+		decks[it->second].monsterCardIds.push_back(deckResults->get_unsigned32("monsterId"));
+	}
+
+	return decks;
+}
+
+void db::DatabaseAPI::LinkMonsterDecks(const ptl::vector<UnlinkedMonsterDeck>& decks, ptl::sparse_set<unsigned int, tbsg::MonsterDeck>& monsterDecks, ptl::sparse_set<unsigned int, tbsg::MonsterCard>& cards)
+{
+	const CardIndex<tbsg::MonsterCard> cardIndex{ cards };
+	monsterDecks.reserve(monsterDecks.size() + decks.size());
+	for (const UnlinkedMonsterDeck& unlinked : decks)
+	{
+		const bool exists = monsterDecks.has(unlinked.id);
+		tbsg::MonsterDeck newDeck{};
+		tbsg::MonsterDeck& deck = exists ? monsterDecks.at(unlinked.id) : newDeck;
+		deck.id = unlinked.id;
+		deck.name = unlinked.name;
+		for (unsigned int cardId : unlinked.monsterCardIds)
+		{
+			tbsg::MonsterCard* card = cardIndex.Find(cardId);
+			if (card != nullptr)
+			{
+				deck.cards.push_back(card);
+			}
+		}
+		if (!exists)
 		{
-			auto& deckRef = monsterDecks.at(deckResults->get_unsigned32("id"));
-			deckRef.cards.push_back(&cards.at(deckResults->get_unsigned32("monsterId")));
+			monsterDecks.insert(newDeck.id, std::move(newDeck));
 		}
 	}
-	cof::Debug("Found {} monster decks", deckResults->row_count());
 }
 
 void db::DatabaseAPI::GetScriptsForCards(
 	ptl::sparse_set<unsigned, tbsg::Script>& scripts) const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.QueryUnbuffered(
 		"SELECT scripts.*, cards.name as scriptName,cards.id as cardId FROM `scripts` \
 		INNER JOIN scriptCardRelation ON scriptCardRelation.scriptId = scripts.id\
 		INNER JOIN cards ON scriptCardRelation.cardId = cards.id\
 		WHERE cards.projectId = 1 AND(scripts.id, scripts.revision) IN(SELECT scripts.id, MAX(scripts.revision) revision FROM scripts GROUP BY scripts.id)"
 	);
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
-	if (scriptResult->row_count() <= 0)
-	{
-		return;
-	}
+
+	auto mapper = MakeRowMapper<tbsg::Script>(
+		Column("id", &tbsg::Script::id),
+		Column("cardId", &tbsg::Script::cardId),
+		Column("scriptName", &tbsg::Script::name),
+		Column("content", &tbsg::Script::code),
+		Column("revision", &tbsg::Script::revision));
+	mapper.Bind(*scriptResult);
+
 	while (scriptResult->next())
 	{
-		scripts.insert(scriptResult->get_unsigned32("cardId"), { scriptResult->get_unsigned32("id"),scriptResult->get_unsigned32("cardId"),0 ,scriptResult->get_string("scriptName"),scriptResult->get_string("content") });
+		tbsg::Script script{};
+		mapper.Fill(*scriptResult, script);
+		scripts.insert(script.cardId, std::move(script));
 	}
 }
 
 void db::DatabaseAPI::GetScriptsForMonsterCards(ptl::sparse_set<unsigned int, tbsg::Script>& scripts) const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.QueryUnbuffered(
 		"SELECT scripts.*, monsters.name as scriptName,monsters.id as monsterId FROM `scripts` \
 		INNER JOIN scriptMonsterRelation ON scriptMonsterRelation.scriptId = scripts.id \
 		INNER JOIN monsters ON scriptMonsterRelation.monsterId = monsters.id \
 		WHERE monsters.projectId = 1 AND(scripts.id, scripts.revision) IN(SELECT scripts.id, MAX(scripts.revision) revision FROM scripts GROUP BY scripts.id)"
 	);
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
-	if (scriptResult->row_count() <= 0)
-	{
-		return;
-	}
+
+	auto mapper = MakeRowMapper<tbsg::Script>(
+		Column("id", &tbsg::Script::id),
+		Column("monsterId", &tbsg::Script::monsterCardId),
+		Column("scriptName", &tbsg::Script::name),
+		Column("content", &tbsg::Script::code),
+		Column("revision", &tbsg::Script::revision));
+	mapper.Bind(*scriptResult);
+
 	while(scriptResult->next())
 	{
-		scripts.insert(scriptResult->get_unsigned32("monsterId"), { scriptResult->get_unsigned32("id"),0,scriptResult->get_unsigned32("monsterId") ,scriptResult->get_string("scriptName"),scriptResult->get_string("content") });
+		tbsg::Script script{};
+		mapper.Fill(*scriptResult, script);
+		scripts.insert(script.monsterCardId, std::move(script));
 	}
 }
 
 tbsg::Script db::DatabaseAPI::GetScriptForCard(unsigned cardId) const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.Query(
 		"SELECT scripts.id,scripts.content,scripts.revision FROM scripts			\
 		INNER JOIN scriptCardRelation ON scripts.id = scriptCardRelation.scriptId	\
 		WHERE scriptCardRelation.cardId = ?											\
 		ORDER BY revision DESC														\
-		LIMIT 1;"
-	);
-	scriptStatement->set_unsigned32(0, cardId);
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
+		LIMIT 1;",
+		[&](mariadb::statement_ref& statement)
+		{
+			statement->set_unsigned32(0, cardId);
+		});
 
 	tbsg::Script script{};
 
@@ -368,21 +570,26 @@ tbsg::Script db::DatabaseAPI::GetScriptForCard(unsigned cardId) const
 	script.id = scriptResult->get_unsigned32("id");
 	script.cardId = cardId;
 	script.code = scriptResult->get_string("content");
+	script.revision = scriptResult->get_unsigned32("revision");
 
 	return script;
 }
 
 tbsg::Script db::DatabaseAPI::GetScriptForMonsterCard(unsigned cardId) const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.Query(
 		"SELECT scripts.id,scripts.content,scripts.revision FROM scripts				\
 		INNER JOIN scriptMonsterRelation ON scripts.id = scriptMonsterRelation.scriptId	\
 		WHERE scriptMonsterRelation.monsterId = ?										\
 		ORDER BY revision DESC															\
-		LIMIT 1;"
-	);
-	scriptStatement->set_unsigned32(0, cardId);
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
+		LIMIT 1;",
+		[&](mariadb::statement_ref& statement)
+		{
+			statement->set_unsigned32(0, cardId);
+		});
 
 	tbsg::Script script{};
 
@@ -397,32 +604,40 @@ tbsg::Script db::DatabaseAPI::GetScriptForMonsterCard(unsigned cardId) const
 	script.id = scriptResult->get_unsigned32("id");
 	script.monsterCardId = cardId;
 	script.code = scriptResult->get_string("content");
+	script.revision = scriptResult->get_unsigned32("revision");
 
 	return script;
 }
 
 ptl::vector<tbsg::Script> db::DatabaseAPI::GetOtherScripts() const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.QueryUnbuffered(
 		"SELECT scripts.*, scriptOtherRelation.name FROM scripts							\
 		INNER JOIN scriptOtherRelation ON scripts.id = scriptOtherRelation.scriptId			\
 		WHERE scriptOtherRelation.projectId = ?												\
-		AND(id, revision) IN(SELECT id, MAX(revision) revision FROM scripts GROUP BY id);"
-	);
-	scriptStatement->set_unsigned32(0, this->projectId);
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
+		AND(id, revision) IN(SELECT id, MAX(revision) revision FROM scripts GROUP BY id);",
+		[&](mariadb::statement_ref& statement)
+		{
+			statement->set_unsigned32(0, this->projectId);
+		});
 
 	ptl::vector<tbsg::Script> scripts{};
 
+	auto mapper = MakeRowMapper<tbsg::Script>(
+		Column("id", &tbsg::Script::id),
+		Column("name", &tbsg::Script::name),
+		Column("content", &tbsg::Script::code),
+		Column("revision", &tbsg::Script::revision));
+	mapper.Bind(*scriptResult);
+
 	while (scriptResult->next())
 	{
-		tbsg::Script script;
-
-		script.id = scriptResult->get_unsigned32("id");
-		script.name = scriptResult->get_string("name");
-		script.code = scriptResult->get_string("content");
-
-		scripts.push_back(script);
+		tbsg::Script script{};
+		mapper.Fill(*scriptResult, script);
+		scripts.push_back(std::move(script));
 	}
 
 	return scripts;
@@ -430,15 +645,19 @@ ptl::vector<tbsg::Script> db::DatabaseAPI::GetOtherScripts() const
 
 tbsg::Script db::DatabaseAPI::GetOtherScript(const ptl::string& scriptName) const
 {
-	mariadb::statement_ref scriptStatement = connection->create_statement(
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref scriptResult = statements.Query(
 		"SELECT scripts.id,scripts.content,scripts.revision FROM scripts				\
 		INNER JOIN scriptOtherRelation ON scripts.id = scriptOtherRelation.scriptId		\
 		WHERE scriptOtherRelation.name = ?												\
 		ORDER BY revision DESC															\
-		LIMIT 1;"
-	);
-	scriptStatement->set_string(0, std::string(scriptName));
-	const mariadb::result_set_ref scriptResult = scriptStatement->query();
+		LIMIT 1;",
+		[&](mariadb::statement_ref& statement)
+		{
+			statement->set_string(0, std::string(scriptName));
+		});
 
 	tbsg::Script script{};
 
@@ -453,15 +672,87 @@ tbsg::Script db::DatabaseAPI::GetOtherScript(const ptl::string& scriptName) cons
 	script.id = scriptResult->get_unsigned32("id");
 	script.name = scriptName;
 	script.code = scriptResult->get_string("content");
+	script.revision = scriptResult->get_unsigned32("revision");
 
 	return script;
 }
 
+ptl::unordered_map<unsigned int, unsigned int> db::DatabaseAPI::GetLatestScriptRevisions() const
+{
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	const mariadb::result_set_ref revisionResult = statements.Query("SELECT `id`, MAX(`revision`) AS `revision` FROM `scripts` GROUP BY `id`;");
+
+	ptl::unordered_map<unsigned int, unsigned int> revisions{};
+	revisions.reserve(revisionResult->row_count());
+
+	while (revisionResult->next())
+	{
+		revisions[revisionResult->get_unsigned32("id")] = revisionResult->get_unsigned32("revision");
+	}
+
+	return revisions;
+}
+
+ptl::vector<tbsg::Script> db::DatabaseAPI::GetLatestScripts(const ptl::vector<unsigned int>& scriptIds) const
+{
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	ptl::vector<tbsg::Script> scripts{};
+	scripts.reserve(scriptIds.size());
+
+	// Every amount of scripts is its own cached statement, so large batches are split into a few fixed sizes.
+	for (std::size_t first = 0; first < scriptIds.size(); first += maxScriptsPerQuery)
+	{
+		const std::size_t count = std::min(maxScriptsPerQuery, scriptIds.size() - first);
+
+		std::string placeholders = "?";
+		for (std::size_t i = 1; i < count; i++)
+		{
+			placeholders += ", ?";
+		}
+
+		const mariadb::result_set_ref scriptResult = statements.QueryUnbuffered(
+			"SELECT `id`, `content`, `revision` FROM `scripts` "
+			"WHERE `id` IN (" + placeholders + ") "
+			"AND (`id`, `revision`) IN (SELECT `id`, MAX(`revision`) FROM `scripts` WHERE `id` IN (" + placeholders + ") GROUP BY `id`);",
+			[&](mariadb::statement_ref& statement)
+			{
+				for (std::size_t i = 0; i < count; i++)
+				{
+					statement->set_unsigned32(static_cast<mariadb::u32>(i), scriptIds[first + i]);
+					statement->set_unsigned32(static_cast<mariadb::u32>(count + i), scriptIds[first + i]);
+				}
+			});
+
+		auto mapper = MakeRowMapper<tbsg::Script>(
+			Column("id", &tbsg::Script::id),
+			Column("content", &tbsg::Script::code),
+			Column("revision", &tbsg::Script::revision));
+		mapper.Bind(*scriptResult);
+
+		while (scriptResult->next())
+		{
+			tbsg::Script script{};
+			mapper.Fill(*scriptResult, script);
+			scripts.push_back(std::move(script));
+		}
+	}
+
+	return scripts;
+}
+
 ptl::vector<tbsg::Server> db::DatabaseAPI::GetAvailableServers(bool production) const
 {
-	mariadb::statement_ref serverStatement = connection->create_statement("SELECT * FROM `servers` WHERE `occupied`=0 AND `production`=? AND `lastOnline` > NOW() - INTERVAL 15 SECOND;");
-	serverStatement->set_unsigned32(0, production ? 1 : 0);
-	mariadb::result_set_ref serverResult = serverStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref serverResult = statements.Query("SELECT * FROM `servers` WHERE `occupied`=0 AND `production`=? AND `lastOnline` > NOW() - INTERVAL 15 SECOND;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, production ? 1 : 0);
+	});
 
 	ptl::vector<tbsg::Server> servers{};
 
@@ -481,34 +772,58 @@ ptl::vector<tbsg::Server> db::DatabaseAPI::GetAvailableServers(bool production)
 
 unsigned db::DatabaseAPI::RegisterServer(const std::string& ip, unsigned port, ptl::string hostname, bool production) const
 {
-	mariadb::statement_ref serverStatement = connection->create_statement("INSERT INTO `servers` (`hostname`, `ip`, `port`, `production`, `lastOnline`) VALUES (?, ?, ?, ?, NOW());");
-	if(hostname.empty())
-	{
-		serverStatement->set_null(0);
-	}
-	else
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	return static_cast<unsigned int>(statements.Insert("INSERT INTO `servers` (`hostname`, `ip`, `port`, `production`, `lastOnline`) VALUES (?, ?, ?, ?, NOW());", [&](mariadb::statement_ref& statement)
 	{
-		serverStatement->set_string(0, std::string(hostname));
-	}
-	serverStatement->set_string(1, std::string(ip));
-	serverStatement->set_unsigned32(2, port);
-	serverStatement->set_unsigned32(3, production ? 1 : 0);
-	return static_cast<unsigned int>(serverStatement->insert());
+		if(hostname.empty())
+		{
+			statement->set_null(0);
+		}
+		else
+		{
+			statement->set_string(0, std::string(hostname));
+		}
+		statement->set_string(1, std::string(ip));
+		statement->set_unsigned32(2, port);
+		statement->set_unsigned32(3, production ? 1 : 0);
+	}));
 }
 
 void db::DatabaseAPI::PingServer(unsigned serverId) const
 {
-	mariadb::statement_ref serverStatement = connection->create_statement("UPDATE `servers` SET `lastOnline`=NOW() WHERE `id`=?;");
-	serverStatement->set_unsigned32(0, serverId);
-	serverStatement->execute();
+	if (this->writeBehind)
+	{
+		this->writeBehind->PingServer(serverId);
+		return;
+	}
+
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	statements.Execute("UPDATE `servers` SET `lastOnline`=NOW() WHERE `id`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, serverId);
+	});
 }
 
 void db::DatabaseAPI::SetServerOccupied(unsigned serverId, bool isOccupied) const
 {
-	mariadb::statement_ref serverStatement = connection->create_statement("UPDATE `servers` SET `occupied`=?, `lastOnline`=NOW() WHERE `id`=?;");
-	serverStatement->set_unsigned32(0, isOccupied ? 1 : 0);
-	serverStatement->set_unsigned32(1, serverId);
-	serverStatement->execute();
+	if (this->writeBehind)
+	{
+		this->writeBehind->SetServerOccupied(serverId, isOccupied);
+		return;
+	}
+
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	statements.Execute("UPDATE `servers` SET `occupied`=?, `lastOnline`=NOW() WHERE `id`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, isOccupied ? 1 : 0);
+		statement->set_unsigned32(1, serverId);
+	});
 }
 
 void db::DatabaseAPI::RegisterIp(unsigned profileId, const ptl::string& ip) const
@@ -518,67 +833,100 @@ void db::DatabaseAPI::RegisterIp(unsigned profileId, const ptl::string& ip) cons
 
 void db::DatabaseAPI::RegisterIp(unsigned profileId, unsigned serverId, const ptl::string& ip) const
 {
-	mariadb::statement_ref ipStatement = connection->create_statement("INSERT INTO `ipLog` (`profileId`, `serverId`, `ip`, `date`) VALUES (?, ?, ?, NOW());");
-	ipStatement->set_unsigned32(0, profileId);
-	if(serverId == 0)
+	if (this->writeBehind)
 	{
-		ipStatement->set_null(1);
+		this->writeBehind->RegisterIp(profileId, serverId, std::string(ip));
+		return;
 	}
-	else
+
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	statements.Execute("INSERT INTO `ipLog` (`profileId`, `serverId`, `ip`, `date`) VALUES (?, ?, ?, NOW());", [&](mariadb::statement_ref& statement)
 	{
-		ipStatement->set_unsigned32(1, serverId);
-	}
-	ipStatement->set_string(2, ip);
-	ipStatement->execute();
+		statement->set_unsigned32(0, profileId);
+		if(serverId == 0)
+		{
+			statement->set_null(1);
+		}
+		else
+		{
+			statement->set_unsigned32(1, serverId);
+		}
+		statement->set_string(2, ip);
+	});
 }
 
 // ReSharper disable once CppConstValueFunctionReturnType
 const tbsg::Match db::DatabaseAPI::RegisterMatch(tbsg::Match match) const
 {
-	mariadb::statement_ref matchStatement = connection->create_statement("INSERT INTO `matches` (`ownerProfileId`, `ownerDeckId`, `opponentProfileId`, `opponentDeckId`, `serverId`, `createdDate`) VALUES (?, ?, ?, ?, ?, NOW());");
-	matchStatement->set_unsigned32(0, match.ownerProfileId);
-	matchStatement->set_unsigned32(1, match.ownerDeckId);
-	if(match.opponentProfileId == 0)
-	{
-		matchStatement->set_null(2);
-	}
-	else
-	{
-		matchStatement->set_unsigned32(2, match.opponentProfileId);
-	}
-	if(match.opponentDeckId == 0)
-	{
-		matchStatement->set_null(3);
-	}
-	else
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	match.id = static_cast<unsigned int>(statements.Insert("INSERT INTO `matches` (`ownerProfileId`, `ownerDeckId`, `opponentProfileId`, `opponentDeckId`, `serverId`, `createdDate`) VALUES (?, ?, ?, ?, ?, NOW());", [&](mariadb::statement_ref& statement)
 	{
-		matchStatement->set_unsigned32(3, match.opponentDeckId);
-	}
-	matchStatement->set_unsigned32(4, match.serverId);
-	match.id = static_cast<unsigned int>(matchStatement->insert());
+		statement->set_unsigned32(0, match.ownerProfileId);
+		statement->set_unsigned32(1, match.ownerDeckId);
+		if(match.opponentProfileId == 0)
+		{
+			statement->set_null(2);
+		}
+		else
+		{
+			statement->set_unsigned32(2, match.opponentProfileId);
+		}
+		if(match.opponentDeckId == 0)
+		{
+			statement->set_null(3);
+		}
+		else
+		{
+			statement->set_unsigned32(3, match.opponentDeckId);
+		}
+		statement->set_unsigned32(4, match.serverId);
+	}));
 	return match;
 }
 
 void db::DatabaseAPI::StartMatch(unsigned matchId) const
 {
-	mariadb::statement_ref matchStatement = connection->create_statement("UPDATE `matches` SET `startDate`=NOW() WHERE `id`=?;");
-	matchStatement->set_unsigned32(0, matchId);
-	matchStatement->execute();
+	// Never queued, GetNextMatchForServer(..) would return the match again until the start was flushed.
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	statements.Execute("UPDATE `matches` SET `startDate`=NOW() WHERE `id`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, matchId);
+	});
 }
 
 void db::DatabaseAPI::EndMatch(unsigned matchId) const
 {
-	mariadb::statement_ref matchStatement = connection->create_statement("UPDATE `matches` SET `endDate`=NOW() WHERE `id`=?;");
-	matchStatement->set_unsigned32(0, matchId);
-	matchStatement->execute();
+	if (this->writeBehind)
+	{
+		this->writeBehind->EndMatch(matchId);
+		return;
+	}
+
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	statements.Execute("UPDATE `matches` SET `endDate`=NOW() WHERE `id`=?;", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, matchId);
+	});
 }
 
 // ReSharper disable once CppConstValueFunctionReturnType
 const tbsg::Match db::DatabaseAPI::GetNextMatchForServer(unsigned serverId) const
 {
-	mariadb::statement_ref matchStatement = connection->create_statement("SELECT * FROM `matches` WHERE `matches`.`startDate` IS NULL  AND `matches`.`endDate` IS NULL AND `matches`.`serverId`=? LIMIT 1");
-	matchStatement->set_unsigned32(0, serverId);
-	mariadb::result_set_ref matchResult = matchStatement->query();
+	ConnectionPool::Lease lease = pool->Acquire();
+	StatementCache& statements = lease.GetStatements();
+
+	mariadb::result_set_ref matchResult = statements.Query("SELECT * FROM `matches` WHERE `matches`.`startDate` IS NULL  AND `matches`.`endDate` IS NULL AND `matches`.`serverId`=? LIMIT 1", [&](mariadb::statement_ref& statement)
+	{
+		statement->set_unsigned32(0, serverId);
+	});
 
 	tbsg::Match match{};
 
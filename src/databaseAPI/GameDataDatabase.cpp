@@ -1,10 +1,12 @@
 #include "GameDataDatabase.h"
+#include "GameDataSnapshot.h"
 #include "Net/Packet.h"
 #ifdef _WIN32
 #include <filesystem>
 #else
 #include <experimental/filesystem>
 #endif
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include "LoggingFunction.h"
@@ -15,55 +17,269 @@ void tbsg::GameDataDatabase::Initialize(db::DatabaseAPI* api)
 
 	cof::Info("[GameDataDatabase] Loading GameData from the database...");
 
-	cof::Debug("[GameDataDatabase] Loading Cards from the database...");
-	this->cards = api->GetCards();
-	cof::Debug("[GameDataDatabase] Loading MonsterCards from the database...");
-	this->monsterCards = api->GetMonsterCards();
-	cof::Debug("[GameDataDatabase] Loading MonsterCardsDecks from the database...");
-	LoadMonsterDecks();
-	cof::Debug("[GameDataDatabase] Loading CardTypes from the database...");
-	this->cardTypes = api->GetCardTypes();
-	cof::Debug("[GameDataDatabase] Loading CardRarities from the database...");
-	this->cardRarity = api->GetCardRarities();
-
-	cof::Debug("[GameDataDatabase] Loading CardScripts from the database...");
-	this->scripts.reserve(GetCards().size() + GetMonsterCards().size());
-    api->GetScriptsForCards(this->scripts);
-	/*
-	for (const Card& card : GetCards())
+	// Every table is loaded on its own database worker and pooled connection, so loading takes about as long as the slowest query.
+	// The scripts are started first because they are the largest. The monster decks are linked to the monster cards once both arrived.
+	auto cardScriptsResult = api->RunAsync([](const db::DatabaseAPI& database)
 	{
-		Script script = api->GetScriptForCard(card.id);
-		if(script.id != 0)
+		ptl::sparse_set<unsigned int, Script> scripts{};
+		database.GetScriptsForCards(scripts);
+		return scripts;
+	});
+	auto monsterCardScriptsResult = api->RunAsync([](const db::DatabaseAPI& database)
+	{
+		ptl::sparse_set<unsigned int, Script> scripts{};
+		database.GetScriptsForMonsterCards(scripts);
+		return scripts;
+	});
+	auto otherScriptsResult = api->Async(&db::DatabaseAPI::GetOtherScripts);
+	auto cardsResult = api->Async(&db::DatabaseAPI::GetCards);
+	auto monsterCardsResult = api->Async(&db::DatabaseAPI::GetMonsterCards);
+	auto monsterDecksResult = api->Async(&db::DatabaseAPI::GetUnlinkedMonsterDecks);
+	auto cardTypesResult = api->Async(&db::DatabaseAPI::GetCardTypes);
+	auto cardRaritiesResult = api->Async(&db::DatabaseAPI::GetCardRarities);
+
+	this->cards = cardsResult.get();
+	this->cardIndex.Build(this->cards);
+	cof::Debug("[GameDataDatabase] Loaded {} Cards.", this->cards.size());
+	this->monsterCards = monsterCardsResult.get();
+	cof::Debug("[GameDataDatabase] Loaded {} MonsterCards.", this->monsterCards.size());
+	db::DatabaseAPI::LinkMonsterDecks(monsterDecksResult.get(), this->monsterDecks, this->monsterCards);
+	cof::Debug("[GameDataDatabase] Loaded {} MonsterCardsDecks.", this->monsterDecks.size());
+	this->cardTypes = cardTypesResult.get();
+	cof::Debug("[GameDataDatabase] Loaded {} CardTypes.", this->cardTypes.size());
+	this->cardRarity = cardRaritiesResult.get();
+	cof::Debug("[GameDataDatabase] Loaded {} CardRarities.", this->cardRarity.size());
+
+	// Merged in the order they were loaded in before.
+	ptl::sparse_set<unsigned int, Script> cardScripts = cardScriptsResult.get();
+	ptl::sparse_set<unsigned int, Script> monsterCardScripts = monsterCardScriptsResult.get();
+	ptl::vector<Script> otherScripts = otherScriptsResult.get();
+	this->scripts.reserve(this->scripts.size() + cardScripts.size() + monsterCardScripts.size() + otherScripts.size());
+	for (auto* loaded : { &cardScripts, &monsterCardScripts })
+	{
+		for (std::size_t i = 0; i < loaded->keys.size(); i++)
 		{
-			this->scripts.insert(script.id, script);
+			this->scripts.insert(loaded->keys[i], std::move(loaded->values[i]));
 		}
-	}*/
-	cof::Debug("[GameDataDatabase] Loading MonsterCardScripts from the database...");
-	api->GetScriptsForMonsterCards(this->scripts);
-	/*
-	for (const MonsterCard& card : GetMonsterCards())
+	}
+	for (tbsg::Script& script : otherScripts)
 	{
-		Script script = api->GetScriptForMonsterCard(card.id);
 		if (script.id != 0)
 		{
 			this->scripts.insert(script.id, script);
 		}
-	}*/
-	cof::Debug("[GameDataDatabase] Loading other scripts from the database...");
-	for (tbsg::Script& script : api->GetOtherScripts())
+	}
+	cof::Debug("[GameDataDatabase] Loaded {} scripts.", this->scripts.size());
+
+	cof::Info("[GameDataDatabase] Done loading from database.");
+}
+
+bool tbsg::GameDataDatabase::Initialize(db::DatabaseAPI* api, const std::string& snapshotPath, bool validate)
+{
+	std::unique_ptr<GameDataSnapshot> snapshot = GameDataSnapshot::Open(snapshotPath);
+	if (snapshot != nullptr && snapshot->GetProjectId() != api->GetProjectId())
 	{
-		if (script.id != 0)
+		cof::Warn("[GameDataDatabase] Snapshot {} belongs to project {}, not {}.", snapshotPath, snapshot->GetProjectId(), api->GetProjectId());
+		snapshot.reset();
+	}
+	if (snapshot != nullptr && validate)
+	{
+		try
 		{
-			this->scripts.insert(script.id, script);
+			if (!snapshot->HasLatestScripts(api->GetLatestScriptRevisions()))
+			{
+				snapshot.reset();
+			}
+		}
+		catch (const std::exception& exception)
+		{
+			// The snapshot is there to start without the database, so it is still used.
+			cof::Warn("[GameDataDatabase] Could not validate snapshot {}, using it anyway: {}", snapshotPath, exception.what());
 		}
 	}
 
-	cof::Info("[GameDataDatabase] Done loading from database.");
+	if (snapshot == nullptr)
+	{
+		Initialize(api);
+		return false;
+	}
+
+	this->api = api;
+	cof::Info("[GameDataDatabase] Loading GameData from snapshot {}...", snapshotPath);
+	snapshot->Load(*this);
+	cof::Info("[GameDataDatabase] Done loading from snapshot.");
+	return true;
+}
+
+bool tbsg::GameDataDatabase::SaveSnapshot(const std::string& path) const
+{
+	return GameDataSnapshot::Write(*this, this->api->GetProjectId(), path);
+}
+
+void tbsg::GameDataDatabase::EnableRefresh(std::chrono::milliseconds interval)
+{
+	this->refreshInterval = interval;
+	this->lastRefresh = std::chrono::steady_clock::now();
+}
+
+void tbsg::GameDataDatabase::Update()
+{
+	if (this->refreshInterval.count() <= 0 || std::chrono::steady_clock::now() - this->lastRefresh < this->refreshInterval)
+	{
+		return;
+	}
+	Refresh();
+}
+
+void tbsg::GameDataDatabase::Refresh()
+{
+	if (this->refreshing)
+	{
+		return;
+	}
+	this->refreshing = true;
+	this->lastRefresh = std::chrono::steady_clock::now();
+
+	// The worker gets its own copy of the revisions, the scripts themselves are only touched on this thread.
+	ptl::unordered_map<unsigned int, unsigned int> knownRevisions{};
+	knownRevisions.reserve(this->scripts.size());
+	for (const Script& script : this->scripts)
+	{
+		knownRevisions[script.id] = script.revision;
+	}
+
+	// The completion may be drained after this database was destroyed, it is dropped then.
+	std::weak_ptr<bool> lifetime = this->lifetime;
+	try
+	{
+		api->RunAsync([knownRevisions](const db::DatabaseAPI& database)
+		{
+			RefreshedData refreshed{};
+			refreshed.cards = database.GetCards();
+			refreshed.monsterCards = database.GetMonsterCards();
+
+			ptl::vector<unsigned int> changedScripts{};
+			for (const auto& pair : database.GetLatestScriptRevisions())
+			{
+				auto it = knownRevisions.find(pair.first);
+				if (it != knownRevisions.end() && it->second != pair.second)
+				{
+					changedScripts.push_back(pair.first);
+				}
+			}
+			if (!changedScripts.empty())
+			{
+				refreshed.scripts = database.GetLatestScripts(changedScripts);
+			}
+			return refreshed;
+		}, [this, lifetime](std::future<RefreshedData> result)
+		{
+			if (lifetime.expired())
+			{
+				return;
+			}
+			this->refreshing = false;
+			try
+			{
+				RefreshedData refreshed = result.get();
+				ApplyRefresh(refreshed);
+			}
+			catch (const std::exception& exception)
+			{
+				cof::Error("[GameDataDatabase] Failed to refresh the game data: {}", exception.what());
+			}
+		});
+	}
+	catch (const std::exception& exception)
+	{
+		this->refreshing = false;
+		cof::Error("[GameDataDatabase] Failed to start refreshing the game data: {}", exception.what());
+	}
+}
+
+void tbsg::GameDataDatabase::ApplyRefresh(RefreshedData& refreshed)
+{
+	// Everything is assigned in place, the cards keep their address.
+	std::size_t changedCards = 0;
+	for (Card& card : refreshed.cards.values)
+	{
+		Card* existing = this->cardIndex.Find(card.id);
+		if (existing == nullptr)
+		{
+			continue;
+		}
+
+		const auto& effects = existing->data.baseCardEffects;
+		const auto& newEffects = card.data.baseCardEffects;
+		const bool sameEffects = effects.size() == newEffects.size() && std::equal(effects.begin(), effects.end(), newEffects.begin(),
+			[](const BaseCardEffects& left, const BaseCardEffects& right)
+			{
+				return left.baseEffect == right.baseEffect && left.effectValue == right.effectValue;
+			});
+		if (sameEffects && existing->meta.name == card.meta.name && existing->meta.description == card.meta.description
+			&& existing->meta.rarity == card.meta.rarity && existing->meta.type == card.meta.type)
+		{
+			continue;
+		}
+
+		existing->meta = std::move(card.meta);
+		existing->data = std::move(card.data);
+		changedCards++;
+	}
+
+	std::size_t changedMonsterCards = 0;
+	const db::CardIndex<MonsterCard> monsterCardIndex{ this->monsterCards };
+	for (MonsterCard& card : refreshed.monsterCards.values)
+	{
+		MonsterCard* existing = monsterCardIndex.Find(card.id);
+		if (existing == nullptr)
+		{
+			continue;
+		}
+		if (existing->meta.name == card.meta.name && existing->meta.description == card.meta.description
+			&& existing->data.maxHealth == card.data.maxHealth && existing->data.monsterTrait == card.data.monsterTrait)
+		{
+			continue;
+		}
+
+		existing->meta = std::move(card.meta);
+		existing->data.maxHealth = card.data.maxHealth;
+		existing->data.health = card.data.maxHealth;
+		existing->data.monsterTrait = card.data.monsterTrait;
+		changedMonsterCards++;
+	}
+
+	std::size_t changedScripts = 0;
+	for (Script& changed : refreshed.scripts)
+	{
+		for (Script& script : this->scripts.values)
+		{
+			if (script.id == changed.id)
+			{
+				script.code = changed.code;
+				script.revision = changed.revision;
+				changedScripts++;
+			}
+		}
+	}
+
+	if (changedCards + changedMonsterCards + changedScripts > 0)
+	{
+		cof::Info("[GameDataDatabase] Refreshed {} cards, {} monster cards and {} scripts.", changedCards, changedMonsterCards, changedScripts);
+	}
 }
 
 void tbsg::GameDataDatabase::LoadDecksOfProfile(unsigned int profileId)
 {
-	this->decks[profileId] = api->GetDecksOfProfile(profileId, this->cards);
+	LoadDecksOfProfiles(ptl::vector<unsigned int>{ profileId });
+}
+
+void tbsg::GameDataDatabase::LoadDecksOfProfiles(const ptl::vector<unsigned int>& profileIds)
+{
+	for (auto& pair : api->GetDecksOfProfiles(profileIds, this->cardIndex))
+	{
+		this->decks[pair.first] = std::move(pair.second);
+	}
 }
 
 bool tbsg::GameDataDatabase::LoadMonsterDeck(unsigned deckId)
@@ -100,7 +316,7 @@ const ptl::sparse_set<unsigned, tbsg::Card>& tbsg::GameDataDatabase::GetCards()
 
 tbsg::Card* tbsg::GameDataDatabase::GetCard(unsigned id)
 {
-	return &cards.at(id);
+	return cardIndex.Find(id);
 }
 
 tbsg::Card* tbsg::GameDataDatabase::GetCard(std::string name)
@@ -0,0 +1,648 @@
+#include "GameDataSnapshot.h"
+#include "GameDataDatabase.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "LoggingFunction.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	enum Section : std::size_t
+	{
+		Cards,
+		CardEffects,
+		MonsterCards,
+		MonsterDecks,
+		MonsterDeckCards,
+		CardTypes,
+		CardRarities,
+		Scripts,
+		/// The characters of all strings, its count is in bytes.
+		Strings,
+		SectionCount
+	};
+
+	struct SectionEntry
+	{
+		std::uint64_t offset;
+		std::uint64_t count;
+	};
+
+	struct FileHeader
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t projectId;
+		std::uint64_t fileSize;
+		/// FNV-1a of everything after the header.
+		std::uint64_t checksum;
+		SectionEntry sections[SectionCount];
+	};
+
+	constexpr char fileMagic[8] = { 'T', 'B', 'S', 'G', 'D', 'A', 'T', 'A' };
+
+	/**
+	 * \brief A string in the Strings section.
+	 */
+	struct StringRef
+	{
+		std::uint32_t offset;
+		std::uint32_t length;
+	};
+
+	struct CardRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		StringRef name;
+		StringRef description;
+		std::uint32_t rarity;
+		std::uint32_t type;
+		/// Range in the CardEffects section.
+		std::uint32_t firstEffect;
+		std::uint32_t effectCount;
+	};
+
+	struct CardEffectRecord
+	{
+		std::uint32_t effect;
+		std::int32_t value;
+	};
+
+	struct MonsterCardRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		StringRef name;
+		StringRef description;
+		std::uint32_t health;
+		std::uint32_t maxHealth;
+		std::uint32_t armor;
+		std::uint32_t monsterTrait;
+	};
+
+	struct MonsterDeckRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		StringRef name;
+		/// Range of monster card ids in the MonsterDeckCards section.
+		std::uint32_t firstCard;
+		std::uint32_t cardCount;
+	};
+
+	/**
+	 * \brief Card types and card rarities.
+	 */
+	struct NamedRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		StringRef name;
+	};
+
+	struct ScriptRecord
+	{
+		std::uint32_t key;
+		std::uint32_t id;
+		std::uint32_t cardId;
+		std::uint32_t monsterCardId;
+		std::uint32_t revision;
+		StringRef name;
+		StringRef code;
+	};
+
+	constexpr std::size_t recordSizes[SectionCount] = {
+		sizeof(CardRecord),
+		sizeof(CardEffectRecord),
+		sizeof(MonsterCardRecord),
+		sizeof(MonsterDeckRecord),
+		sizeof(std::uint32_t),
+		sizeof(NamedRecord),
+		sizeof(NamedRecord),
+		sizeof(ScriptRecord),
+		sizeof(char),
+	};
+
+	/// Sections start on this alignment, so records can be read in place from the mapping.
+	constexpr std::size_t sectionAlignment = 8;
+
+	std::uint64_t Checksum(const char* data, std::size_t size)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (std::size_t i = 0; i < size; i++)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	/**
+	 * \brief Collects the sections of a snapshot. Equal strings are stored once.
+	 */
+	class SnapshotBuilder
+	{
+	public:
+		template<typename Record>
+		void Add(Section section, const Record& record)
+		{
+			static_assert(std::is_trivially_copyable<Record>::value, "Records are copied into the file byte for byte.");
+			std::vector<char>& data = this->sections[section];
+			const char* bytes = reinterpret_cast<const char*>(&record);
+			data.insert(data.end(), bytes, bytes + sizeof(Record));
+		}
+
+		std::uint32_t GetCount(Section section) const
+		{
+			return static_cast<std::uint32_t>(this->sections[section].size() / recordSizes[section]);
+		}
+
+		StringRef AddString(const ptl::string& string)
+		{
+			const std::string value(string.data(), string.size());
+			auto it = this->strings.find(value);
+			if (it != this->strings.end())
+			{
+				return it->second;
+			}
+
+			std::vector<char>& data = this->sections[Strings];
+			const StringRef ref{ static_cast<std::uint32_t>(data.size()), static_cast<std::uint32_t>(value.size()) };
+			data.insert(data.end(), value.begin(), value.end());
+			this->strings.emplace(value, ref);
+			return ref;
+		}
+
+		std::vector<char> Build(unsigned int projectId) const
+		{
+			FileHeader header{};
+			std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+			header.version = tbsg::GameDataSnapshot::formatVersion;
+			header.projectId = projectId;
+
+			std::vector<char> file(sizeof(FileHeader));
+			for (std::size_t section = 0; section < SectionCount; section++)
+			{
+				file.resize((file.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment);
+				header.sections[section].offset = file.size();
+				header.sections[section].count = this->sections[section].size() / recordSizes[section];
+				file.insert(file.end(), this->sections[section].begin(), this->sections[section].end());
+			}
+
+			header.fileSize = file.size();
+			header.checksum = Checksum(file.data() + sizeof(FileHeader), file.size() - sizeof(FileHeader));
+			std::memcpy(file.data(), &header, sizeof(FileHeader));
+			return file;
+		}
+
+	private:
+		std::vector<char> sections[SectionCount]{};
+		std::unordered_map<std::string, StringRef> strings{};
+	};
+}
+
+struct tbsg::GameDataSnapshot::Mapping
+{
+	const char* data{ nullptr };
+	std::size_t size{ 0 };
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE fileMapping{ nullptr };
+#endif
+
+	~Mapping()
+	{
+#ifdef _WIN32
+		if (data != nullptr)
+		{
+			UnmapViewOfFile(data);
+		}
+		if (fileMapping != nullptr)
+		{
+			CloseHandle(fileMapping);
+		}
+		if (file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file);
+		}
+#else
+		if (data != nullptr)
+		{
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
+	}
+
+	bool Map(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER fileSize{};
+		// Empty files can't be mapped, and are too small for a snapshot anyway.
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader)))
+		{
+			return false;
+		}
+		fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (fileMapping == nullptr)
+		{
+			return false;
+		}
+		data = static_cast<const char*>(MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0));
+		size = static_cast<std::size_t>(fileSize.QuadPart);
+		return data != nullptr;
+#else
+		const int descriptor = open(path.c_str(), O_RDONLY);
+		if (descriptor < 0)
+		{
+			return false;
+		}
+		struct stat status{};
+		if (fstat(descriptor, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(FileHeader)))
+		{
+			close(descriptor);
+			return false;
+		}
+		void* view = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		// The mapping keeps the file open.
+		close(descriptor);
+		if (view == MAP_FAILED)
+		{
+			return false;
+		}
+		data = static_cast<const char*>(view);
+		size = static_cast<std::size_t>(status.st_size);
+		return true;
+#endif
+	}
+};
+
+bool tbsg::GameDataSnapshot::Write(const GameDataDatabase& database, unsigned int projectId, const std::string& path)
+{
+	SnapshotBuilder builder{};
+
+	const auto& cards = database.cards;
+	for (std::size_t i = 0; i < cards.keys.size(); i++)
+	{
+		const Card& card = cards.values[i];
+		CardRecord record{};
+		record.key = cards.keys[i];
+		record.id = card.id;
+		record.name = builder.AddString(card.meta.name);
+		record.description = builder.AddString(card.meta.description);
+		record.rarity = card.meta.rarity;
+		record.type = card.meta.type;
+		record.firstEffect = builder.GetCount(CardEffects);
+		record.effectCount = static_cast<std::uint32_t>(card.data.baseCardEffects.size());
+		for (const BaseCardEffects& effect : card.data.baseCardEffects)
+		{
+			builder.Add(CardEffects, CardEffectRecord{ static_cast<std::uint32_t>(effect.baseEffect), effect.effectValue });
+		}
+		builder.Add(Cards, record);
+	}
+
+	const auto& monsterCards = database.monsterCards;
+	for (std::size_t i = 0; i < monsterCards.keys.size(); i++)
+	{
+		const MonsterCard& card = monsterCards.values[i];
+		MonsterCardRecord record{};
+		record.key = monsterCards.keys[i];
+		record.id = card.id;
+		record.name = builder.AddString(card.meta.name);
+		record.description = builder.AddString(card.meta.description);
+		record.health = card.data.health;
+		record.maxHealth = card.data.maxHealth;
+		record.armor = card.data.armor;
+		record.monsterTrait = card.data.monsterTrait;
+		builder.Add(MonsterCards, record);
+	}
+
+	const auto& monsterDecks = database.monsterDecks;
+	for (std::size_t i = 0; i < monsterDecks.keys.size(); i++)
+	{
+		const MonsterDeck& deck = monsterDecks.values[i];
+		MonsterDeckRecord record{};
+		record.key = monsterDecks.keys[i];
+		record.id = deck.id;
+		record.name = builder.AddString(deck.name);
+		record.firstCard = builder.GetCount(MonsterDeckCards);
+		record.cardCount = static_cast<std::uint32_t>(deck.cards.size());
+		for (const MonsterCard* card : deck.cards)
+		{
+			builder.Add(MonsterDeckCards, static_cast<std::uint32_t>(card->id));
+		}
+		builder.Add(MonsterDecks, record);
+	}
+
+	for (std::size_t i = 0; i < database.cardTypes.keys.size(); i++)
+	{
+		const CardType& type = database.cardTypes.values[i];
+		builder.Add(CardTypes, NamedRecord{ database.cardTypes.keys[i], type.id, builder.AddString(type.name) });
+	}
+	for (std::size_t i = 0; i < database.cardRarity.keys.size(); i++)
+	{
+		const CardRarity& rarity = database.cardRarity.values[i];
+		builder.Add(CardRarities, NamedRecord{ database.cardRarity.keys[i], rarity.id, builder.AddString(rarity.name) });
+	}
+
+	const auto& scripts = database.scripts;
+	for (std::size_t i = 0; i < scripts.keys.size(); i++)
+	{
+		const Script& script = scripts.values[i];
+		ScriptRecord record{};
+		record.key = scripts.keys[i];
+		record.id = script.id;
+		record.cardId = script.cardId;
+		record.monsterCardId = script.monsterCardId;
+		record.revision = script.revision;
+		record.name = builder.AddString(script.name);
+		record.code = builder.AddString(script.code);
+		builder.Add(Scripts, record);
+	}
+
+	const std::vector<char> file = builder.Build(projectId);
+
+	// Write next to the old file first, so a crash or a full disk never leaves a broken snapshot behind.
+	const std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+		output.write(file.data(), static_cast<std::streamsize>(file.size()));
+		if (!output)
+		{
+			cof::Error("[GameDataSnapshot] Failed to write {}.", temporaryPath);
+			return false;
+		}
+	}
+	// Replace the old file in one step, a server starting meanwhile opens either the old or the new snapshot.
+#ifdef _WIN32
+	if (!MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+#endif
+	{
+		cof::Error("[GameDataSnapshot] Failed to replace {}.", path);
+		return false;
+	}
+
+	cof::Info("[GameDataSnapshot] Wrote {} bytes to {}.", file.size(), path);
+	return true;
+}
+
+std::unique_ptr<tbsg::GameDataSnapshot> tbsg::GameDataSnapshot::Open(const std::string& path)
+{
+	auto mapping = std::make_unique<Mapping>();
+	if (!mapping->Map(path))
+	{
+		cof::Info("[GameDataSnapshot] No usable snapshot at {}.", path);
+		return nullptr;
+	}
+
+	std::unique_ptr<GameDataSnapshot> snapshot{ new GameDataSnapshot(std::move(mapping)) };
+	if (!snapshot->Validate(path))
+	{
+		return nullptr;
+	}
+	return snapshot;
+}
+
+tbsg::GameDataSnapshot::GameDataSnapshot(std::unique_ptr<Mapping> mapping) : mapping(std::move(mapping))
+{
+}
+
+tbsg::GameDataSnapshot::~GameDataSnapshot() = default;
+
+unsigned int tbsg::GameDataSnapshot::GetProjectId() const
+{
+	return reinterpret_cast<const FileHeader*>(this->mapping->data)->projectId;
+}
+
+bool tbsg::GameDataSnapshot::HasLatestScripts(const ptl::unordered_map<unsigned int, unsigned int>& latestRevisions) const
+{
+	const ScriptRecord* scripts = GetRecords<ScriptRecord>(Scripts);
+	for (std::size_t i = 0; i < GetCount(Scripts); i++)
+	{
+		auto it = latestRevisions.find(scripts[i].id);
+		if (it == latestRevisions.end() || it->second != scripts[i].revision)
+		{
+			cof::Info("[GameDataSnapshot] Script {} changed since the snapshot was written.", scripts[i].id);
+			return false;
+		}
+	}
+	return true;
+}
+
+void tbsg::GameDataSnapshot::Load(GameDataDatabase& database) const
+{
+	const char* strings = GetRecords<char>(Strings);
+	auto toString = [strings](StringRef ref)
+	{
+		return ptl::string(strings + ref.offset, ref.length);
+	};
+
+	const CardRecord* cardRecords = GetRecords<CardRecord>(Cards);
+	const CardEffectRecord* effectRecords = GetRecords<CardEffectRecord>(CardEffects);
+	database.cards.clear();
+	database.cards.reserve(GetCount(Cards));
+	for (std::size_t i = 0; i < GetCount(Cards); i++)
+	{
+		const CardRecord& record = cardRecords[i];
+		Card card{};
+		card.id = record.id;
+		card.meta.name = toString(record.name);
+		card.meta.description = toString(record.description);
+		card.meta.rarity = record.rarity;
+		card.meta.type = record.type;
+		card.data.baseCardEffects.reserve(record.effectCount);
+		for (std::uint32_t effect = record.firstEffect; effect < record.firstEffect + record.effectCount; effect++)
+		{
+			card.data.baseCardEffects.emplace_back(BaseCardEffects{ static_cast<BaseEffect>(effectRecords[effect].effect), effectRecords[effect].value });
+		}
+		database.cards.insert(static_cast<unsigned int>(record.key), std::move(card));
+	}
+	database.cardIndex.Build(database.cards);
+
+	const MonsterCardRecord* monsterCardRecords = GetRecords<MonsterCardRecord>(MonsterCards);
+	database.monsterCards.clear();
+	database.monsterCards.reserve(GetCount(MonsterCards));
+	for (std::size_t i = 0; i < GetCount(MonsterCards); i++)
+	{
+		const MonsterCardRecord& record = monsterCardRecords[i];
+		MonsterCard card{};
+		card.id = record.id;
+		card.meta.name = toString(record.name);
+		card.meta.description = toString(record.description);
+		card.data.health = record.health;
+		card.data.maxHealth = record.maxHealth;
+		card.data.armor = record.armor;
+		card.data.monsterTrait = record.monsterTrait;
+		database.monsterCards.insert(static_cast<unsigned int>(record.key), std::move(card));
+	}
+
+	// The decks point into the monster cards, which are complete now.
+	const db::CardIndex<MonsterCard> monsterCardIndex{ database.monsterCards };
+	const MonsterDeckRecord* deckRecords = GetRecords<MonsterDeckRecord>(MonsterDecks);
+	const std::uint32_t* deckCards = GetRecords<std::uint32_t>(MonsterDeckCards);
+	database.monsterDecks.clear();
+	database.monsterDecks.reserve(GetCount(MonsterDecks));
+	for (std::size_t i = 0; i < GetCount(MonsterDecks); i++)
+	{
+		const MonsterDeckRecord& record = deckRecords[i];
+		MonsterDeck deck{};
+		deck.id = record.id;
+		deck.name = toString(record.name);
+		deck.cards.reserve(record.cardCount);
+		for (std::uint32_t card = record.firstCard; card < record.firstCard + record.cardCount; card++)
+		{
+			MonsterCard* monsterCard = monsterCardIndex.Find(deckCards[card]);
+			if (monsterCard != nullptr)
+			{
+				deck.cards.push_back(monsterCard);
+			}
+		}
+		database.monsterDecks.insert(static_cast<unsigned int>(record.key), std::move(deck));
+	}
+
+	const NamedRecord* typeRecords = GetRecords<NamedRecord>(CardTypes);
+	database.cardTypes.clear();
+	database.cardTypes.reserve(GetCount(CardTypes));
+	for (std::size_t i = 0; i < GetCount(CardTypes); i++)
+	{
+		database.cardTypes.insert(static_cast<unsigned int>(typeRecords[i].key), CardType{ typeRecords[i].id, toString(typeRecords[i].name) });
+	}
+
+	const NamedRecord* rarityRecords = GetRecords<NamedRecord>(CardRarities);
+	database.cardRarity.clear();
+	database.cardRarity.reserve(GetCount(CardRarities));
+	for (std::size_t i = 0; i < GetCount(CardRarities); i++)
+	{
+		database.cardRarity.insert(static_cast<unsigned int>(rarityRecords[i].key), CardRarity{ rarityRecords[i].id, toString(rarityRecords[i].name) });
+	}
+
+	const ScriptRecord* scriptRecords = GetRecords<ScriptRecord>(Scripts);
+	database.scripts.clear();
+	database.scripts.reserve(GetCount(Scripts));
+	for (std::size_t i = 0; i < GetCount(Scripts); i++)
+	{
+		const ScriptRecord& record = scriptRecords[i];
+		Script script{};
+		script.id = record.id;
+		script.cardId = record.cardId;
+		script.monsterCardId = record.monsterCardId;
+		script.revision = record.revision;
+		script.name = toString(record.name);
+		script.code = toString(record.code);
+		database.scripts.insert(static_cast<unsigned int>(record.key), std::move(script));
+	}
+}
+
+bool tbsg::GameDataSnapshot::Validate(const std::string& path) const
+{
+	const FileHeader& header = *reinterpret_cast<const FileHeader*>(this->mapping->data);
+	if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0)
+	{
+		cof::Warn("[GameDataSnapshot] {} is not a snapshot.", path);
+		return false;
+	}
+	if (header.version != formatVersion)
+	{
+		cof::Warn("[GameDataSnapshot] {} has format version {}, expected {}.", path, header.version, formatVersion);
+		return false;
+	}
+	if (header.fileSize != this->mapping->size)
+	{
+		cof::Warn("[GameDataSnapshot] {} is {} bytes, expected {}.", path, this->mapping->size, header.fileSize);
+		return false;
+	}
+	if (header.checksum != Checksum(this->mapping->data + sizeof(FileHeader), this->mapping->size - sizeof(FileHeader)))
+	{
+		cof::Warn("[GameDataSnapshot] {} is damaged, its checksum doesn't match.", path);
+		return false;
+	}
+
+	for (std::size_t section = 0; section < SectionCount; section++)
+	{
+		const SectionEntry& entry = header.sections[section];
+		if (entry.offset % sectionAlignment != 0 || entry.offset > header.fileSize
+			|| entry.count > (header.fileSize - entry.offset) / recordSizes[section])
+		{
+			cof::Warn("[GameDataSnapshot] {} has a section outside of the file.", path);
+			return false;
+		}
+	}
+
+	// Everything that refers to another section has to stay inside of it.
+	const std::uint64_t stringsSize = GetCount(Strings);
+	auto isInStrings = [stringsSize](StringRef ref)
+	{
+		return ref.offset <= stringsSize && ref.length <= stringsSize - ref.offset;
+	};
+	auto isRange = [](std::uint32_t first, std::uint32_t count, std::size_t size)
+	{
+		return first <= size && count <= size - first;
+	};
+
+	bool valid = true;
+	const CardRecord* cards = GetRecords<CardRecord>(Cards);
+	for (std::size_t i = 0; i < GetCount(Cards); i++)
+	{
+		valid = valid && isInStrings(cards[i].name) && isInStrings(cards[i].description) && isRange(cards[i].firstEffect, cards[i].effectCount, GetCount(CardEffects));
+	}
+	const MonsterCardRecord* monsterCards = GetRecords<MonsterCardRecord>(MonsterCards);
+	for (std::size_t i = 0; i < GetCount(MonsterCards); i++)
+	{
+		valid = valid && isInStrings(monsterCards[i].name) && isInStrings(monsterCards[i].description);
+	}
+	const MonsterDeckRecord* decks = GetRecords<MonsterDeckRecord>(MonsterDecks);
+	for (std::size_t i = 0; i < GetCount(MonsterDecks); i++)
+	{
+		valid = valid && isInStrings(decks[i].name) && isRange(decks[i].firstCard, decks[i].cardCount, GetCount(MonsterDeckCards));
+	}
+	for (std::size_t section : { CardTypes, CardRarities })
+	{
+		const NamedRecord* records = GetRecords<NamedRecord>(section);
+		for (std::size_t i = 0; i < GetCount(section); i++)
+		{
+			valid = valid && isInStrings(records[i].name);
+		}
+	}
+	const ScriptRecord* scripts = GetRecords<ScriptRecord>(Scripts);
+	for (std::size_t i = 0; i < GetCount(Scripts); i++)
+	{
+		valid = valid && isInStrings(scripts[i].name) && isInStrings(scripts[i].code);
+	}
+
+	if (!valid)
+	{
+		cof::Warn("[GameDataSnapshot] {} refers to data outside of its sections.", path);
+	}
+	return valid;
+}
+
+template<typename Record>
+const Record* tbsg::GameDataSnapshot::GetRecords(std::size_t section) const
+{
+	const FileHeader& header = *reinterpret_cast<const FileHeader*>(this->mapping->data);
+	return reinterpret_cast<const Record*>(this->mapping->data + header.sections[section].offset);
+}
+
+std::size_t tbsg::GameDataSnapshot::GetCount(std::size_t section) const
+{
+	const FileHeader& header = *reinterpret_cast<const FileHeader*>(this->mapping->data);
+	return static_cast<std::size_t>(header.sections[section].count);
+}
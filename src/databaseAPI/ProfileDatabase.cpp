@@ -33,12 +33,52 @@ tbsg::SessionTokenResponse tbsg::ProfileDatabase::CheckSessionToken(net::Connect
 		}
 	}
 
-	Profile profile = api->GetProfile(profileId);
+	return ClaimProfile(connection->GetConnectionId(), api->GetProfile(profileId));
+}
+
+void tbsg::ProfileDatabase::CheckSessionTokenAsync(unsigned int connectionId, ptl::string token, std::function<void(SessionTokenResponse)> callback)
+{
+	// Both lookups run on the same worker, the profile is only added on the thread that drains the completions.
+	// The completion may be drained after this database was destroyed, it is dropped then.
+	std::weak_ptr<bool> lifetime = this->lifetime;
+	api->RunAsync([token](const db::DatabaseAPI& database)
+	{
+		const unsigned int profileId = database.GetProfileId(token);
+		return profileId == 0 ? Profile{} : database.GetProfile(profileId);
+	}, [this, lifetime, connectionId, callback](std::future<Profile> result)
+	{
+		if (lifetime.expired())
+		{
+			return;
+		}
+		SessionTokenResponse response = SessionTokenResponse::Invalid;
+		try
+		{
+			response = ClaimProfile(connectionId, result.get());
+		}
+		catch (const std::exception& exception)
+		{
+			cof::Error("{} Failed to check the session token of connection {}: {}", prefix, static_cast<int>(connectionId), exception.what());
+		}
+		callback(response);
+	});
+}
+
+tbsg::SessionTokenResponse tbsg::ProfileDatabase::ClaimProfile(unsigned int connectionId, Profile profile)
+{
 	if (profile.id == 0)
 	{
 		return SessionTokenResponse::Invalid;
 	}
-	profile.connectionId = connection->GetConnectionId();
+
+	auto it = profiles.find(profile.id);
+	if (it != profiles.end() && it->second.connectionId != 0 && it->second.connectionId != connectionId)
+	{
+		cof::Info("{} Connection {} tried to connect with profile {} that is already in use.", prefix, static_cast<int>(connectionId), static_cast<int>(profile.id));
+		return SessionTokenResponse::InUse;
+	}
+
+	profile.connectionId = connectionId;
 	profiles[profile.id] = profile;
 	return SessionTokenResponse::Success;
 }
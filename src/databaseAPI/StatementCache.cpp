@@ -0,0 +1,62 @@
+#include "StatementCache.h"
+#include <utility>
+#include <errmsg.h>
+#include <mysqld_error.h>
+
+db::StatementCache::StatementCache(mariadb::connection_ref connection) : connection(std::move(connection))
+{
+}
+
+mariadb::result_set_ref db::StatementCache::Query(const std::string& sql)
+{
+	return Query(sql, [](mariadb::statement_ref&) {});
+}
+
+mariadb::result_set_ref db::StatementCache::QueryUnbuffered(const std::string& sql)
+{
+	return QueryUnbuffered(sql, [](mariadb::statement_ref&) {});
+}
+
+mariadb::statement_ref db::StatementCache::Get(const std::string& sql)
+{
+	auto it = statements.find(sql);
+	if (it != statements.end())
+	{
+		return it->second;
+	}
+
+	mariadb::statement_ref statement = connection->create_statement(sql);
+	if (!statement)
+	{
+		throw mariadb::exception::connection(CR_SERVER_GONE_ERROR, "Failed to prepare a statement, the database is not connected.");
+	}
+	statements.emplace(sql, statement);
+	return statement;
+}
+
+void db::StatementCache::Clear()
+{
+	statements.clear();
+}
+
+bool db::StatementCache::IsConnectionLost(unsigned int errorId)
+{
+	return errorId == CR_SERVER_GONE_ERROR
+		|| errorId == CR_SERVER_LOST
+		|| errorId == CR_NO_PREPARE_STMT
+		|| errorId == ER_UNKNOWN_STMT_HANDLER;
+}
+
+bool db::StatementCache::MayHaveRun(unsigned int errorId)
+{
+	// Gone and unknown statements are detected before the server runs anything.
+	return errorId == CR_SERVER_LOST;
+}
+
+void db::StatementCache::Reconnect()
+{
+	// The statements belong to the old session, the server forgot them.
+	Clear();
+	connection->disconnect();
+	connection->connect();
+}
@@ -0,0 +1,230 @@
+#include "WriteBehindQueue.h"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+std::size_t db::WriteBehindQueue::Pending::Count() const
+{
+	return ipLog.size() + pings.size() + occupied.size() + endedMatches.size();
+}
+
+db::WriteBehindQueue::WriteBehindQueue(ConnectionPool& pool, WriteBehindOptions options, FailureCallback onFailure)
+	: pool(pool), options(options), onFailure(std::move(onFailure))
+{
+	this->options.maxRowsPerStatement = std::max<std::size_t>(this->options.maxRowsPerStatement, 1);
+	this->flusher = std::thread(&WriteBehindQueue::FlushLoop, this);
+}
+
+db::WriteBehindQueue::~WriteBehindQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->wake.notify_one();
+	this->flusher.join();
+
+	Flush();
+}
+
+void db::WriteBehindQueue::RegisterIp(unsigned int profileId, unsigned int serverId, const std::string& ip)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->pending.ipLog.push_back(IpLogEntry{ profileId, serverId, ip });
+	Queued(lock);
+}
+
+void db::WriteBehindQueue::PingServer(unsigned int serverId)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->pending.pings.insert(serverId);
+	Queued(lock);
+}
+
+void db::WriteBehindQueue::SetServerOccupied(unsigned int serverId, bool isOccupied)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->pending.occupied[serverId] = isOccupied;
+	// Setting the occupied state updates lastOnline as well.
+	this->pending.pings.erase(serverId);
+	Queued(lock);
+}
+
+void db::WriteBehindQueue::EndMatch(unsigned int matchId)
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->pending.endedMatches.insert(matchId);
+	Queued(lock);
+}
+
+void db::WriteBehindQueue::Flush()
+{
+	std::lock_guard<std::mutex> flushLock(this->flushMutex);
+
+	Pending writes;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::swap(writes, this->pending);
+	}
+	Write(writes);
+}
+
+std::size_t db::WriteBehindQueue::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->pending.Count();
+}
+
+void db::WriteBehindQueue::Queued(std::unique_lock<std::mutex>& lock)
+{
+	const bool full = this->pending.Count() >= this->options.maxPending;
+	lock.unlock();
+	if (full)
+	{
+		this->wake.notify_one();
+	}
+}
+
+void db::WriteBehindQueue::FlushLoop()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (!this->stopping)
+	{
+		this->wake.wait_for(lock, this->options.flushInterval, [this]()
+		{
+			return this->stopping || this->pending.Count() >= this->options.maxPending;
+		});
+		if (this->stopping)
+		{
+			break;
+		}
+		if (this->pending.Count() == 0)
+		{
+			continue;
+		}
+
+		lock.unlock();
+		Flush();
+		lock.lock();
+	}
+}
+
+template<typename Work>
+void db::WriteBehindQueue::TryWrite(const char* description, std::size_t rows, Work work)
+{
+	try
+	{
+		work();
+	}
+	catch (const std::exception& exception)
+	{
+		if (this->onFailure)
+		{
+			this->onFailure(std::string(description) + " (" + std::to_string(rows) + " rows)", exception);
+		}
+	}
+}
+
+void db::WriteBehindQueue::Write(Pending& writes)
+{
+	if (writes.Count() == 0)
+	{
+		return;
+	}
+
+	std::unique_ptr<ConnectionPool::Lease> lease;
+	TryWrite("Borrowing a connection for queued writes", writes.Count(), [&]()
+	{
+		lease = std::make_unique<ConnectionPool::Lease>(this->pool.Acquire());
+	});
+	if (!lease)
+	{
+		return;
+	}
+	StatementCache& statements = lease->GetStatements();
+
+	for (std::size_t first = 0; first < writes.ipLog.size(); first += this->options.maxRowsPerStatement)
+	{
+		const std::size_t rows = std::min(this->options.maxRowsPerStatement, writes.ipLog.size() - first);
+		TryWrite("INSERT INTO `ipLog`", rows, [&]()
+		{
+			statements.Execute("INSERT INTO `ipLog` (`profileId`, `serverId`, `ip`, `date`) VALUES " + Repeat("(?, ?, ?, NOW())", rows) + ";", [&](mariadb::statement_ref& statement)
+			{
+				for (std::size_t row = 0; row < rows; row++)
+				{
+					const IpLogEntry& entry = writes.ipLog[first + row];
+					const auto index = static_cast<mariadb::u32>(row * 3);
+					statement->set_unsigned32(index, entry.profileId);
+					if (entry.serverId == 0)
+					{
+						statement->set_null(index + 1);
+					}
+					else
+					{
+						statement->set_unsigned32(index + 1, entry.serverId);
+					}
+					statement->set_string(index + 2, entry.ip);
+				}
+			});
+		});
+	}
+
+	for (bool isOccupied : { false, true })
+	{
+		std::set<unsigned int> servers;
+		for (const auto& pair : writes.occupied)
+		{
+			if (pair.second == isOccupied)
+			{
+				servers.insert(pair.first);
+			}
+		}
+		UpdateWhereIdIn(statements, "UPDATE `servers` SET `occupied`", "UPDATE `servers` SET `occupied`=?, `lastOnline`=NOW() WHERE `id` IN ", servers,
+			[isOccupied](mariadb::statement_ref& statement) { statement->set_unsigned32(0, isOccupied ? 1 : 0); }, 1);
+	}
+	UpdateWhereIdIn(statements, "UPDATE `servers` SET `lastOnline`", "UPDATE `servers` SET `lastOnline`=NOW() WHERE `id` IN ", writes.pings);
+	UpdateWhereIdIn(statements, "UPDATE `matches` SET `endDate`", "UPDATE `matches` SET `endDate`=NOW() WHERE `id` IN ", writes.endedMatches);
+}
+
+void db::WriteBehindQueue::UpdateWhereIdIn(StatementCache& statements, const char* description, const std::string& prefix, const std::set<unsigned int>& ids,
+	const std::function<void(mariadb::statement_ref&)>& bindPrefix, unsigned int prefixParameters)
+{
+	auto it = ids.begin();
+	while (it != ids.end())
+	{
+		const auto chunkEnd = std::next(it, static_cast<std::ptrdiff_t>(std::min<std::size_t>(this->options.maxRowsPerStatement, std::distance(it, ids.end()))));
+		const std::size_t rows = static_cast<std::size_t>(std::distance(it, chunkEnd));
+
+		TryWrite(description, rows, [&]()
+		{
+			statements.Execute(prefix + "(" + Repeat("?", rows) + ");", [&](mariadb::statement_ref& statement)
+			{
+				if (bindPrefix)
+				{
+					bindPrefix(statement);
+				}
+				mariadb::u32 index = prefixParameters;
+				for (auto id = it; id != chunkEnd; ++id)
+				{
+					statement->set_unsigned32(index++, *id);
+				}
+			});
+		});
+		it = chunkEnd;
+	}
+}
+
+std::string db::WriteBehindQueue::Repeat(const char* item, std::size_t count)
+{
+	std::string result;
+	for (std::size_t i = 0; i < count; i++)
+	{
+		if (i != 0)
+		{
+			result += ", ";
+		}
+		result += item;
+	}
+	return result;
+}
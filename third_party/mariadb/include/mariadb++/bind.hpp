@@ -49,6 +49,22 @@ class bind {
 
     void set(enum_field_types type, const char* buffer = nullptr, unsigned long length = 0, bool us = false);
 
+    /**
+     * Gets the size of the buffer of a variable length result bind
+     *
+     * @return Size of the buffer, zero for fixed length types
+     */
+    unsigned long capacity() const;
+
+    /**
+     * Prepares a variable length result bind for the next fetch: grows the buffer to hold at least
+     * length bytes and resets the buffer length, which every fetch overwrites with the value length.
+     * Does nothing for fixed length types.
+     *
+     * @param length Minimum size of the buffer
+     */
+    void reserve(unsigned long length = 0);
+
    private:
     MYSQL_BIND* m_bind;
     MYSQL_TIME m_time;
@@ -57,6 +73,8 @@ class bind {
     my_bool m_error;
 
     data_ref m_data;
+    // true if the value is stored in m_data instead of the union
+    bool m_variable_length = false;
 
     union {
         u64 m_unsigned64;
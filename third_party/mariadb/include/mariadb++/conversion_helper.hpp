@@ -10,6 +10,7 @@
 #define MARIADBCLIENTPP_CONVERSION_HELPER_H
 
 #include <limits>
+#include <stdexcept>
 
 #ifdef WIN32
 #undef max
@@ -125,7 +125,8 @@ class result_set : public last_error {
     u64 row_index() const;
 
     /**
-     * Gets the number of rows in this result
+     * Gets the number of rows in this result.
+     * For unbuffered results this is only known once all rows were fetched.
      *
      * @return Number of rows in result_set
      */
@@ -141,6 +142,7 @@ class result_set : public last_error {
     /**
      * Set the current row index in result_set (seek to result).
      * Also immediately fetches the selected row.
+     * Unbuffered results cannot seek.
      *
      * @param index Index of row to select
      * @return True if row could be seeked to and fetched.
@@ -155,6 +157,8 @@ class result_set : public last_error {
     MAKE_GETTER_DECL(time, time);
     MAKE_GETTER_DECL(decimal, decimal);
     MAKE_GETTER_DECL(string, std::string);
+    // characters of a string column without copying them, column_size() of them are valid until the next fetch
+    MAKE_GETTER_DECL(string_data, const char*);
     MAKE_GETTER_DECL(boolean, bool);
     MAKE_GETTER_DECL(unsigned8, u8);
     MAKE_GETTER_DECL(signed8, s8);
@@ -176,8 +180,18 @@ class result_set : public last_error {
 
     /**
      * Create result_set from statement
+     *
+     * @param buffered False to fetch rows from the server one at a time
+     */
+    result_set(const statement_data_ref& stmt, bool buffered);
+
+    /**
+     * Fetches the next row of an unbuffered statement result,
+     * growing the buffers of values that did not fit and fetching those again
+     *
+     * @return True if next row exists
      */
-    explicit result_set(const statement_data_ref& stmt);
+    bool fetch_unbuffered();
 
     /**
      * Throws if the result set was created, but no row was ever fetched (using next())
@@ -214,6 +228,10 @@ class result_set : public last_error {
     u32 m_field_count;
     // indicates if a row was fetched using next()
     bool m_was_fetched;
+    // indicates if all rows were received before the first fetch
+    bool m_buffered;
+    // indicates if an unbuffered fetch grew a buffer the client library does not know about yet
+    bool m_binds_grown;
 };
 
 typedef std::shared_ptr<result_set> result_set_ref;
@@ -63,6 +63,15 @@ class statement : public last_error {
      */
     result_set_ref query();
 
+    /**
+     * Execute the query and return a result set that receives its rows one at a time while they
+     * are fetched, instead of buffering the whole result on the client first.
+     * The connection cannot be used for anything else until the result set is read or released.
+     *
+     * @return Unbuffered result set
+     */
+    result_set_ref query_unbuffered();
+
     /**
      * Set connection ref, used by concurrency
      */
@@ -41,6 +41,19 @@ unsigned long bind::length() const { return m_bind->buffer_length; }
 
 bool bind::is_null() const { return (m_is_null != 0); }
 
+unsigned long bind::capacity() const { return m_data ? (unsigned long)m_data->size() : 0; }
+
+void bind::reserve(unsigned long length) {
+    if (!m_variable_length) return;
+
+    if (length > capacity()) {
+        m_data = data_ref(new data<char>(length));
+        m_bind->buffer = m_data->get();
+    }
+
+    m_bind->buffer_length = capacity();
+}
+
 void bind::set(enum_field_types type, const char* buffer, unsigned long length, bool us) {
     m_bind->buffer_type = type;
     m_bind->is_unsigned = us ? 1 : 0;
@@ -97,6 +110,8 @@ void bind::set(enum_field_types type, const char* buffer, unsigned long length,
         case MYSQL_TYPE_VARCHAR:
         case MYSQL_TYPE_VAR_STRING:
         case MYSQL_TYPE_STRING:
+            m_variable_length = true;
+
             if (length) {
                 m_data = data_ref(new data<char>(length));
                 m_bind->buffer = m_data->get();
@@ -10,6 +10,8 @@
 
 #include <mysql.h>
 #include <memory.h>
+#include <algorithm>
+#include <stdexcept>
 #include <mariadb++/connection.hpp>
 #include <mariadb++/result_set.hpp>
 #include <mariadb++/conversion_helper.hpp>
@@ -26,7 +28,9 @@ result_set::result_set(connection *connection)
       m_stmt_data(nullptr),
       m_lengths(nullptr),
       m_field_count(0),
-      m_was_fetched(false) {
+      m_was_fetched(false),
+      m_buffered(true),
+      m_binds_grown(false) {
 
     if (m_result_set) {
         m_field_count = mysql_num_fields(m_result_set);
@@ -36,7 +40,7 @@ result_set::result_set(connection *connection)
     }
 }
 
-result_set::result_set(const statement_data_ref &stmt_data)
+result_set::result_set(const statement_data_ref &stmt_data, bool buffered)
     : m_result_set(nullptr),
       m_fields(nullptr),
       m_row(nullptr),
@@ -44,12 +48,16 @@ result_set::result_set(const statement_data_ref &stmt_data)
       m_stmt_data(stmt_data),
       m_lengths(nullptr),
       m_field_count(0),
-      m_was_fetched(false) {
+      m_was_fetched(false),
+      m_buffered(buffered),
+      m_binds_grown(false) {
 
-    int max_length = 1;
+    // buffered results size the variable length binds to the longest value of the column,
+    // unbuffered results start out empty and grow them in fetch_unbuffered()
+    int max_length = buffered ? 1 : 0;
     mysql_stmt_attr_set(stmt_data->m_statement, STMT_ATTR_UPDATE_MAX_LENGTH, &max_length);
 
-    if (mysql_stmt_store_result(stmt_data->m_statement))
+    if (buffered && mysql_stmt_store_result(stmt_data->m_statement))
         STMT_ERROR(stmt_data->m_statement)
     else {
         m_field_count = mysql_stmt_field_count(stmt_data->m_statement);
@@ -176,6 +184,8 @@ unsigned long result_set::column_size(u32 index) const {
 }
 
 bool result_set::set_row_index(u64 index) {
+    if (!m_buffered) throw std::logic_error("Cannot seek in an unbuffered result set");
+
     if (m_stmt_data)
         mysql_stmt_data_seek(m_stmt_data->m_statement, index);
     else
@@ -186,7 +196,11 @@ bool result_set::set_row_index(u64 index) {
 bool result_set::next() {
     if (!m_result_set) return (m_was_fetched = false);
 
-    if (m_stmt_data) return (m_was_fetched = !mysql_stmt_fetch(m_stmt_data->m_statement));
+    if (m_stmt_data) {
+        if (!m_buffered) return (m_was_fetched = fetch_unbuffered());
+
+        return (m_was_fetched = !mysql_stmt_fetch(m_stmt_data->m_statement));
+    }
 
     m_row = mysql_fetch_row(m_result_set);
     m_lengths = mysql_fetch_lengths(m_result_set);
@@ -195,6 +209,43 @@ bool result_set::next() {
     return (m_was_fetched = m_row != nullptr);
 }
 
+bool result_set::fetch_unbuffered() {
+    MYSQL_STMT *statement = m_stmt_data->m_statement;
+
+    for (u32 i = 0; i < m_field_count; ++i) m_binds[i]->reserve();
+
+    // the client library fetches into its own copy of the binds, so grown buffers have to be
+    // bound again; done here, where every buffer_length holds the capacity of its buffer again
+    if (m_binds_grown) {
+        if (mysql_stmt_bind_result(statement, m_raw_binds)) STMT_ERROR(statement)
+        m_binds_grown = false;
+    }
+
+    const int status = mysql_stmt_fetch(statement);
+    if (status == MYSQL_NO_DATA) return false;
+    if (status == 1) STMT_ERROR(statement)
+
+    if (status == MYSQL_DATA_TRUNCATED) {
+        for (u32 i = 0; i < m_field_count; ++i) {
+            bind &column = *m_binds[i];
+
+            // the fetch stored the full length of the value, and the library was bound to the
+            // current capacity, so only longer values were cut off
+            const unsigned long length = column.length();
+            if (!column.m_variable_length || length <= column.capacity()) continue;
+
+            // grow by at least double, so the buffers settle after a few rows
+            column.reserve(std::max(length, column.capacity() * 2));
+            m_row[i] = column.buffer();
+            m_binds_grown = true;
+
+            if (mysql_stmt_fetch_column(statement, column.m_bind, i, 0)) STMT_ERROR(statement)
+        }
+    }
+
+    return true;
+}
+
 u64 result_set::row_index() const {
     if (m_stmt_data) return (u64)mysql_stmt_row_tell(m_stmt_data->m_statement);
 
@@ -293,6 +344,10 @@ MAKE_GETTER(string, std::string, value::type::string)
     return std::string(m_row[index], column_size(index));
 }
 
+MAKE_GETTER(string_data, const char*, value::type::string)
+    return m_row[index];
+}
+
 MAKE_GETTER(date, date_time, value::type::date)
     if (m_stmt_data) return mariadb::date_time(m_binds[index]->m_time);
 
@@ -69,7 +69,19 @@ result_set_ref statement::query() {
 
     if (mysql_stmt_execute(m_data->m_statement)) STMT_ERROR_RETURN_RS(m_data->m_statement);
 
-    rs.reset(new result_set(m_data));
+    rs.reset(new result_set(m_data, true));
+    return rs;
+}
+
+result_set_ref statement::query_unbuffered() {
+    result_set_ref rs;
+
+    if (m_data->m_raw_binds && mysql_stmt_bind_param(m_data->m_statement, m_data->m_raw_binds))
+        STMT_ERROR_RETURN_RS(m_data->m_statement);
+
+    if (mysql_stmt_execute(m_data->m_statement)) STMT_ERROR_RETURN_RS(m_data->m_statement);
+
+    rs.reset(new result_set(m_data, false));
     return rs;
 }
 
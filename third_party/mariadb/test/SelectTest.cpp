@@ -122,3 +122,25 @@ TEST_F(SelectTest, RealLimits) {
     EXPECT_FLOAT_EQ(0, res->get_float(3));
     EXPECT_FLOAT_EQ(0, res->get_double(4));
 }
+
+TEST_F(SelectTest, UnbufferedStrings) {
+    m_con->execute("CREATE TABLE " + m_table_name + " (seq INT, str TEXT);");
+
+    // a short value after a longer one, then one that fits the grown buffer, then a longer one
+    const std::string values[] = {std::string(100, 'a'), "short", std::string(60, 'b'),
+                                  std::string(300, 'c')};
+    for (int i = 0; i < 4; ++i)
+        m_con->execute("INSERT INTO " + m_table_name + " VALUES (" + std::to_string(i) + ", '" +
+                       values[i] + "');");
+
+    statement_ref stmt =
+        m_con->create_statement("SELECT str FROM " + m_table_name + " ORDER BY seq ASC;");
+    result_set_ref res = stmt->query_unbuffered();
+    ASSERT_TRUE(!!res);
+
+    for (const std::string& value : values) {
+        ASSERT_TRUE(res->next());
+        EXPECT_EQ(value, res->get_string(0));
+    }
+    ASSERT_FALSE(res->next());
+}